@@ -1,1357 +1,5036 @@
-#include <stdio.h>
-#include "FlvDecoder.h"
-#include "flv_mpegts.h"
-#include "common.h"
-
-
-#define NGX_RTMP_MSG_AUDIO              8
-#define NGX_RTMP_MSG_VIDEO              9
-#define NGX_RTMP_MSG_AMF3_META          15
-#define NGX_RTMP_MSG_AMF3_SHARED        16
-#define NGX_RTMP_MSG_AMF3_CMD           17
-#define NGX_RTMP_MSG_AMF_META           18
-#define NGX_RTMP_MSG_AMF_SHARED         19
-
-#define FLV_HLS_BUFSIZE            (1024*1024)
-#define FLV_HLS_DIR_ACCESS         0744
-int g_winfrages = 6;
-int g_fraglen = 3000;
-int g_max_fraglen = 5000;
-
-typedef struct {
-    u_int64_t                            id;
-    u_int64_t                            key_id;
-    double                              duration;
-    unsigned                            active:1;
-    unsigned                            discont:1; /* before */
-} hls_frag_t;
-
-typedef struct {
-    unsigned                            opened:1;
-
-    flv_mpegts_file_t                   file;
-
-    std::string                         playlist;
-    std::string                         playlist_bak;
-
-    char                                stream[1024];
-    int                                   stream_len;
-
-
-    u_int64_t                            frag;
-    u_int64_t                            frag_ts;
-    u_int32_t                          nfrags;
-    hls_frag_t                          *frags; /* circular 2 * winfrags + 1 */
-    u_int32_t                          winfrags;
-    u_int32_t                          max_fraglen;
-    u_int32_t                          fraglen;
-
-    u_int32_t                          audio_cc;
-    u_int32_t                          video_cc;
-    u_int32_t                          key_frags;
-
-    u_int64_t                            aframe_base;
-    u_int64_t                            aframe_num;
-
-    str_buf_t                            *aframe;
-    u_int64_t                            aframe_pts;
-    int                                bStart;
-    
-    int                          max_audio_delay;
-    u_int32_t                       sync;
-} hls_ctx_t;
-
-
-
-typedef struct Flv2hlsContext
-{
-    FlvFileReader flvreader;
-    FlvDecoder flvdec;
-    hls_ctx_t   hls_ctx;
-    av_codec_ctx_t  codec;
-}Flv2hlsContext_t;
-
-static hls_frag_t *
-hls_get_frag(hls_ctx_t  *ctx, int n)
-{
-    return &ctx->frags[(ctx->frag + n) % (ctx->winfrags * 2 + 1)];
-}
-
-
-Flv2hlsContext* flv_open_read(const char* file)
-{
-    Flv2hlsContext* flv = new Flv2hlsContext();
-    
-    if (flv->flvreader.open(file) != SUCCESS) {
-        flv_freep(flv);
-        return NULL;
-    }
-    
-    if (flv->flvdec.initialize(&flv->flvreader) != SUCCESS) {
-        flv_freep(flv);
-        return NULL;
-    }
-    
-    return flv;
-}
-
-void flv_close(Flv2hlsContext* flv)
-{
-    Flv2hlsContext* context = flv;
-    flv_freep(context);
-}
-
-int flv_read_header(Flv2hlsContext* flv, char (*header)[9], u_int32_t*pos)
-{
-    int ret = SUCCESS;
-    
-    Flv2hlsContext* context = (Flv2hlsContext*)flv;
-
-    if (!context->flvreader.is_open()) {
-        return ERROR_SYSTEM_IO_INVALID;
-    }
-    
-    if ((ret = context->flvdec.read_header(*header)) != SUCCESS) {
-        return ret;
-    }
-    
-    char ts[4]; // tag size
-    if ((ret = context->flvdec.read_previous_tag_size(ts)) != SUCCESS) {
-        return ret;
-    }
-    *pos = context->flvdec.getPosition();
-    return ret;
-}
-
-int flv_read_tag_header(Flv2hlsContext* context, char* ptype, u_int32_t *pdata_size, u_int32_t* ptime)
-{
-    int ret = SUCCESS;
-    
-
-    if (!context->flvreader.is_open()) {
-        return ERROR_SYSTEM_IO_INVALID;
-    }
-    
-    if ((ret = context->flvdec.read_tag_header(ptype, pdata_size, ptime)) != SUCCESS) {
-        return ret;
-    }
-    
-    return ret;
-}
-
-int flv_read_tag_data(Flv2hlsContext* context, char**data, u_int32_t size, char type)
-{
-    int ret = SUCCESS;
-    
-
-    if (!context->flvreader.is_open()) {
-        return ERROR_SYSTEM_IO_INVALID;
-    }
-    
-    if ((ret = context->flvdec.read_tag_data(data, size, type)) != SUCCESS) {
-        return ret;
-    }
-    
-    char ts[4]; // tag size
-    if ((ret = context->flvdec.read_previous_tag_size(ts)) != SUCCESS) {
-        return ret;
-    }
-    
-    return ret;
-}
-
-int hls_init_playlist(hls_ctx_t*ctx, char*hls_path)
-{
-    int ret = SUCCESS;
-    ctx->playlist = std::string(hls_path) + ".m3u8";
-    ctx->playlist_bak = ctx->playlist + ".bak";
-    return ret;
-}
-
-
-int flv_hls_copy(void *dst, u_int8_t**src, int n)
-{
-    u_char  *last;
-    size_t   pn;
-
-    if (src == NULL || dst == NULL) {
-        return -1;
-    }
-
-    memcpy(dst, *src, n);
-    *src += n;
-    return SUCCESS;
-}
-
-
-static int
-hls_append_aud(str_buf_t * out)
-{
-    static u_char   aud_nal[] = { 0x00, 0x00, 0x00, 0x01, 0x09, 0xf0 };
-
-    if (out->last + sizeof(aud_nal) > out->end) {
-        return ERROR_NORMAL;
-    }
-
-    memcpy(out->last, aud_nal, sizeof(aud_nal));
-    out->last += sizeof(aud_nal);
-    return SUCCESS;
-}
-
-static int
-hls_append_sps_pps(av_codec_ctx_t*codec_ctx, str_buf_t*out)
-{
-    u_int8_t                        *p;
-    u_int8_t                        *in;
-    hls_ctx_t             *ctx;
-    int8_t                          nnals;
-    u_int16_t                        len, rlen;
-    int                       n;
-    u_int8_t                        dummy[FLV_HLS_BUFSIZE];
-    in = codec_ctx->avc_header;
-
-    p = in;
-
-    /*
-     * Skip bytes:
-     * - flv fmt
-     * - H264 CONF/PICT (0x00)
-     * - 0
-     * - 0
-     * - 0
-     * - version
-     * - profile
-     * - compatibility
-     * - level
-     * - nal bytes
-     */
-    DEBUG("enter hls_append_sps_pps, buf size:%d\n", out->end-out->last);
-    if (flv_hls_copy(dummy, &p, 10) != SUCCESS) {
-        return SUCCESS;
-    }
-
-    /* number of SPS NALs */
-    if (flv_hls_copy(&nnals, &p, 1) != SUCCESS) {
-        return SUCCESS;
-    }
-
-    nnals &= 0x1f; /* 5lsb */
-
-    printf("hls: SPS number: %u\n", nnals);
-
-    /* SPS */
-    for (n = 0; ; ++n) {
-        for (; nnals; --nnals) {
-
-            /* NAL length */
-            if (flv_hls_copy(&rlen, &p, 2) != SUCCESS) {
-                return SUCCESS;
-            }
-
-            flv_rmemcpy(&len, &rlen, 2);
-
-            printf("hls: header NAL length: %u, buf size:%d\n", (size_t) len, out->end-out->last);
-
-            /* AnnexB prefix */
-            if (out->end - out->last < 4) {
-                printf( "hls: too small buffer for header NAL size\n");
-                return ERROR_NORMAL;
-            }
-
-            *out->last++ = 0;
-            *out->last++ = 0;
-            *out->last++ = 0;
-            *out->last++ = 1;
-
-            /* NAL body */
-            if (out->end - out->last < len) {
-                printf("hls: too small buffer for header NAL\n");
-                return ERROR_NORMAL;
-            }
-            
-            if (flv_hls_copy(out->last, &p, len) != SUCCESS) {
-                return SUCCESS;
-            }
-            out->last += len;
-
-        }
-
-        if (n == 1) {
-            break;
-        }
-
-        /* number of PPS NALs */
-        if (flv_hls_copy(&nnals, &p, 1) != SUCCESS) {
-            return SUCCESS;
-        }
-        DEBUG("PPS nnals:%d\n", nnals);
-    }
-
-    return SUCCESS;
-}
-
-static void
-hls_next_frag(hls_ctx_t *ctx)
-{
-
-    if (ctx->nfrags == ctx->winfrags) {
-        ctx->frag++;
-    } else {
-        ctx->nfrags++;
-    }
-}
-
-static int
-hls_rename_file(const char *src, const char *dst)
-{
-    /* rename file with overwrite */
-
-
-    rename(src, dst);
-   return SUCCESS;
-}
-
-
-static int
-hls_write_playlist(hls_ctx_t *ctx)
-{
-    static u_char                   buffer[1024];
-    int                                 fd;
-    u_char                         *p, *end;
-    ssize_t                         n;
-
-    hls_frag_t            *f;
-    u_int32_t                      i, max_frag;
-
-
-    fd = open(ctx->playlist_bak.c_str(), O_WRONLY|O_CREAT|O_TRUNC);
-
-    if (fd == -1) {
-        printf("hls: open file failed: '%s'\n",
-                      ctx->playlist_bak.c_str());
-        return ERROR_NORMAL;
-    }
-    fchmod(fd, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH);
-
-    max_frag = ctx->fraglen / 1000;
-
-    for (i = 0; i < ctx->nfrags; i++) {
-        f = hls_get_frag(ctx, i);
-        if (f->duration > max_frag) {
-            max_frag = (u_int32_t) (f->duration + .5);
-        }
-    }
-
-    p = buffer;
-    end = p + sizeof(buffer);
-
-    p += sprintf((char*)p, "#EXTM3U\n"
-                     "#EXT-X-VERSION:3\n"
-                     "#EXT-X-MEDIA-SEQUENCE:%u\n"
-                     "#EXT-X-TARGETDURATION:%u\n",
-                     ctx->frag, max_frag);
-
-    printf("will write buf:%s, size:%d", buffer, p-buffer);
-    n = write(fd, buffer, p - buffer);
-    if (n <= 0) {
-        printf("hls:write failed: '%s'\n",
-                      ctx->playlist_bak.c_str());
-        close(fd);
-        return ERROR_NORMAL;
-    }
-
-
-    for (i = 0; i < ctx->nfrags; i++) {
-        f = hls_get_frag(ctx, i);
-
-        p = buffer;
-        end = p + sizeof(buffer);
-
-        if (f->discont) {
-            p += sprintf((char*)p, "#EXT-X-DISCONTINUITY\n");
-        }
-
-
-        p += sprintf((char*)p, "#EXTINF:%.3f,\n"
-                         "%u.ts\n",
-                         f->duration, f->id);
-
-
-        n = write(fd, buffer, p - buffer);
-        if (n <= 0) {
-            printf("hls: write failed '%V'",
-                          ctx->playlist_bak.c_str());
-            close(fd);
-            return ERROR_NORMAL;
-        }
-    }
-
-    close(fd);
-
-    hls_rename_file(ctx->playlist_bak.c_str(), ctx->playlist.c_str());
-
-    return SUCCESS;
-}
-
-
-static int
-hls_close_fragment(hls_ctx_t *ctx, u_int32_t ts)
-{
-    DEBUG("hls_close_fragment frag:%d, nfrags:%d\n", ctx->frag, ctx->nfrags);
-    if( ctx->frag != 0 || ctx->nfrags != 0 )
-    {
-        close(ctx->file.fd);
-        ctx->opened = 0;
-    }else{
-    /*
-        if( ctx->aframe )
-        {
-            DEBUG("*********clean aframe***************\n");
-            memset(ctx->aframe->buf, 0, sizeof(MAX_FRAME_SIZE));
-            ctx->aframe->last = ctx->aframe->pos = ctx->aframe->start = ctx->aframe->buf;
-            ctx->aframe_pts = 0;
-        }
-        */
-        ctx->bStart = 1;
-    }
-    hls_next_frag(ctx);
-
-    if( ctx->frag != 0 || ctx->nfrags != 1)
-    {
-        hls_write_playlist(ctx);
-    }
-    return SUCCESS;
-}
-
-static u_int64_t
-flv_hls_get_fragment_id(hls_ctx_t*ctx)
-{
-    return ctx->frag + ctx->nfrags;    
-}
-
-static int
-hls_flush_audio(hls_ctx_t *ctx)
-{
-    flv_mpegts_frame_t         frame;
-    int                                rc;
-    str_buf_t                      *b;
-
-    b = ctx->aframe;
-
-    if (b == NULL || b->pos == b->last) {
-        return SUCCESS;
-    }
-
-
-    memset(&frame, 0, sizeof(frame));
+#include <stdio.h>
+#include <stdarg.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include "FlvDecoder.h"
+#include "flv_mpegts.h"
+#include "flv_mp4.h"
+#include "flv_hls_http.h"
+#include "flv_hls_sink.h"
+#include "flv_amf.h"
+#include "flv_salvage.h"
+#include "common.h"
+
+
+#define NGX_RTMP_MSG_AUDIO              8
+#define NGX_RTMP_MSG_VIDEO              9
+#define NGX_RTMP_MSG_AMF3_META          15
+#define NGX_RTMP_MSG_AMF3_SHARED        16
+#define NGX_RTMP_MSG_AMF3_CMD           17
+#define NGX_RTMP_MSG_AMF_META           18
+#define NGX_RTMP_MSG_AMF_SHARED         19
+
+#define FLV_HLS_BUFSIZE            (1024*1024)
+#define FLV_HLS_DIR_ACCESS         0744
+int g_winfrages = 6;
+int g_fraglen = 3000;
+int g_max_fraglen = 5000;
+char *g_http_listen = NULL;
+int g_http_segs = 0;
+int g_partlen = 0;
+int g_fmp4 = 0;
+int g_single = 0;
+int g_vod = 0;
+int g_audio = 0;
+int g_iframes = 0;
+int g_encrypt = 0;
+int g_sample_aes = 0;
+int g_crc = 0;
+int g_frags_per_key = 0;
+int g_expire = 0;
+int g_durable = 0;
+char *g_key_url = (char *) "";
+char *g_sink_url = NULL;
+char *g_checkpoint = NULL;
+int g_incremental = 0;
+flv_hls_sink_t *g_sink;
+
+/* outputs of the single pass, one by -o each */
+#define HLS_MAX_OUTPUTS            8
+
+char *g_outputs[HLS_MAX_OUTPUTS];
+u_int32_t g_noutputs = 0;
+
+/* renditions converted in parallel, one by -r each */
+char *g_renditions[HLS_MAX_OUTPUTS];
+u_int32_t g_nrenditions = 0;
+
+/* recent keyframes of a rendition kept for the others */
+#define HLS_ALIGN_KEYS             4
+
+/* keyframes of the renditions this close in msec are the same one */
+#define HLS_ALIGN_SLACK            10
+
+/* LL-HLS parts of a fragment, the last one takes the rest */
+#define HLS_MAX_PARTS              HLS_STORE_MAX_PARTS
+#define HLS_PART_SEGMENTS          3
+
+#define HLS_MP4_INIT               "init.mp4"
+
+/* a file being written, renamed to its name when complete */
+#define HLS_TMP_EXT                ".tmp"
+
+/* segments synced together at most */
+#define HLS_SYNC_MAX               64
+
+/* delta updates skip the fragments older than this many targets */
+#define HLS_SKIP_TARGETS           6
+
+/* vod lists from the first fragment, 0 is the empty one before it */
+#define HLS_VOD_SEQUENCE           1
+
+/* room for one formatted playlist entry */
+#define HLS_ENTRY_MAX              1024
+
+/* the key uri with the playlist name, an EXT-X-KEY fits an entry */
+#define HLS_KEY_URI_MAX            256
+
+/* single file mode grows the file ahead by this */
+#define HLS_SINGLE_PREALLOC        (16*1024*1024)
+
+/* a checkpoint at the first fragment this long after the last one */
+#define HLS_CHECKPOINT_MSEC        5000
+#define HLS_CHECKPOINT_MAGIC       "FLV2HLS1"
+
+/* bytes at each end of the input before the checkpoint hashed */
+#define HLS_INPUT_HASH             (64*1024)
+
+/* msec lost in a damaged range that make a discontinuity */
+#define HLS_SALVAGE_GAP            1000
+
+/* bytes of the input mapped at a time to find the tag after damage */
+#define HLS_SALVAGE_WINDOW         (64*1024*1024)
+
+typedef struct {
+    double                              duration;
+    unsigned                            independent:1;
+} hls_part_t;
+
+typedef struct {
+    u_int64_t                            id;
+    u_int64_t                            key_id;
+    double                              duration;
+    unsigned                            active:1;
+    unsigned                            discont:1; /* before */
+
+    off_t                               offset;  /* byte range in single file */
+    off_t                               size;
+
+    u_int32_t                           crc;       /* CRC32C of the bytes */
+
+    u_int64_t                           entry_off; /* in playlist entries */
+    u_int32_t                           entry_len;
+
+    u_int64_t                           iframe_off; /* in I-frame entries */
+    u_int32_t                           iframe_len;
+    u_int32_t                           niframes;
+
+    u_int32_t                           nparts;
+    hls_part_t                          parts[HLS_MAX_PARTS]; /* the last in progress */
+} hls_frag_t;
+
+/*
+ * the playlist entries of the window as formatted, appended when a
+ * fragment enters and trimmed from the head when it leaves.
+ */
+typedef struct {
+    u_char                              *data;
+    size_t                              pos;     /* oldest entry */
+    size_t                              last;
+    size_t                              cap;
+    u_int64_t                           base;    /* offset of data[0] */
+} hls_entries_t;
+
+typedef struct {
+    u_int64_t                           id;
+    u_int32_t                           duration;
+} hls_target_t;
+
+/* IDR of the fragment in progress, its TS packets in the file */
+typedef struct {
+    u_int64_t                           dts;
+    off_t                               offset;
+    off_t                               size;
+} hls_iframe_t;
+
+/* fragment out of the window, deleted some windows later */
+typedef struct {
+    u_int64_t                           id;
+    u_int64_t                           key_id;
+    unsigned                            active:1;
+} hls_expired_t;
+
+/* the checkpoint file, the arrays and the bytes of the output follow */
+typedef struct {
+    char                                magic[8];
+    u_int32_t                           head_size;
+    u_int32_t                           frag_size;
+    u_int32_t                           winfrags;
+    u_int32_t                           flags;     /* of the options */
+
+    int64_t                             offset;
+    u_int32_t                           input_crc; /* of the bytes before */
+    u_int32_t                           vstartime;
+    u_int32_t                           avc_header_size;
+    u_int32_t                           aac_header_size;
+    u_int32_t                           aframe_len;
+
+    u_int64_t                           frag;
+    u_int32_t                           nfrags;
+    u_int32_t                           target;
+    u_int32_t                           ntargets;
+    u_int32_t                           nexpired_max; /* 0 for none */
+    u_int32_t                           expired_head;
+    u_int32_t                           nexpired;
+
+    u_int32_t                           audio_cc;
+    u_int32_t                           video_cc;
+    u_int64_t                           aframe_base;
+    u_int64_t                           aframe_num;
+    u_int64_t                           aframe_pts;
+    int32_t                             bStart;
+    u_int32_t                           vod_target;
+    u_int32_t                           meta_target;
+    u_int64_t                           part_last_ts;
+    int64_t                             part_gap;
+
+    u_int32_t                           init_written;
+    u_int32_t                           mp4_seq;
+    u_int32_t                           mp4_video_duration;
+    u_int32_t                           mp4_audio_duration;
+
+    u_char                              key[16];
+    u_int64_t                           key_id;
+    u_int32_t                           key_frags;
+
+    int64_t                             single_size;
+    int64_t                             crc_size;  /* of the sidecar */
+
+    u_int64_t                           entries_base;
+    u_int64_t                           entries_len;
+    u_int64_t                           iframes_base;
+    u_int64_t                           iframes_len;
+    u_int64_t                           iframe_seq;
+    u_int32_t                           iframe_bw;
+
+    u_int32_t                           peak_bw;
+    u_int64_t                           bytes;
+    double                              seconds;
+} hls_checkpoint_head_t;
+
+/*
+ * where the input is at the tag being converted, with what the
+ * outputs do not keep, for the checkpoint taken at its fragment.
+ */
+typedef struct {
+    std::string                         path;
+    std::string                         path_bak;
+    std::string                         input;     /* empty for a stream */
+    int64_t                             offset;    /* of the tag */
+    u_int32_t                           vstartime;
+    av_codec_ctx_t                      *codec;
+    u_int64_t                           last;      /* msec, written */
+
+    /* the last close, written at the end of an incremental input */
+    unsigned                            incremental:1;
+    unsigned                            saved:1;
+    hls_checkpoint_head_t               head;
+    u_char                              *aframe;
+} hls_checkpoint_t;
+
+
+/*
+ * the damaged ranges of the input skipped. the PreviousTagSize are
+ * checked once the first one was right, muxers that write them wrong
+ * write them all wrong.
+ */
+typedef struct {
+    unsigned                            checked:1;
+    unsigned                            trailers:1;
+    u_int32_t                           last_ts;   /* of the last good tag */
+    u_int32_t                           nranges;
+    int64_t                             bytes;
+} hls_salvage_t;
+
+typedef struct {
+    unsigned                            opened:1;
+    unsigned                            resumed:1; /* closed, not opened */
+    unsigned                            discont:1; /* of the next fragment */
+
+    flv_mpegts_file_t                   file;
+
+    std::string                         playlist;
+    std::string                         playlist_bak;
+
+    char                                stream[1024];
+    int                                   stream_len;
+
+
+    u_int64_t                            frag;
+    u_int64_t                            frag_ts;
+    u_int32_t                          nfrags;
+    hls_frag_t                          *frags; /* circular 2 * winfrags + 1 */
+
+    hls_entries_t                       entries;
+    hls_target_t                        *targets; /* circular winfrags + 1 */
+    u_int32_t                           target;
+    u_int32_t                           ntargets;
+    u_int32_t                          winfrags;
+    u_int32_t                          max_fraglen;
+    u_int32_t                          fraglen;
+
+    u_int32_t                          audio_cc;
+    u_int32_t                          video_cc;
+    u_int32_t                          key_frags;
+
+    u_int64_t                            aframe_base;
+    u_int64_t                            aframe_num;
+
+    str_buf_t                            *aframe;
+    u_int64_t                            aframe_pts;
+    int                                bStart;
+    
+    int                          max_audio_delay;
+    u_int32_t                       sync;
+
+    hls_store_t                     *store; /* in memory for http, NULL to disable */
+    flv_hls_sink_t                  *sink;  /* segments and playlists go there */
+
+    u_int32_t                       partlen; /* LL-HLS part msec, 0 to disable */
+    u_int64_t                       part_ts;
+    u_int64_t                       part_last_ts;
+    int64_t                         part_gap;  /* max between frames */
+
+    unsigned                        fmp4:1;    /* fragmented mp4 segments */
+    unsigned                        init_written:1;
+    flv_mp4_t                       mp4;
+    av_codec_ctx_t                  *codec;
+
+    unsigned                        single:1;  /* all fragments in one file */
+    std::string                     single_name;
+    int                             single_fd;
+    off_t                           single_alloc;
+
+    unsigned                        vod:1;     /* whole list, written at end */
+    u_int32_t                       vod_target;
+    u_int32_t                       meta_target; /* by the keyframes table */
+
+    unsigned                        audio_only:1;
+    u_char                          ts_header[FLV_MPEGTS_HEADER_SIZE];
+
+    unsigned                        encrypt:1; /* AES-128 segments */
+    unsigned                        sample_aes:1; /* or the samples */
+    flv_aes_key_t                   aes;
+    u_char                          aes_iv[16];
+    u_char                          *saes;     /* encrypted AnnexB */
+    size_t                          saes_cap;
+    u_char                          *rbsp;     /* slice, no emulation */
+    size_t                          rbsp_cap;
+    u_int32_t                       frags_per_key; /* 0 for one key */
+    u_char                          key[16];
+    u_int64_t                       key_id;
+    std::string                     key_path;  /* "<key_path><id>.key" */
+    std::string                     key_uri;
+
+    u_int32_t                       crc;       /* 1 sidecar, 2 and m3u8 */
+    std::string                     crc_path;
+    int                             crc_fd;
+
+    unsigned                        iframes:1; /* I-frame playlist */
+    std::string                     iframes_playlist;
+    std::string                     iframes_playlist_bak;
+    hls_iframe_t                    *keys;
+    u_int32_t                       nkeys;
+    u_int32_t                       max_keys;
+    hls_entries_t                   iframe_entries;
+    u_int64_t                       iframe_seq;
+    u_int32_t                       iframe_bw;
+
+    u_int32_t                       durable;   /* fdatasync every n, 0 never */
+    u_int32_t                       unsynced;  /* segments closed since */
+    int                             sync_fds[HLS_SYNC_MAX];
+    u_int32_t                       nsync_fds;
+    unsigned                        sync_playlist:1;
+
+    u_int32_t                       expire;    /* windows kept, 0 forever */
+    hls_expired_t                   *expired;  /* expire windows of them */
+    u_int32_t                       expired_head;
+    u_int32_t                       nexpired;
+
+    /* measured for the master playlist */
+    u_int64_t                       bytes;
+    double                          seconds;
+    u_int32_t                       peak_bw;
+    u_int32_t                       master_bw; /* peak last written */
+    struct hls_master_s             *master;
+
+    hls_checkpoint_t                *checkpoint; /* NULL to disable */
+} hls_ctx_t;
+
+
+/*
+ * the variant playlist of the outputs, written when the peak
+ * bandwidth of one grows and at the end.
+ */
+typedef struct hls_master_s {
+    std::string                     path;
+    std::string                     path_bak;
+    flv_hls_sink_t                  *sink;
+    hls_ctx_t                       *outputs;
+    u_int32_t                       noutputs;
+    pthread_mutex_t                 lock;  /* renditions update it */
+} hls_master_t;
+
+
+/*
+ * keyframes of the renditions converted in parallel, fragments are
+ * cut only at the keyframes all of them have. a rendition waits at
+ * each keyframe until the others have passed it.
+ */
+typedef struct {
+    u_int32_t                       keys[HLS_ALIGN_KEYS]; /* msec */
+    u_int32_t                       nkeys;
+    unsigned                        video:1; /* has the AVC header */
+    unsigned                        done:1;
+} hls_align_input_t;
+
+
+typedef struct {
+    pthread_mutex_t                 lock;
+    pthread_cond_t                  cond;
+    hls_align_input_t               inputs[HLS_MAX_OUTPUTS];
+    u_int32_t                       ninputs;
+} hls_align_t;
+
+
+/*
+ * flv tag parsed once and shared by all the outputs.
+ */
+typedef struct {
+    char                            type;
+    u_int32_t                       timestamp;
+    u_char                          *data;
+    u_int32_t                       size;
+
+    /* video tag header, the AVCC NAL units */
+    unsigned                        pict:1;
+    unsigned                        key:1;
+    unsigned                        boundary:1; /* fragments may start */
+    u_int32_t                       cts;
+    u_char                          *nalu;
+    u_int32_t                       nalu_size;
+
+    /* mpegts payloads, AnnexB video and ADTS header of audio */
+    unsigned                        slices_on:1; /* record slices */
+    u_int32_t                       *slices;  /* offset, size in AnnexB */
+    u_int32_t                       nslices;
+    u_int32_t                       max_slices;
+    unsigned                        annexb_ok:1;
+    u_char                          *annexb;
+    size_t                          annexb_len;
+    unsigned                        adts_ok:1;
+    u_char                          adts[7];
+} hls_frame_t;
+
+
+
+typedef struct Flv2hlsContext
+{
+    FlvFileReader flvreader;
+    FlvDecoder flvdec;
+    hls_ctx_t   *outputs;   /* every frame goes to all, the first is served */
+    u_int32_t   noutputs;
+    hls_master_t *master;
+    hls_align_t *align;     /* renditions in parallel, NULL for one input */
+    u_int32_t   rendition;
+    av_codec_ctx_t  codec;
+    flv_amf_meta_t  meta;   /* points into codec.meta */
+    hls_checkpoint_t *checkpoint;
+    hls_salvage_t salvage;
+    hls_store_t store;
+    flv_hls_http_t *http;
+}Flv2hlsContext_t;
+
+static hls_frag_t *
+hls_get_frag(hls_ctx_t  *ctx, int n)
+{
+    return &ctx->frags[(ctx->frag + n) % (ctx->winfrags * 2 + 1)];
+}
+
+
+Flv2hlsContext* flv_open_read(const char* file)
+{
+    Flv2hlsContext* flv = new Flv2hlsContext();
+    
+    if (flv->flvreader.open(file) != SUCCESS) {
+        flv_freep(flv);
+        return NULL;
+    }
+    
+    if (flv->flvdec.initialize(&flv->flvreader) != SUCCESS) {
+        flv_freep(flv);
+        return NULL;
+    }
+    
+    return flv;
+}
+
+void flv_close(Flv2hlsContext* flv)
+{
+    Flv2hlsContext* context = flv;
+
+    delete [] context->codec.avc_header;
+    delete [] context->codec.aac_header;
+    delete [] (char *) context->codec.meta;
+
+    flv_freep(context);
+}
+
+int flv_read_header(Flv2hlsContext* flv, char (*header)[9], u_int32_t*pos)
+{
+    int ret = SUCCESS;
+    
+    Flv2hlsContext* context = (Flv2hlsContext*)flv;
+
+    if (!context->flvreader.is_open()) {
+        return ERROR_SYSTEM_IO_INVALID;
+    }
+    
+    if ((ret = context->flvdec.read_header(*header)) != SUCCESS) {
+        return ret;
+    }
+    
+    char ts[4]; // tag size
+    if ((ret = context->flvdec.read_previous_tag_size(ts)) != SUCCESS) {
+        return ret;
+    }
+    *pos = context->flvdec.getPosition();
+    return ret;
+}
+
+int flv_read_tag_header(Flv2hlsContext* context, char* ptype, u_int32_t *pdata_size, u_int32_t* ptime)
+{
+    int ret = SUCCESS;
+    
+
+    if (!context->flvreader.is_open()) {
+        return ERROR_SYSTEM_IO_INVALID;
+    }
+    
+    if ((ret = context->flvdec.read_tag_header(ptype, pdata_size, ptime)) != SUCCESS) {
+        return ret;
+    }
+    
+    return ret;
+}
+
+int flv_read_tag_data(Flv2hlsContext* context, char**data, u_int32_t size)
+{
+    int ret = SUCCESS;
+    
+
+    if (!context->flvreader.is_open()) {
+        return ERROR_SYSTEM_IO_INVALID;
+    }
+    
+    if ((ret = context->flvdec.read_tag_data(data, size)) != SUCCESS) {
+        return ret;
+    }
+    
+    u_char ts[4]; // tag size
+    if ((ret = context->flvdec.read_previous_tag_size((char *) ts)) != SUCCESS) {
+        return ret;
+    }
+
+    u_int32_t prev = ((u_int32_t) ts[0] << 24) | ((u_int32_t) ts[1] << 16)
+                     | ((u_int32_t) ts[2] << 8) | ts[3];
+
+    if (!context->salvage.checked) {
+        context->salvage.checked = 1;
+        context->salvage.trailers = (prev == size + 11);
+
+    } else if (context->salvage.trailers && prev != size + 11) {
+        return ERROR_FLV_DAMAGED_TAG;
+    }
+    
+    return ret;
+}
+
+
+int hls_init_playlist(hls_ctx_t*ctx, char*hls_path)
+{
+    int ret = SUCCESS;
+    ctx->playlist = std::string(hls_path) + ".m3u8";
+    ctx->playlist_bak = ctx->playlist + ".bak";
+    return ret;
+}
+
+
+int flv_hls_copy(void *dst, u_int8_t**src, int n)
+{
+    u_char  *last;
+    size_t   pn;
+
+    if (src == NULL || dst == NULL) {
+        return -1;
+    }
+
+    memcpy(dst, *src, n);
+    *src += n;
+    return SUCCESS;
+}
+
+
+static int
+hls_append_aud(str_buf_t * out)
+{
+    static u_char   aud_nal[] = { 0x00, 0x00, 0x00, 0x01, 0x09, 0xf0 };
+
+    if (out->last + sizeof(aud_nal) > out->end) {
+        return ERROR_NORMAL;
+    }
+
+    memcpy(out->last, aud_nal, sizeof(aud_nal));
+    out->last += sizeof(aud_nal);
+    return SUCCESS;
+}
+
+static int
+hls_append_sps_pps(av_codec_ctx_t*codec_ctx, str_buf_t*out)
+{
+    u_int8_t                        *p;
+    u_int8_t                        *in;
+    hls_ctx_t             *ctx;
+    int8_t                          nnals;
+    u_int16_t                        len, rlen;
+    int                       n;
+    u_int8_t                        dummy[FLV_HLS_BUFSIZE];
+    in = codec_ctx->avc_header;
+
+    p = in;
+
+    /*
+     * Skip bytes:
+     * - flv fmt
+     * - H264 CONF/PICT (0x00)
+     * - 0
+     * - 0
+     * - 0
+     * - version
+     * - profile
+     * - compatibility
+     * - level
+     * - nal bytes
+     */
+    DEBUG("enter hls_append_sps_pps, buf size:%d\n", out->end-out->last);
+    if (flv_hls_copy(dummy, &p, 10) != SUCCESS) {
+        return SUCCESS;
+    }
+
+    /* number of SPS NALs */
+    if (flv_hls_copy(&nnals, &p, 1) != SUCCESS) {
+        return SUCCESS;
+    }
+
+    nnals &= 0x1f; /* 5lsb */
+
+    printf("hls: SPS number: %u\n", nnals);
+
+    /* SPS */
+    for (n = 0; ; ++n) {
+        for (; nnals; --nnals) {
+
+            /* NAL length */
+            if (flv_hls_copy(&rlen, &p, 2) != SUCCESS) {
+                return SUCCESS;
+            }
+
+            flv_rmemcpy(&len, &rlen, 2);
+
+            printf("hls: header NAL length: %u, buf size:%d\n", (size_t) len, out->end-out->last);
+
+            /* AnnexB prefix */
+            if (out->end - out->last < 4) {
+                printf( "hls: too small buffer for header NAL size\n");
+                return ERROR_NORMAL;
+            }
+
+            *out->last++ = 0;
+            *out->last++ = 0;
+            *out->last++ = 0;
+            *out->last++ = 1;
+
+            /* NAL body */
+            if (out->end - out->last < len) {
+                printf("hls: too small buffer for header NAL\n");
+                return ERROR_NORMAL;
+            }
+            
+            if (flv_hls_copy(out->last, &p, len) != SUCCESS) {
+                return SUCCESS;
+            }
+            out->last += len;
+
+        }
+
+        if (n == 1) {
+            break;
+        }
+
+        /* number of PPS NALs */
+        if (flv_hls_copy(&nnals, &p, 1) != SUCCESS) {
+            return SUCCESS;
+        }
+        DEBUG("PPS nnals:%d\n", nnals);
+    }
+
+    return SUCCESS;
+}
+
+static const char *
+hls_segment_ext(hls_ctx_t *ctx)
+{
+    return ctx->fmp4 ? "m4s" : "ts";
+}
+
+
+static u_int32_t
+hls_playlist_version(hls_ctx_t *ctx, int parts)
+{
+    if (ctx->fmp4) {
+        return 7;
+    }
+
+    if (parts) {
+        return 6;
+    }
+
+    return ctx->single ? 4 : 3;
+}
+
+
+/*
+ * snprintf that returns what it wrote, not what it would have. the
+ * renderers add it to their position and never pass the end.
+ */
+static int
+hls_snprintf(void *p, size_t size, const char *fmt, ...)
+{
+    va_list                         args;
+    int                             n;
+
+    if (size == 0) {
+        return 0;
+    }
+
+    va_start(args, fmt);
+    n = vsnprintf((char *) p, size, fmt, args);
+    va_end(args);
+
+    if (n < 0) {
+        return 0;
+    }
+
+    return (size_t) n < size ? n : (int) size - 1;
+}
+
+
+/* EXTINF and the uri of fragment, a byte range in single file mode */
+static int
+hls_render_entry(hls_ctx_t *ctx, hls_frag_t *f, u_char *p, size_t size)
+{
+    const char                      *name;
+
+    if (ctx->single) {
+        name = strrchr(ctx->single_name.c_str(), '/');
+        name = name ? name + 1 : ctx->single_name.c_str();
+
+        return hls_snprintf(p, size,
+                        "#EXTINF:%.3f,\n"
+                        "#EXT-X-BYTERANGE:%lld@%lld\n"
+                        "%s\n",
+                        f->duration, (long long) f->size,
+                        (long long) f->offset, name);
+    }
+
+    return hls_snprintf(p, size,
+                    "#EXTINF:%.3f,\n"
+                    "%u.%s\n",
+                    f->duration, (u_int32_t) f->id, hls_segment_ext(ctx));
+}
+
+
+/*
+ * no IV, each fragment is encrypted with its media sequence number
+ * as players take it by default. one IV for all the fragments of a
+ * key would encrypt their equal PAT/PMT to equal blocks.
+ */
+static int
+hls_render_key(hls_ctx_t *ctx, u_int64_t key_id, u_char *p, size_t size)
+{
+    return hls_snprintf(p, size,
+                    "#EXT-X-KEY:METHOD=%s,URI=\"%s%llu.key\"\n",
+                    ctx->sample_aes ? "SAMPLE-AES" : "AES-128",
+                    ctx->key_uri.c_str(), (unsigned long long) key_id);
+}
+
+
+static int
+hls_entries_reserve(hls_entries_t *e)
+{
+    u_char                          *data;
+    size_t                          cap;
+
+    /* drop the trimmed head before growing */
+    if (e->pos > e->cap / 2) {
+        memmove(e->data, e->data + e->pos, e->last - e->pos);
+        e->base += e->pos;
+        e->last -= e->pos;
+        e->pos = 0;
+    }
+
+    if (e->last + HLS_ENTRY_MAX > e->cap) {
+        cap = e->cap ? e->cap * 2 : 4096;
+
+        data = (u_char *) realloc(e->data, cap);
+        if (data == NULL) {
+            return ERROR_NORMAL;
+        }
+
+        e->data = data;
+        e->cap = cap;
+    }
+
+    return SUCCESS;
+}
+
+
+/*
+ * format the entry of fragment entering the window once,
+ * at the tail of the entries.
+ */
+static int
+hls_entries_append(hls_ctx_t *ctx, hls_frag_t *f)
+{
+    static u_char                   discont[] = "#EXT-X-DISCONTINUITY\n";
+    hls_entries_t                   *e;
+    int                             n;
+
+    e = &ctx->entries;
+
+    if (hls_entries_reserve(e) != SUCCESS) {
+        return ERROR_NORMAL;
+    }
+
+    f->entry_off = e->base + e->last;
+
+    if (f->discont) {
+        memcpy(e->data + e->last, discont, sizeof(discont) - 1);
+        e->last += sizeof(discont) - 1;
+    }
+
+    /* the key is listed where it begins, the header repeats it */
+    if (ctx->encrypt && f->active && f->key_id == f->id) {
+        e->last += hls_render_key(ctx, f->key_id, e->data + e->last,
+                                  HLS_ENTRY_MAX / 2);
+    }
+
+    if (ctx->crc == 2 && f->active) {
+        e->last += hls_snprintf(e->data + e->last, 32,
+                            "#CRC32C:%08x\n", f->crc);
+    }
+
+    n = hls_render_entry(ctx, f, e->data + e->last,
+                         HLS_ENTRY_MAX - (e->base + e->last - f->entry_off));
+    e->last += n;
+
+    f->entry_len = (u_int32_t) (e->base + e->last - f->entry_off);
+
+    return SUCCESS;
+}
+
+
+static void
+hls_entries_trim(hls_ctx_t *ctx, hls_frag_t *f)
+{
+    ctx->entries.pos = f->entry_off + f->entry_len - ctx->entries.base;
+
+    if (ctx->iframes) {
+        ctx->iframe_entries.pos = f->iframe_off + f->iframe_len
+                                  - ctx->iframe_entries.base;
+        ctx->iframe_seq += f->niframes;
+    }
+}
+
+
+/*
+ * I-frame entries of the closed fragment, each IDR lasts until the
+ * next one or the end of fragment. the PAT/PMT at the fragment start
+ * is the map.
+ */
+static int
+hls_iframes_append(hls_ctx_t *ctx, hls_frag_t *f)
+{
+    static u_char                   discont[] = "#EXT-X-DISCONTINUITY\n";
+    hls_entries_t                   *e;
+    hls_iframe_t                    *k;
+    const char                      *name;
+    char                            uri[64];
+    u_int64_t                       end, next;
+    u_int32_t                       i, bw, peak;
+    double                          d;
+    int                             n;
+
+    e = &ctx->iframe_entries;
+    peak = ctx->iframe_bw;
+
+    f->iframe_off = e->base + e->last;
+    f->iframe_len = 0;
+    f->niframes = 0;
+
+    if (!f->active || ctx->nkeys == 0) {
+        ctx->nkeys = 0;
+        return SUCCESS;
+    }
+
+    if (ctx->single) {
+        name = strrchr(ctx->single_name.c_str(), '/');
+        snprintf(uri, sizeof(uri), "%s",
+                 name ? name + 1 : ctx->single_name.c_str());
+    } else {
+        snprintf(uri, sizeof(uri), "%u.%s",
+                 (u_int32_t) f->id, hls_segment_ext(ctx));
+    }
+
+    end = ctx->frag_ts + (u_int64_t) (f->duration * 90000);
+
+    for (i = 0; i < ctx->nkeys; i++) {
+        k = &ctx->keys[i];
+
+        if (hls_entries_reserve(e) != SUCCESS) {
+            return ERROR_NORMAL;
+        }
+
+        n = 0;
+
+        if (i == 0) {
+            if (f->discont) {
+                memcpy(e->data + e->last, discont, sizeof(discont) - 1);
+                n = sizeof(discont) - 1;
+            }
+
+            n += hls_snprintf(e->data + e->last + n, HLS_ENTRY_MAX - n,
+                          "#EXT-X-MAP:URI=\"%s\",BYTERANGE=\"%d@%lld\"\n",
+                          uri, FLV_MPEGTS_HEADER_SIZE,
+                          (long long) f->offset);
+        }
+
+        next = (i + 1 < ctx->nkeys) ? ctx->keys[i + 1].dts : end;
+        d = next > k->dts ? (next - k->dts) / 90000. : 0;
+
+        n += hls_snprintf(e->data + e->last + n, HLS_ENTRY_MAX - n,
+                      "#EXTINF:%.3f,\n"
+                      "#EXT-X-BYTERANGE:%lld@%lld\n"
+                      "%s\n",
+                      d, (long long) k->size, (long long) k->offset, uri);
+        e->last += n;
+
+        if (d > 0) {
+            bw = (u_int32_t) (k->size * 8 / d);
+            if (bw > peak) {
+                peak = bw;
+            }
+        }
+    }
+
+    /* the master playlist of the renditions reads it */
+    if (peak > ctx->iframe_bw) {
+        if (ctx->master) {
+            pthread_mutex_lock(&ctx->master->lock);
+        }
+
+        ctx->iframe_bw = peak;
+
+        if (ctx->master) {
+            pthread_mutex_unlock(&ctx->master->lock);
+        }
+    }
+
+    f->iframe_len = (u_int32_t) (e->base + e->last - f->iframe_off);
+    f->niframes = ctx->nkeys;
+    ctx->nkeys = 0;
+
+    return SUCCESS;
+}
+
+
+/* the IDR just written to the fragment */
+static void
+hls_iframes_add(hls_ctx_t *ctx, u_int64_t dts, off_t offset)
+{
+    hls_iframe_t                    *keys;
+    u_int32_t                       max;
+
+    if (ctx->nkeys == ctx->max_keys) {
+        max = ctx->max_keys ? ctx->max_keys * 2 : 16;
+
+        keys = (hls_iframe_t *) realloc(ctx->keys, max * sizeof(hls_iframe_t));
+        if (keys == NULL) {
+            return;
+        }
+
+        ctx->keys = keys;
+        ctx->max_keys = max;
+    }
+
+    ctx->keys[ctx->nkeys].dts = dts;
+    ctx->keys[ctx->nkeys].offset = offset;
+    ctx->keys[ctx->nkeys].size = ctx->file.offset - offset;
+    ctx->nkeys++;
+}
+
+
+/*
+ * the longest fragment of the window is at the head of the deque,
+ * each fragment is pushed and popped once.
+ */
+static void
+hls_target_push(hls_ctx_t *ctx, hls_frag_t *f)
+{
+    hls_target_t                    *t;
+    u_int32_t                       size, duration;
+
+    size = ctx->winfrags + 1;
+    duration = (u_int32_t) (f->duration + .5);
+
+    while (ctx->ntargets) {
+        t = &ctx->targets[(ctx->target + ctx->ntargets - 1) % size];
+        if (t->duration > duration) {
+            break;
+        }
+        ctx->ntargets--;
+    }
+
+    t = &ctx->targets[(ctx->target + ctx->ntargets++) % size];
+    t->id = f->id;
+    t->duration = duration;
+}
+
+
+static void
+hls_target_pop(hls_ctx_t *ctx, hls_frag_t *f)
+{
+    if (ctx->ntargets && ctx->targets[ctx->target].id == f->id) {
+        ctx->target = (ctx->target + 1) % (ctx->winfrags + 1);
+        ctx->ntargets--;
+    }
+}
+
+
+static u_int32_t
+hls_target_duration(hls_ctx_t *ctx)
+{
+    u_int32_t                       max_frag;
+
+    max_frag = ctx->fraglen / 1000;
+
+    if (ctx->vod) {
+        return ctx->vod_target > max_frag ? ctx->vod_target : max_frag;
+    }
+
+    /* the same from the first m3u8 to the last */
+    if (ctx->meta_target > max_frag) {
+        max_frag = ctx->meta_target;
+    }
+
+    if (ctx->ntargets && ctx->targets[ctx->target].duration > max_frag) {
+        max_frag = ctx->targets[ctx->target].duration;
+    }
+
+    return max_frag;
+}
+
+
+/*
+ * the longest fragment the keyframes of the metadata make, cut as
+ * hls_update_fragment does. a table that goes back is not trusted,
+ * a wrong one only makes the target longer than needed.
+ */
+static void
+hls_meta_target(hls_ctx_t *ctx, flv_amf_meta_t *meta)
+{
+    u_int64_t                       t, frag_t, last_t, d;
+    u_int32_t                       i, duration, target;
+    double                          v;
+
+    if (ctx->vod || ctx->audio_only || meta->nkeys == 0) {
+        return;
+    }
+
+    target = 0;
+    frag_t = 0;
+    last_t = 0;
+
+    for (i = 0; i < meta->nkeys; i++) {
+        v = flv_amf_key_time(meta, i);
+
+        if (!(v >= 0 && v < 4294967.)) {
+            return;
+        }
+
+        t = (u_int64_t) (v * 1000 + .5);
+
+        if (t < last_t) {
+            DEBUG("keyframes of the metadata go back at %u\n", i);
+            return;
+        }
+
+        last_t = t;
+
+        if (i == 0) {
+            frag_t = t;
+            continue;
+        }
+
+        d = t - frag_t;
+
+        if (d >= ctx->fraglen || d > ctx->max_fraglen) {
+            duration = (u_int32_t) (d / 1000. + .5);
+            target = duration > target ? duration : target;
+            frag_t = t;
+        }
+    }
+
+    /* the last one ends with the input */
+    if (meta->duration * 1000 > frag_t && meta->duration < 4294967.) {
+        d = (u_int64_t) (meta->duration * 1000 + .5) - frag_t;
+        duration = (u_int32_t) (d / 1000. + .5);
+        target = duration > target ? duration : target;
+    }
+
+    ctx->meta_target = target;
+
+    DEBUG("target duration %u by %u keyframes of the metadata\n",
+          target, meta->nkeys);
+}
+
+
+/*
+ * the fragment left the window. the one that left expire windows
+ * before is deleted, players may still be loading it until then,
+ * and its key when no later fragment is encrypted with it.
+ */
+static void
+hls_expire_frag(hls_ctx_t *ctx, hls_frag_t *f)
+{
+    hls_expired_t                   *e, *next;
+    u_int32_t                       n;
+    std::string                     path;
+
+    n = ctx->expire * ctx->winfrags + 1;
+
+    if (ctx->expired == NULL) {
+        ctx->expired = new hls_expired_t[n];
+        ctx->expired_head = 0;
+        ctx->nexpired = 0;
+    }
+
+    e = &ctx->expired[(ctx->expired_head + ctx->nexpired) % n];
+    e->id = f->id;
+    e->key_id = f->key_id;
+    e->active = f->active;
+
+    if (++ctx->nexpired < n) {
+        return;
+    }
+
+    e = &ctx->expired[ctx->expired_head];
+    ctx->expired_head = (ctx->expired_head + 1) % n;
+    ctx->nexpired--;
+    next = &ctx->expired[ctx->expired_head];
+
+    /* nothing was written for the one before the first */
+    if (!e->active) {
+        return;
+    }
+
+    path = std::string(ctx->stream, ctx->stream_len)
+           + std::to_string((unsigned long long) e->id) + "."
+           + hls_segment_ext(ctx);
+
+    flv_hls_sink_delete(ctx->sink, path.c_str());
+
+    if (ctx->encrypt && next->key_id != e->key_id) {
+        path = ctx->key_path + std::to_string((unsigned long long) e->key_id)
+               + ".key";
+
+        flv_hls_sink_delete(ctx->sink, path.c_str());
+    }
+}
+
+
+static void
+hls_next_frag(hls_ctx_t *ctx)
+{
+    hls_frag_t                      *f;
+    u_int32_t                       duration;
+
+    f = hls_get_frag(ctx, ctx->nfrags);
+
+    if (ctx->iframes) {
+        hls_iframes_append(ctx, f);
+    }
+
+    /*
+     * vod keeps every entry, the fragments only cycle through the
+     * window. nothing was written for the one before the first.
+     */
+    if (ctx->vod) {
+        if (f->active) {
+            hls_entries_append(ctx, f);
+
+            duration = (u_int32_t) (f->duration + .5);
+            if (duration > ctx->vod_target) {
+                ctx->vod_target = duration;
+            }
+        }
+
+    } else {
+        hls_entries_append(ctx, f);
+        hls_target_push(ctx, f);
+    }
+
+    if (ctx->nfrags == ctx->winfrags) {
+        f = hls_get_frag(ctx, 0);
+
+        if (!ctx->vod) {
+            hls_entries_trim(ctx, f);
+            hls_target_pop(ctx, f);
+
+            if (ctx->expire && !ctx->single) {
+                hls_expire_frag(ctx, f);
+            }
+        }
+
+        ctx->frag++;
+    } else {
+        ctx->nfrags++;
+    }
+}
+
+
+/*
+ * skip_until advertises delta updates, skipped is the number of
+ * fragments replaced by EXT-X-SKIP.
+ */
+static int
+hls_render_header(hls_ctx_t *ctx, u_char *p, size_t size, int parts,
+    u_int32_t skip_until, u_int32_t skipped)
+{
+    hls_frag_t                      *f;
+    int                             n;
+
+    n = hls_snprintf(p, size,
+                 "#EXTM3U\n"
+                 "#EXT-X-VERSION:%u\n"
+                 "%s"
+                 "#EXT-X-MEDIA-SEQUENCE:%u\n"
+                 "#EXT-X-TARGETDURATION:%u\n",
+                 skipped ? 9 : hls_playlist_version(ctx, parts),
+                 ctx->vod ? "#EXT-X-PLAYLIST-TYPE:VOD\n" : "",
+                 ctx->vod ? HLS_VOD_SEQUENCE : (u_int32_t) ctx->frag,
+                 hls_target_duration(ctx));
+
+    if (parts || skip_until) {
+        n += hls_snprintf(p + n, size - n, "#EXT-X-SERVER-CONTROL:");
+
+        if (skip_until) {
+            n += hls_snprintf(p + n, size - n, "CAN-SKIP-UNTIL=%u.0%s",
+                          skip_until, parts ? "," : "");
+        }
+
+        if (parts) {
+            n += hls_snprintf(p + n, size - n,
+                          "CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=%.3f",
+                          ctx->partlen * 3 / 1000.);
+        }
+
+        n += hls_snprintf(p + n, size - n, "\n");
+    }
+
+    if (parts) {
+        n += hls_snprintf(p + n, size - n,
+                      "#EXT-X-PART-INF:PART-TARGET=%.3f\n",
+                      ctx->partlen / 1000.);
+    }
+
+    if (ctx->fmp4) {
+        n += hls_snprintf(p + n, size - n,
+                      "#EXT-X-MAP:URI=\"%s\"\n", HLS_MP4_INIT);
+    }
+
+    if (skipped) {
+        n += hls_snprintf(p + n, size - n,
+                      "#EXT-X-SKIP:SKIPPED-SEGMENTS=%u\n", skipped);
+    }
+
+    /* the first fragment listed is in the middle of its key */
+    if (ctx->encrypt && !ctx->vod && skipped < ctx->nfrags) {
+        f = hls_get_frag(ctx, skipped);
+
+        if (f->active && f->key_id != f->id) {
+            n += hls_render_key(ctx, f->key_id, p + n, size - n);
+        }
+    }
+
+    return n;
+}
+
+
+static void
+hls_render_parts(hls_ctx_t *ctx, hls_buf_t *pl, hls_frag_t *f,
+    u_int32_t nparts)
+{
+    u_char                          buffer[128];
+    u_int32_t                       i;
+    int                             n;
+
+    for (i = 0; i < nparts; i++) {
+        n = hls_snprintf(buffer, sizeof(buffer),
+                     "#EXT-X-PART:DURATION=%.3f,URI=\"%llu.%u.%s\"%s\n",
+                     f->parts[i].duration, (unsigned long long) f->id, i,
+                     hls_segment_ext(ctx),
+                     f->parts[i].independent ? ",INDEPENDENT=YES" : "");
+        hls_buf_append(pl, buffer, n);
+    }
+}
+
+
+/*
+ * the playlist served from memory, with LL-HLS parts of the recent
+ * fragments and of the one in progress. the first skipped fragments
+ * are left out for a delta update.
+ * the playlist on disk never lists parts.
+ */
+static hls_buf_t *
+hls_render_playlist(hls_ctx_t *ctx, u_int32_t skip_until, u_int32_t skipped)
+{
+    static u_char                   discont[] = "#EXT-X-DISCONTINUITY\n";
+    u_char                          buffer[HLS_ENTRY_MAX];
+    hls_entries_t                   *e;
+    hls_frag_t                      *f;
+    hls_buf_t                       *pl;
+    u_int32_t                       i, from, next_part, skip;
+    u_int64_t                       next_id, start, off;
+    int                             n, parts;
+
+    e = &ctx->entries;
+    parts = (ctx->partlen != 0);
+
+    start = (skipped < ctx->nfrags) ? hls_get_frag(ctx, skipped)->entry_off
+                                    : e->base + e->last;
+
+    pl = hls_buf_create(e->base + e->last - start + HLS_ENTRY_MAX);
+    if (pl == NULL) {
+        return NULL;
+    }
+
+    n = hls_render_header(ctx, buffer, sizeof(buffer), parts,
+                          skip_until, skipped);
+    hls_buf_append(pl, buffer, n);
+
+    /* the formatted entries up to the fragments with parts */
+    from = ctx->nfrags;
+    if (parts) {
+        from = ctx->nfrags > HLS_PART_SEGMENTS
+               ? ctx->nfrags - HLS_PART_SEGMENTS : 0;
+    }
+
+    if (from < skipped) {
+        from = skipped;
+    }
+
+    off = (from < ctx->nfrags) ? hls_get_frag(ctx, from)->entry_off
+                               : e->base + e->last;
+    hls_buf_append(pl, e->data + (start - e->base), off - start);
+
+    for (i = from; i < ctx->nfrags; i++) {
+        f = hls_get_frag(ctx, i);
+
+        skip = 0;
+        if (f->discont) {
+            hls_buf_append(pl, discont, sizeof(discont) - 1);
+            skip = sizeof(discont) - 1;
+        }
+
+        hls_render_parts(ctx, pl, f, f->nparts);
+
+        hls_buf_append(pl, e->data + (f->entry_off - e->base) + skip,
+                       f->entry_len - skip);
+    }
+
+    if (parts) {
+        next_id = ctx->frag + ctx->nfrags;
+        next_part = 0;
+
+        if (ctx->opened) {
+            f = hls_get_frag(ctx, ctx->nfrags);
+
+            if (f->discont) {
+                hls_buf_append(pl, discont, sizeof(discont) - 1);
+            }
+
+            hls_render_parts(ctx, pl, f, f->nparts);
+            next_id = f->id;
+            next_part = f->nparts;
+        }
+
+        n = hls_snprintf(buffer, sizeof(buffer),
+                     "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"%llu.%u.%s\"\n",
+                     (unsigned long long) next_id, next_part,
+                     hls_segment_ext(ctx));
+        hls_buf_append(pl, buffer, n);
+    }
+
+    return pl;
+}
+
+
+/*
+ * fragments starting more than skip_until seconds before the end,
+ * counted from the newest back so the cost does not grow with
+ * the window.
+ */
+static u_int32_t
+hls_skipped_frags(hls_ctx_t *ctx, u_int32_t skip_until)
+{
+    u_int32_t                       n;
+    double                          duration;
+
+    duration = 0;
+
+    for (n = ctx->nfrags; n > 0 && duration < skip_until; n--) {
+        duration += hls_get_frag(ctx, n - 1)->duration;
+    }
+
+    return n;
+}
+
+
+static int
+hls_publish_playlist(hls_ctx_t *ctx)
+{
+    hls_buf_t                       *pl, *delta;
+    u_int32_t                       target, skip_until, skipped;
+
+    /* the least boundary allowed, six target durations */
+    target = hls_target_duration(ctx);
+    skip_until = HLS_SKIP_TARGETS * (target ? target : 1);
+
+    pl = hls_render_playlist(ctx, skip_until, 0);
+    if (pl == NULL) {
+        return ERROR_NORMAL;
+    }
+
+    delta = NULL;
+
+    skipped = hls_skipped_frags(ctx, skip_until);
+    if (skipped) {
+        delta = hls_render_playlist(ctx, skip_until, skipped);
+    }
+
+    return hls_store_publish(ctx->store, pl, delta);
+}
+
+
+/*
+ * the I-frame playlist follows the playlist, the same way in one
+ * write. it is published with the next snapshot.
+ */
+static int
+hls_write_iframes(hls_ctx_t *ctx)
+{
+    static u_char                   endlist[] = "#EXT-X-ENDLIST\n";
+    u_char                          header[HLS_ENTRY_MAX];
+    struct iovec                    iov[3];
+    hls_entries_t                   *e;
+    hls_buf_t                       *pl;
+    const char                      *name;
+    int                             i;
+    ssize_t                         n, size;
+
+    e = &ctx->iframe_entries;
+
+    n = hls_snprintf(header, sizeof(header),
+                 "#EXTM3U\n"
+                 "#EXT-X-VERSION:5\n"
+                 "%s"
+                 "#EXT-X-MEDIA-SEQUENCE:%llu\n"
+                 "#EXT-X-TARGETDURATION:%u\n"
+                 "#EXT-X-I-FRAMES-ONLY\n",
+                 ctx->vod ? "#EXT-X-PLAYLIST-TYPE:VOD\n" : "",
+                 (unsigned long long) ctx->iframe_seq,
+                 hls_target_duration(ctx));
+
+    iov[0].iov_base = header;
+    iov[0].iov_len = n;
+    iov[1].iov_base = e->data + e->pos;
+    iov[1].iov_len = e->last - e->pos;
+    iov[2].iov_base = endlist;
+    iov[2].iov_len = ctx->vod ? sizeof(endlist) - 1 : 0;
+
+    size = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len;
+
+    if (flv_hls_sink_writev(ctx->sink, ctx->iframes_playlist.c_str(),
+                            ctx->iframes_playlist_bak.c_str(), iov, 3, 0)
+        != SUCCESS)
+    {
+        return ERROR_NORMAL;
+    }
+
+    if (ctx->store) {
+        pl = hls_buf_create(size);
+        if (pl == NULL) {
+            return ERROR_NORMAL;
+        }
+
+        for (i = 0; i < 3; i++) {
+            hls_buf_append(pl, (u_char *) iov[i].iov_base, iov[i].iov_len);
+        }
+
+        name = strrchr(ctx->iframes_playlist.c_str(), '/');
+        name = name ? name + 1 : ctx->iframes_playlist.c_str();
+
+        hls_store_set_iframes(ctx->store, name, pl);
+    }
+
+    return SUCCESS;
+}
+
+
+/*
+ * the header and the formatted entries go out in one write,
+ * the playlist is replaced by rename.
+ */
+static int
+hls_write_playlist(hls_ctx_t *ctx)
+{
+    static u_char                   endlist[] = "#EXT-X-ENDLIST\n";
+    u_char                          header[HLS_ENTRY_MAX];
+    struct iovec                    iov[3];
+    hls_entries_t                   *e;
+
+    e = &ctx->entries;
+
+    iov[0].iov_base = header;
+    iov[0].iov_len = hls_render_header(ctx, header, sizeof(header), 0, 0, 0);
+    iov[1].iov_base = e->data + e->pos;
+    iov[1].iov_len = e->last - e->pos;
+    iov[2].iov_base = endlist;
+    iov[2].iov_len = ctx->vod ? sizeof(endlist) - 1 : 0;
+
+    /* the segments it lists are on disk since the last sync */
+    if (flv_hls_sink_writev(ctx->sink, ctx->playlist.c_str(),
+                            ctx->playlist_bak.c_str(), iov, 3,
+                            ctx->sync_playlist ? FLV_HLS_SINK_SYNC : 0)
+        != SUCCESS)
+    {
+        return ERROR_NORMAL;
+    }
+
+    ctx->sync_playlist = 0;
+
+    if (ctx->iframes) {
+        hls_write_iframes(ctx);
+    }
+
+    if (ctx->store) {
+        hls_publish_playlist(ctx);
+    }
+
+    return SUCCESS;
+}
+
+
+/* CODECS of the variant, RFC 6381 */
+static int
+hls_render_codecs(hls_ctx_t *ctx, char *p, size_t size)
+{
+    av_codec_ctx_t                  *codec;
+    int                             n;
+
+    codec = ctx->codec;
+    n = 0;
+
+    if (!ctx->audio_only && codec->avc_header) {
+        n += hls_snprintf(p + n, size - n, "avc1.%02x%02x%02x",
+                      codec->avc_profile, codec->avc_compat,
+                      codec->avc_level);
+    }
+
+    if (codec->aac_header) {
+        n += hls_snprintf(p + n, size - n, "%smp4a.40.%u", n ? "," : "",
+                      codec->aac_ps ? 29 : codec->aac_sbr ? 5
+                                                          : codec->aac_profile);
+    }
+
+    return n;
+}
+
+
+static int
+hls_write_master(hls_master_t *master)
+{
+    u_char                          buffer[HLS_ENTRY_MAX * HLS_MAX_OUTPUTS];
+    char                            codecs[64];
+    hls_ctx_t                       *ctx;
+    struct iovec                    iov;
+    u_int32_t                       i;
+    int                             n;
+
+    n = hls_snprintf(buffer, sizeof(buffer),
+                 "#EXTM3U\n"
+                 "#EXT-X-VERSION:3\n");
+
+    for (i = 0; i < master->noutputs; i++) {
+        ctx = &master->outputs[i];
+
+        /* nothing measured yet, e.g. audio only without audio */
+        if (ctx->peak_bw == 0) {
+            continue;
+        }
+
+        ctx->master_bw = ctx->peak_bw;
+
+        hls_render_codecs(ctx, codecs, sizeof(codecs));
+
+        n += hls_snprintf(buffer + n, sizeof(buffer) - n,
+                      "#EXT-X-STREAM-INF:BANDWIDTH=%u,AVERAGE-BANDWIDTH=%u,"
+                      "CODECS=\"%s\"",
+                      ctx->peak_bw,
+                      (u_int32_t) (ctx->bytes * 8 / ctx->seconds), codecs);
+
+        if (!ctx->audio_only && ctx->codec->width) {
+            n += hls_snprintf(buffer + n, sizeof(buffer) - n,
+                          ",RESOLUTION=%ux%u",
+                          ctx->codec->width, ctx->codec->height);
+        }
+
+        n += hls_snprintf(buffer + n, sizeof(buffer) - n,
+                      "\n%s\n", ctx->playlist.c_str());
+    }
+
+    for (i = 0; i < master->noutputs; i++) {
+        ctx = &master->outputs[i];
+
+        if (!ctx->iframes || ctx->iframe_bw == 0) {
+            continue;
+        }
+
+        n += hls_snprintf(buffer + n, sizeof(buffer) - n,
+                      "#EXT-X-I-FRAME-STREAM-INF:BANDWIDTH=%u,"
+                      "CODECS=\"avc1.%02x%02x%02x\",RESOLUTION=%ux%u,"
+                      "URI=\"%s\"\n",
+                      ctx->iframe_bw, ctx->codec->avc_profile,
+                      ctx->codec->avc_compat, ctx->codec->avc_level,
+                      ctx->codec->width, ctx->codec->height,
+                      ctx->iframes_playlist.c_str());
+    }
+
+    iov.iov_base = buffer;
+    iov.iov_len = n;
+
+    return flv_hls_sink_writev(master->sink, master->path.c_str(),
+                               master->path_bak.c_str(), &iov, 1, 0);
+}
+
+
+/*
+ * peak and average bitrate of the output, the master playlist
+ * follows when the peak grows.
+ */
+static void
+hls_update_bandwidth(hls_ctx_t *ctx, hls_frag_t *f)
+{
+    u_int32_t                       bw;
+
+    if (ctx->master) {
+        pthread_mutex_lock(&ctx->master->lock);
+    }
+
+    ctx->bytes += f->size;
+    ctx->seconds += f->duration;
+
+    bw = (u_int32_t) (f->size * 8 / f->duration);
+    if (bw > ctx->peak_bw) {
+        ctx->peak_bw = bw;
+
+        if (ctx->master) {
+            hls_write_master(ctx->master);
+        }
+    }
+
+    if (ctx->master) {
+        pthread_mutex_unlock(&ctx->master->lock);
+    }
+}
+
+
+/*
+ * "crc32c size@offset uri" of the closed fragment appended to the
+ * sidecar, the hash is of the bytes as written.
+ */
+static int
+hls_write_crc(hls_ctx_t *ctx, hls_frag_t *f)
+{
+    char                            line[256];
+    const char                      *name;
+    int                             n;
+
+    if (ctx->crc_fd == -1) {
+        ctx->crc_fd = open(ctx->crc_path.c_str(),
+                           O_WRONLY|O_CREAT|O_TRUNC|O_APPEND, 0644);
+        if (ctx->crc_fd == -1) {
+            ERROR("error: hls open %s failed\n", ctx->crc_path.c_str());
+            return ERROR_NORMAL;
+        }
+    }
+
+    if (ctx->single) {
+        name = strrchr(ctx->single_name.c_str(), '/');
+        name = name ? name + 1 : ctx->single_name.c_str();
+
+        n = hls_snprintf(line, sizeof(line), "%08x %lld@%lld %s\n", f->crc,
+                     (long long) f->size, (long long) f->offset, name);
+    } else {
+        n = hls_snprintf(line, sizeof(line), "%08x %lld@0 %u.%s\n", f->crc,
+                     (long long) f->size, (u_int32_t) f->id,
+                     hls_segment_ext(ctx));
+    }
+
+    if (write(ctx->crc_fd, line, n) != n) {
+        ERROR("error: hls write %s failed\n", ctx->crc_path.c_str());
+        return ERROR_NORMAL;
+    }
+
+    return SUCCESS;
+}
+
+
+/* the data of the closed segments, or of the single file */
+static void
+hls_sync_fragments(hls_ctx_t *ctx)
+{
+    u_int32_t                       i;
+
+    if (ctx->single && ctx->single_fd != -1
+        && fdatasync(ctx->single_fd) != 0)
+    {
+        ERROR("error: hls sync %s failed\n", ctx->single_name.c_str());
+    }
+
+    for (i = 0; i < ctx->nsync_fds; i++) {
+        if (ctx->sync_fds[i] == -1) {
+            continue;
+        }
+
+        if (fdatasync(ctx->sync_fds[i]) != 0) {
+            ERROR("error: hls sync segment failed, errno=%d\n", errno);
+        }
+
+        close(ctx->sync_fds[i]);
+    }
+
+    ctx->nsync_fds = 0;
+    ctx->unsynced = 0;
+}
+
+
+/*
+ * the closed segment takes its name. every durable segments their
+ * data is synced, each by fdatasync, before the rename of the last
+ * one and the directory after it. the playlist written next is synced
+ * too. the ones before the last were renamed unsynced, they outlive a
+ * crash of the process but not one of the system.
+ */
+static int
+hls_commit_fragment(hls_ctx_t *ctx)
+{
+    std::string                     tmp;
+    unsigned                        flags;
+
+    flags = 0;
+
+    if (ctx->durable && ++ctx->unsynced >= ctx->durable) {
+        hls_sync_fragments(ctx);
+
+        ctx->sync_playlist = 1;
+        flags = FLV_HLS_SINK_SYNC;
+    }
+
+    if (ctx->single) {
+        return SUCCESS;
+    }
+
+    tmp = std::string(ctx->stream) + HLS_TMP_EXT;
+
+    return flv_hls_sink_rename(ctx->sink, tmp.c_str(), ctx->stream, flags);
+}
+
+
+static int
+hls_close_fragment(hls_ctx_t *ctx, u_int64_t ts)
+{
+    hls_frag_t                      *f;
+    u_int32_t                       i;
+    double                          d;
+
+    DEBUG("hls_close_fragment frag:%d, nfrags:%d\n", ctx->frag, ctx->nfrags);
+    if( ctx->frag != 0 || ctx->nfrags != 0 )
+    {
+        if (ctx->fmp4 && ctx->opened) {
+            flv_mp4_write_fragment(&ctx->file, &ctx->mp4, ts);
+        }
+
+        /* the single file stays open for the next fragment */
+        if (!ctx->single) {
+            if (ctx->durable && ctx->opened && ctx->file.fd != -1) {
+                ctx->sync_fds[ctx->nsync_fds++] = dup(ctx->file.fd);
+            }
+
+            flv_mpegts_close_file(&ctx->file);
+        }
+
+        f = hls_get_frag(ctx, ctx->nfrags);
+        f->size = ctx->file.offset - f->offset;
+
+        if (ctx->opened && flv_hls_sink_local(ctx->sink)) {
+            hls_commit_fragment(ctx);
+        }
+
+        /* the whole segment goes ahead of the playlist listing it */
+        if (ctx->file.out) {
+            flv_hls_sink_put(ctx->sink, ctx->stream, ctx->file.out);
+            ctx->file.out = NULL;
+        }
+
+        if (ctx->crc) {
+            f->crc = ctx->file.crc;
+            hls_write_crc(ctx, f);
+        }
+
+        if (f->duration > 0) {
+            hls_update_bandwidth(ctx, f);
+        }
+
+        ctx->opened = 0;
+
+        if (ctx->file.mem) {
+            f = hls_get_frag(ctx, ctx->nfrags);
+
+            /* the last part takes the rest of the fragment */
+            d = f->duration;
+            for (i = 0; i < f->nparts; i++) {
+                d -= f->parts[i].duration;
+            }
+            f->parts[f->nparts++].duration = d > 0 ? d : 0;
+
+            hls_store_add_part(ctx->store, f->id, ctx->file.mem);
+            hls_store_close_segment(ctx->store, f->id);
+            ctx->file.mem = NULL;
+        }
+    }else{
+    /*
+        if( ctx->aframe )
+        {
+            DEBUG("*********clean aframe***************\n");
+            memset(ctx->aframe->buf, 0, sizeof(MAX_FRAME_SIZE));
+            ctx->aframe->last = ctx->aframe->pos = ctx->aframe->start = ctx->aframe->buf;
+            ctx->aframe_pts = 0;
+        }
+        */
+        ctx->bStart = 1;
+    }
+    hls_next_frag(ctx);
+
+    /* vod writes the playlist once at the end */
+    if( !ctx->vod && (ctx->frag != 0 || ctx->nfrags != 1))
+    {
+        hls_write_playlist(ctx);
+    }
+    return SUCCESS;
+}
+
+static u_int64_t
+flv_hls_get_fragment_id(hls_ctx_t*ctx)
+{
+    return ctx->frag + ctx->nfrags;    
+}
+
+/*
+ * SAMPLE-AES of the buffered ADTS frames, with the key of the fragment
+ * they are flushed to. 16 bytes and the last partial block stay clear.
+ */
+static void
+hls_sample_aes_audio(hls_ctx_t *ctx, str_buf_t *b)
+{
+    u_char                          *p, iv[16];
+    u_int32_t                       len;
+
+    for (p = b->pos; p + 7 <= b->last; p += len) {
+        len = ((p[3] & 0x03) << 11) | (p[4] << 3) | (p[5] >> 5);
+        if (len < 7 || p + len > b->last) {
+            break;
+        }
+
+        if (len - 7 > 16) {
+            memcpy(iv, ctx->aes_iv, 16);
+            flv_aes_cbc_encrypt(&ctx->aes, iv, p + 7 + 16, p + 7 + 16,
+                                (len - 7 - 16) & ~0x0f);
+        }
+    }
+}
+
+
+static int
+hls_flush_audio(hls_ctx_t *ctx)
+{
+    flv_mpegts_frame_t         frame;
+    int                                rc;
+    str_buf_t                      *b;
+
+    b = ctx->aframe;
+
+    if (b == NULL || b->pos == b->last) {
+        return SUCCESS;
+    }
+
+
+    memset(&frame, 0, sizeof(frame));
 
     frame.dts = ctx->aframe_pts;
     frame.pts = frame.dts;
     frame.cc = ctx->audio_cc;
     frame.pid = 0x101;
     frame.sid = 0xc0;
+    frame.key = ctx->audio_only;  /* PCR */
+
+    DEBUG("hls: flush audio frame pts=%u\n", frame.pts);
+
+    if (ctx->sample_aes) {
+        hls_sample_aes_audio(ctx, b);
+    }
+
+    rc = flv_mpegts_write_frame(&ctx->file, &frame, b);
+
+    if (rc != SUCCESS) {
+        ERROR("error: hls_flush_audio call flv_mpegts_write_frame failed");
+    }
+
+    ctx->audio_cc = frame.cc;
+    b->pos = b->last = b->start;
+
+    return rc;
+}
+
+/*
+ * end of input: flush the buffered audio and publish
+ * the fragment in progress, the live input from pipe
+ * would otherwise lose the last fragment.
+ */
+static int
+hls_finish(hls_ctx_t *ctx)
+{
+    /* the last fragment completes the batch */
+    if (ctx->durable) {
+        ctx->unsynced = ctx->durable - 1;
+    }
+
+    if (ctx->opened) {
+        hls_flush_audio(ctx);
+        hls_close_fragment(ctx, 0);
+    }
+
+    if (ctx->unsynced || ctx->nsync_fds) {
+        hls_sync_fragments(ctx);
+    }
+
+    if (ctx->vod) {
+        hls_write_playlist(ctx);
+    }
+
+    /* give back the preallocated space past the end */
+    if (ctx->single_fd != -1) {
+        if (ftruncate(ctx->single_fd, ctx->file.offset) != 0) {
+            ERROR("error: hls truncate %s failed\n", ctx->single_name.c_str());
+        }
+
+        close(ctx->single_fd);
+        ctx->single_fd = -1;
+    }
+
+    return SUCCESS;
+}
+
+
+/*
+ * the fmp4 init segment from the codec headers, written once
+ * before the first fragment.
+ */
+static int
+hls_write_init(hls_ctx_t *ctx)
+{
+    flv_mpegts_file_t               file;
+    int                             rc;
+    std::string                     path, tmp;
+    av_codec_ctx_t                  codec;
+
+    memset(&file, 0, sizeof(file));
+    file.mem = ctx->store ? hls_buf_create(1024) : NULL;
+    file.out = flv_hls_sink_local(ctx->sink) ? NULL : hls_buf_create(1024);
+
+    path = std::string(ctx->stream, ctx->stream_len) + HLS_MP4_INIT;
+    tmp = path + HLS_TMP_EXT;
+
+    if (flv_mp4_open_file(&file, (char *) tmp.c_str()) != SUCCESS) {
+        hls_buf_unref(file.mem);
+        hls_buf_unref(file.out);
+        return ERROR_NORMAL;
+    }
+
+    /* the audio only rendition has no video track */
+    codec = *ctx->codec;
+    if (ctx->audio_only) {
+        codec.avc_header = NULL;
+        codec.avc_header_size = 0;
+    }
+
+    rc = flv_mp4_write_init(&file, &codec);
+
+    if (rc == SUCCESS && ctx->durable && file.fd != -1
+        && fdatasync(file.fd) != 0)
+    {
+        rc = ERROR_NORMAL;
+    }
+
+    flv_mpegts_close_file(&file);
+
+    if (rc != SUCCESS) {
+        ERROR("error: hls write %s failed\n", HLS_MP4_INIT);
+        hls_buf_unref(file.mem);
+        hls_buf_unref(file.out);
+        return rc;
+    }
+
+    if (file.out) {
+        flv_hls_sink_put(ctx->sink, path.c_str(), file.out);
+
+    } else if (flv_hls_sink_rename(ctx->sink, tmp.c_str(), path.c_str(),
+                                   ctx->durable ? FLV_HLS_SINK_SYNC : 0)
+               != SUCCESS)
+    {
+        hls_buf_unref(file.mem);
+        return ERROR_NORMAL;
+    }
+
+    if (file.mem) {
+        hls_store_set_init(ctx->store, HLS_MP4_INIT, file.mem);
+    }
+
+    ctx->init_written = 1;
+
+    return SUCCESS;
+}
+
+
+/*
+ * a new key every frags_per_key fragments, written next to the
+ * playlist before the first fragment it encrypts.
+ */
+static int
+hls_ensure_key(hls_ctx_t *ctx, u_int64_t id)
+{
+    std::string                     path;
+    struct iovec                    iov;
+    int                             fd;
+    ssize_t                         n;
+
+    if (ctx->key_frags > 0) {
+        ctx->key_frags--;
+        return SUCCESS;
+    }
+
+    fd = open("/dev/urandom", O_RDONLY);
+    if (fd == -1) {
+        ERROR("error: hls open /dev/urandom failed\n");
+        return ERROR_NORMAL;
+    }
+
+    n = read(fd, ctx->key, sizeof(ctx->key));
+    close(fd);
+
+    if (n != sizeof(ctx->key)) {
+        ERROR("error: hls read key failed\n");
+        return ERROR_NORMAL;
+    }
+
+    path = ctx->key_path + std::to_string((unsigned long long) id) + ".key";
+
+    iov.iov_base = ctx->key;
+    iov.iov_len = sizeof(ctx->key);
+
+    /* on disk before any segment encrypted with it */
+    if (flv_hls_sink_writev(ctx->sink, path.c_str(),
+                            (path + HLS_TMP_EXT).c_str(), &iov, 1,
+                            ctx->durable ? FLV_HLS_SINK_SYNC : 0)
+        != SUCCESS)
+    {
+        return ERROR_NORMAL;
+    }
+
+    ctx->key_id = id;
+    ctx->key_frags = ctx->frags_per_key ? ctx->frags_per_key - 1
+                                        : (u_int32_t) -1;
+
+    return SUCCESS;
+}
+
+
+/*
+ * key and iv of the samples and the PMT of the encrypted streams,
+ * made again for each fragment since the AAC header may come late.
+ */
+static void
+hls_init_sample_aes(hls_ctx_t *ctx, u_int64_t id)
+{
+    av_codec_ctx_t                  *codec;
+    unsigned                        streams;
+    u_int32_t                       i;
+
+    codec = ctx->codec;
+
+    flv_aes_set_key(&ctx->aes, ctx->key);
+
+    memset(ctx->aes_iv, 0, 8);
+    for (i = 0; i < 8; i++) {
+        ctx->aes_iv[15 - i] = (u_char) (id >> (i * 8));
+    }
+
+    streams = FLV_MPEGTS_AUDIO | FLV_MPEGTS_SAMPLE_AES;
+    if (!ctx->audio_only) {
+        streams |= FLV_MPEGTS_VIDEO;
+    }
+
+    if (codec->aac_header && codec->aac_header_size > 2) {
+        flv_mpegts_make_header(ctx->ts_header, streams, codec->aac_header + 2,
+                               codec->aac_header_size - 2);
+    } else {
+        flv_mpegts_make_header(ctx->ts_header, streams, NULL, 0);
+    }
+
+    ctx->file.header = ctx->ts_header;
+}
+
+
+/*
+ * the fragments are appended to the single file, opened with the
+ * first one. the space is reserved ahead so that the file is not
+ * fragmented on disk, the size still follows the written bytes.
+ */
+static int
+hls_open_single(hls_ctx_t *ctx)
+{
+    if (ctx->single_fd == -1) {
+        ctx->single_fd = open(ctx->single_name.c_str(),
+                              O_WRONLY|O_CREAT|O_TRUNC, 0644);
+        if (ctx->single_fd == -1) {
+            ERROR("error: hls open %s failed\n", ctx->single_name.c_str());
+            return ERROR_NORMAL;
+        }
+
+        ctx->file.fd = ctx->single_fd;
+        ctx->file.offset = 0;
+        ctx->single_alloc = 0;
+    }
+
+    if (ctx->file.offset + HLS_SINGLE_PREALLOC / 2 > ctx->single_alloc) {
+        if (fallocate(ctx->single_fd, FALLOC_FL_KEEP_SIZE, ctx->single_alloc,
+                      HLS_SINGLE_PREALLOC) != 0)
+        {
+            DEBUG("hls preallocate %s failed, errno=%d\n",
+                  ctx->single_name.c_str(), errno);
+        }
+
+        ctx->single_alloc += HLS_SINGLE_PREALLOC;
+    }
+
+    return ctx->fmp4 ? SUCCESS : flv_mpegts_start_file(&ctx->file);
+}
+
+
+static int
+hls_open_fragment(hls_ctx_t*ctx, u_int64_t ts,
+    int discont)
+{
+    u_int64_t                  id;
+    int                            fd, rc;
+    u_int32_t                  g;
+    hls_frag_t                 *f;
+    off_t                      offset;
+    std::string                tmp;
+
+
+    id = flv_hls_get_fragment_id(ctx);
+    DEBUG("hls_open_fragment, id:%d\n", id);
+    sprintf(ctx->stream + ctx->stream_len, "%u.%s", id, hls_segment_ext(ctx));
+
+    if (ctx->fmp4 && !ctx->init_written) {
+        hls_write_init(ctx);
+    }
+
+    hls_buf_unref(ctx->file.mem);
+    ctx->file.mem = ctx->store ? hls_buf_create(256 * 1024) : NULL;
+
+    hls_buf_unref(ctx->file.out);
+    ctx->file.out = flv_hls_sink_local(ctx->sink) ? NULL
+                                                  : hls_buf_create(256 * 1024);
+
+    offset = ctx->single ? ctx->file.offset : 0;
+
+    /* the hash of the single file starts again with each fragment */
+    ctx->file.hash = (ctx->crc != 0);
+    ctx->file.crc = 0;
+
+    if (ctx->encrypt) {
+        if (hls_ensure_key(ctx, id) != SUCCESS) {
+            return ERROR_NORMAL;
+        }
+
+        /* the iv is the fragment id, its media sequence number */
+        if (ctx->sample_aes) {
+            hls_init_sample_aes(ctx, id);
+        } else {
+            flv_mpegts_init_encryption(&ctx->file, ctx->key,
+                                       sizeof(ctx->key), id);
+        }
+    }
+
+    /* written aside and renamed when closed, never seen torn */
+    tmp = std::string(ctx->stream) + HLS_TMP_EXT;
+
+    if (ctx->single) {
+        rc = hls_open_single(ctx);
+    } else if (ctx->fmp4) {
+        rc = flv_mp4_open_file(&ctx->file, (char *) tmp.c_str());
+    } else {
+        rc = flv_mpegts_open_file(&ctx->file, (char *) tmp.c_str());
+    }
+
+    if (rc != SUCCESS)
+    {
+        printf("hls_open_fragment:open file failed\n");
+        return ERROR_NORMAL;
+    }
+
+    ctx->opened = 1;
+
+    f = hls_get_frag(ctx, ctx->nfrags);
+
+    memset(f, 0, sizeof(*f));
+
+    f->active = 1;
+    f->discont = discont;
+    f->id = id;
+    f->offset = offset;
+    f->key_id = ctx->key_id;
+
+    ctx->frag_ts = ts;
+    ctx->part_ts = ts;
+
+    /* start fragment with audio to make iPhone happy */
+
+    hls_flush_audio(ctx);
+
+    return SUCCESS;
+}
+
+
+
+
+/* the options that change what the state of an output means */
+static u_int32_t
+hls_checkpoint_flags(hls_ctx_t *ctx)
+{
+    return ctx->fmp4 | ctx->single << 1 | ctx->vod << 2 | ctx->encrypt << 3
+           | ctx->sample_aes << 4 | ctx->iframes << 5 | ctx->audio_only << 6
+           | ctx->crc << 7 | (ctx->expire ? 1 : 0) << 9;
+}
+
+
+/*
+ * the output between a fragment closed and the next one, and the
+ * tag of the input that opens it.
+ */
+static void
+hls_checkpoint_head(hls_ctx_t *ctx, hls_checkpoint_head_t *h)
+{
+    hls_checkpoint_t                *cp;
+    hls_entries_t                   *e;
+
+    cp = ctx->checkpoint;
+
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, HLS_CHECKPOINT_MAGIC, sizeof(h->magic));
+    h->head_size = sizeof(*h);
+    h->frag_size = sizeof(hls_frag_t);
+    h->winfrags = ctx->winfrags;
+    h->flags = hls_checkpoint_flags(ctx);
+
+    h->offset = cp->offset;
+    h->vstartime = cp->vstartime;
+    h->avc_header_size = cp->codec->avc_header ? cp->codec->avc_header_size : 0;
+    h->aac_header_size = cp->codec->aac_header ? cp->codec->aac_header_size : 0;
+    h->aframe_len = ctx->aframe ? ctx->aframe->last - ctx->aframe->pos : 0;
+
+    h->frag = ctx->frag;
+    h->nfrags = ctx->nfrags;
+    h->target = ctx->target;
+    h->ntargets = ctx->ntargets;
+    h->nexpired_max = ctx->expired ? ctx->expire * ctx->winfrags + 1 : 0;
+    h->expired_head = ctx->expired_head;
+    h->nexpired = ctx->nexpired;
+
+    h->audio_cc = ctx->audio_cc;
+    h->video_cc = ctx->video_cc;
+    h->aframe_base = ctx->aframe_base;
+    h->aframe_num = ctx->aframe_num;
+    h->aframe_pts = ctx->aframe_pts;
+    h->bStart = ctx->bStart;
+    h->vod_target = ctx->vod_target;
+    h->meta_target = ctx->meta_target;
+    h->part_last_ts = ctx->part_last_ts;
+    h->part_gap = ctx->part_gap;
+
+    h->init_written = ctx->init_written;
+    h->mp4_seq = ctx->mp4.seq;
+    h->mp4_video_duration = ctx->mp4.video.last_duration;
+    h->mp4_audio_duration = ctx->mp4.audio.last_duration;
+
+    memcpy(h->key, ctx->key, sizeof(h->key));
+    h->key_id = ctx->key_id;
+    h->key_frags = ctx->key_frags;
+
+    h->single_size = ctx->single ? ctx->file.offset : 0;
+    h->crc_size = ctx->crc_fd != -1 ? lseek(ctx->crc_fd, 0, SEEK_END) : 0;
+
+    e = &ctx->entries;
+    h->entries_base = e->base + e->pos;
+    h->entries_len = e->last - e->pos;
+
+    e = &ctx->iframe_entries;
+    h->iframes_base = e->base + e->pos;
+    h->iframes_len = e->last - e->pos;
+    h->iframe_seq = ctx->iframe_seq;
+    h->iframe_bw = ctx->iframe_bw;
+
+    h->peak_bw = ctx->peak_bw;
+    h->bytes = ctx->bytes;
+    h->seconds = ctx->seconds;
+}
+
+
+/*
+ * CRC32C of the first and the last bytes of the input before the tag,
+ * an archive appended to keeps it and one rewritten likely not.
+ */
+static int
+hls_input_hash(const char *path, int64_t offset, u_int32_t *crc)
+{
+    u_char                          buf[HLS_INPUT_HASH];
+    int64_t                         from;
+    ssize_t                         n;
+    int                             fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return ERROR_NORMAL;
+    }
+
+    n = pread(fd, buf, offset < HLS_INPUT_HASH ? offset : HLS_INPUT_HASH, 0);
+    *crc = flv_crc32c(0, buf, n > 0 ? n : 0);
+
+    from = offset > HLS_INPUT_HASH ? offset - HLS_INPUT_HASH : 0;
+
+    n = pread(fd, buf, offset - from, from);
+    *crc = flv_crc32c(*crc, buf, n > 0 ? n : 0);
+
+    close(fd);
+
+    return n == offset - from ? SUCCESS : ERROR_NORMAL;
+}
+
+
+/*
+ * the state with the arrays and the bytes of the output as they are,
+ * which is as they were at the close of h while no fragment closed
+ * since. written aside, synced and renamed so that a crash leaves
+ * this one or the one before, the segments on disk agree with both.
+ * the key is in it, 0600.
+ */
+static int
+hls_write_checkpoint(hls_ctx_t *ctx, hls_checkpoint_head_t *h,
+    u_char *aframe)
+{
+    hls_checkpoint_t                *cp;
+    hls_buf_t                       *b;
+    u_char                          *p;
+    size_t                          left;
+    ssize_t                         n;
+    int                             fd, rc;
+
+    cp = ctx->checkpoint;
+
+    /* nothing it refers to is lost with it */
+    if (ctx->durable && (ctx->unsynced || ctx->nsync_fds)) {
+        hls_sync_fragments(ctx);
+    }
+
+    flv_hls_sink_flush(ctx->sink);
+
+    if (!cp->input.empty()
+        && hls_input_hash(cp->input.c_str(), h->offset, &h->input_crc)
+           != SUCCESS)
+    {
+        ERROR("error: hls read %s failed\n", cp->input.c_str());
+        return ERROR_NORMAL;
+    }
+
+    b = hls_buf_create(sizeof(*h) + h->entries_len + 64 * 1024);
+    if (b == NULL) {
+        return ERROR_NORMAL;
+    }
+
+    rc = hls_buf_append(b, (u_char *) h, sizeof(*h));
+    rc |= hls_buf_append(b, (u_char *) ctx->frags,
+                         (ctx->winfrags * 2 + 1) * sizeof(hls_frag_t));
+    rc |= hls_buf_append(b, (u_char *) ctx->targets,
+                         (ctx->winfrags + 1) * sizeof(hls_target_t));
+    rc |= hls_buf_append(b, (u_char *) ctx->expired,
+                         h->nexpired_max * sizeof(hls_expired_t));
+    rc |= hls_buf_append(b, ctx->entries.data + ctx->entries.pos,
+                         h->entries_len);
+    rc |= hls_buf_append(b, ctx->iframe_entries.data
+                            + ctx->iframe_entries.pos, h->iframes_len);
+    rc |= hls_buf_append(b, aframe, h->aframe_len);
+    rc |= hls_buf_append(b, cp->codec->avc_header, h->avc_header_size);
+    rc |= hls_buf_append(b, cp->codec->aac_header, h->aac_header_size);
+
+    if (rc != SUCCESS) {
+        hls_buf_unref(b);
+        return ERROR_NORMAL;
+    }
+
+    fd = open(cp->path_bak.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0600);
+    if (fd == -1) {
+        ERROR("error: hls open %s failed\n", cp->path_bak.c_str());
+        hls_buf_unref(b);
+        return ERROR_NORMAL;
+    }
+
+    for (p = b->data, left = b->len; left; p += n, left -= n) {
+        n = write(fd, p, left);
+        if (n <= 0) {
+            break;
+        }
+    }
+
+    rc = (left == 0 && fdatasync(fd) == 0) ? SUCCESS : ERROR_NORMAL;
+
+    close(fd);
+    hls_buf_unref(b);
+
+    if (rc != SUCCESS
+        || rename(cp->path_bak.c_str(), cp->path.c_str()) != 0)
+    {
+        ERROR("error: hls write %s failed\n", cp->path.c_str());
+        return ERROR_NORMAL;
+    }
+
+    return SUCCESS;
+}
+
+
+/*
+ * after each close, every few seconds. the incremental conversion
+ * also keeps the state of the last one for the end of the input, the
+ * next run reads the fragment in progress again with what was added.
+ */
+static void
+hls_update_checkpoint(hls_ctx_t *ctx)
+{
+    hls_checkpoint_t                *cp;
+    hls_checkpoint_head_t           h;
+    struct timespec                 now;
+    u_int64_t                       msec;
+
+    cp = ctx->checkpoint;
+    if (cp == NULL) {
+        return;
+    }
+
+    if (cp->incremental) {
+        hls_checkpoint_head(ctx, &cp->head);
+
+        if (cp->head.aframe_len) {
+            memcpy(cp->aframe, ctx->aframe->pos, cp->head.aframe_len);
+        }
+
+        cp->saved = 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    msec = (u_int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+
+    if (cp->last && msec < cp->last + HLS_CHECKPOINT_MSEC) {
+        return;
+    }
+
+    cp->last = msec;
+
+    hls_checkpoint_head(ctx, &h);
+    hls_write_checkpoint(ctx, &h, ctx->aframe ? ctx->aframe->pos : NULL);
+}
+
+
+/*
+ * the input is converted to the end, nothing to resume. an incremental
+ * one is continued from the last close when it has grown.
+ */
+static void
+hls_end_checkpoint(hls_ctx_t *ctx)
+{
+    hls_checkpoint_t                *cp;
+
+    cp = ctx->checkpoint;
+
+    if (cp->incremental && cp->saved) {
+        hls_write_checkpoint(ctx, &cp->head, cp->aframe);
+        return;
+    }
+
+    unlink(cp->path.c_str());
+}
+
+
+/*
+ * cut a LL-HLS part before the frame that would make it
+ * longer than the part target, it is published at once.
+ */
+static void
+hls_update_part(hls_ctx_t *ctx, u_int64_t ts)
+{
+    hls_frag_t                      *f;
+    hls_part_t                      *part;
+    int64_t                         d, gap;
+
+    if (!ctx->opened || ctx->partlen == 0 || ctx->file.mem == NULL) {
+        return;
+    }
+
+    f = hls_get_frag(ctx, ctx->nfrags);
+
+    d = (int64_t) (ts - ctx->part_ts);
+    gap = (int64_t) (ts - ctx->part_last_ts);
+    ctx->part_last_ts = ts;
+
+    if (gap > ctx->part_gap && gap < (int64_t) ctx->partlen * 90) {
+        ctx->part_gap = gap;
+    }
+
+    if (d <= 0 || d + ctx->part_gap <= (int64_t) ctx->partlen * 90
+        || f->nparts >= HLS_MAX_PARTS - 1)
+    {
+        return;
+    }
+
+    part = &f->parts[f->nparts++];
+    part->duration = d / 90000.;
+
+    if (ctx->fmp4) {
+        flv_mp4_write_fragment(&ctx->file, &ctx->mp4, ts);
+    }
+
+    hls_store_add_part(ctx->store, f->id, ctx->file.mem);
+    ctx->file.mem = hls_buf_create(64 * 1024);
+
+    ctx->part_ts = ts;
+
+    hls_publish_playlist(ctx);
+}
+
+
+static void
+hls_update_fragment(hls_ctx_t  *ctx, u_int64_t ts, int boundary, u_int32_t flush_rate)
+{
+    hls_frag_t        *f;
+    int                  ts_frag_len;
+    int                   same_frag, force,discont;
+    str_buf_t       *b;
+    int64_t                     d;
+
+    f = NULL;
+    force = 0;
+    discont = 0;
+    DEBUG("hls_update_fragment, boundary:%d, ts:%lld, frag_ts:%lld, max_fraglen:%u\n", 
+        boundary, ts, ctx->frag_ts, ctx->max_fraglen);
+    if (ctx->opened) {
+        f = hls_get_frag(ctx, ctx->nfrags);
+        d = (int64_t) (ts - ctx->frag_ts);
+
+        if (d > (int64_t) ctx->max_fraglen * 90 || d < -90000) {
+            DEBUG("**************force fragment split: %.3f sec, \n", d / 90000.);
+            force = 1;
+            if( !boundary )
+            {
+                DEBUG("not key frame, so not split\n");
+                f->duration = (ts - ctx->frag_ts) / 90000.;
+                discont = 0;
+                force = 0;
+            }
+        } else {
+            f->duration = (ts - ctx->frag_ts) / 90000.;
+            discont = 0;
+        }
+        DEBUG("duration:%d\n", f->duration);
+    }
+    
+    /* past damaged input the next keyframe starts over */
+    if (f && f->duration < ctx->fraglen / 1000. && !ctx->discont) {
+        boundary = 0;
+    }
+  
+    if (boundary || force) {
+
+        /* the checkpoint was taken after the close */
+        if (ctx->resumed) {
+            ctx->resumed = 0;
+        } else {
+            hls_close_fragment(ctx, ts);
+            hls_update_checkpoint(ctx);
+        }
+
+        hls_open_fragment(ctx, ts, discont || ctx->discont);
+        ctx->discont = 0;
+    }
+
+    hls_update_part(ctx, ts);
+
+    b = ctx->aframe;
+    if (ctx->opened && b && b->last > b->pos &&
+        ctx->aframe_pts + (u_int64_t) ctx->max_audio_delay * 90 / flush_rate
+        < ts)
+    {
+        hls_flush_audio(ctx);
+    }
+}
+
+static int
+hls_parse_aac_header(av_codec_ctx_t   *codec_ctx, u_int32_t *objtype,
+    u_int32_t *srindex, u_int32_t *chconf)
+{
+    u_int8_t            *cl;
+    u_char             p[2];
+    u_char              b0, b1;
+    DEBUG("enter hls_parse_aac_header\n");
+    cl = codec_ctx->aac_header;
+
+    if (flv_hls_copy(p, &cl, 2) != SUCCESS) {
+        return ERROR_NORMAL;
+    }
+
+    if (flv_hls_copy(&b0, &cl, 1) != SUCCESS) {
+        return ERROR_NORMAL;
+    }
+
+    if (flv_hls_copy(&b1, &cl, 1) != SUCCESS) {
+        return ERROR_NORMAL;
+    }
+
+    *objtype = b0 >> 3;
+    if (*objtype == 0 || *objtype == 0x1f) {
+        ERROR( "error: hls_parse_aac_header unsupported adts object type:%u\n", *objtype);
+        return ERROR_NORMAL;
+    }
+
+    if (*objtype > 4) {
+
+        /*
+         * Mark all extended profiles as LC
+         * to make Android as happy as possible.
+         */
+
+        *objtype = 2;
+    }
+
+    *srindex = ((b0 << 1) & 0x0f) | ((b1 & 0x80) >> 7);
+    if (*srindex == 0x0f) {
+        ERROR( "error: hls_parse_aac_header unsupported adts sample rate:%u\n", *srindex);
+        return ERROR_NORMAL;
+    }
+
+    *chconf = (b1 >> 3) & 0x0f;
+
+    DEBUG( "hls: aac object_type:%u, sample_rate_index:%u, "
+                   "channel_config:%u\n", *objtype, *srindex, *chconf);
+
+    return SUCCESS;
+}
+
+/*
+ * flv tag shared by all the outputs, what the muxers need from it
+ * is parsed once when it is read.
+ */
+static hls_frame_t *
+hls_frame_create(char type, u_int32_t timestamp, u_char *data, u_int32_t size)
+{
+    hls_frame_t                     *frame;
+
+    frame = new hls_frame_t;
+    memset(frame, 0, sizeof(*frame));
+
+    frame->type = type;
+    frame->timestamp = timestamp;
+    frame->data = data;
+    frame->size = size;
+
+    return frame;
+}
+
+
+/* the outputs are done with it when hls_fanout returns */
+static void
+hls_frame_free(hls_frame_t *frame)
+{
+    if (frame == NULL) {
+        return;
+    }
+
+    free(frame->slices);
+    delete [] frame->annexb;
+    delete [] frame->data;
+    delete frame;
+}
+
+
+/* ADTS header of the raw AAC frame, for mpegts */
+static int
+hls_frame_adts(hls_frame_t *frame, av_codec_ctx_t *codec)
+{
+    u_int32_t                       objtype, srindex, chconf, size;
+    u_char                          *p;
+
+    if (frame->size < 2) {
+        return ERROR_NORMAL;
+    }
+
+    if (hls_parse_aac_header(codec, &objtype, &srindex, &chconf) != SUCCESS) {
+        ERROR( "error: hls_audio aac header error\n");
+        return ERROR_NORMAL;
+    }
+
+    size = frame->size - 2 + 7;
+    p = frame->adts;
+
+    p[0] = 0xff;
+    p[1] = 0xf1;
+    p[2] = (u_char) (((objtype - 1) << 6) | (srindex << 2) |
+                     ((chconf & 0x04) >> 2));
+    p[3] = (u_char) (((chconf & 0x03) << 6) | ((size >> 11) & 0x03));
+    p[4] = (u_char) (size >> 3);
+    p[5] = (u_char) ((size << 5) | 0x1f);
+    p[6] = 0xfc;
+
+    frame->adts_ok = 1;
+
+    return SUCCESS;
+}
+
+
+/* H264 tag header, the AVCC NAL units follow it */
+static int
+hls_frame_avc(hls_frame_t *frame)
+{
+    u_int8_t                        fmt, ftype, htype;
+    u_int32_t                       cts;
+    u_int8_t                        *in = frame->data;
+
+    if (frame->size < 5) {
+        return ERROR_NORMAL;
+    }
+
+    if (flv_hls_copy(&fmt, &in, 1) != SUCCESS) {
+        return -1;
+    }
+
+    if ( (fmt&0xf) != 7 )
+    {
+        ERROR("error: not a h264 frame:%02x, %x\n", fmt, fmt&0xf);
+        return -1;
+    }
+  /* 1: keyframe (IDR)
+     * 2: inter frame
+     * 3: disposable inter frame */
+
+    ftype = (fmt & 0xf0) >> 4;
+
+    /* H264 HDR/PICT */
+
+    if (flv_hls_copy(&htype, &in, 1) != SUCCESS) {
+        ERROR("error: read htype failed\n");
+        return -1;
+    }
+
+    /* proceed only with PICT */
+    /* 0: sequence header
+            1: nalu
+            2: end of sequence
+        */
+    DEBUG("htype:%x, ftype:%x\n", htype, ftype);
+    if (htype != 1) {
+        return SUCCESS;
+    }
+
+    /* 3 bytes: cts */
+
+    cts = 0;
+    if (flv_hls_copy(&cts, &in, 3) != SUCCESS) {
+        ERROR("error: read cts failed\n");
+        return -1;
+    }
+
+    cts = ((cts & 0x00FF0000) >> 16) | ((cts & 0x000000FF) << 16) |
+          (cts & 0x0000FF00);
+
+    frame->pict = 1;
+    frame->key = (ftype == 1);
+    frame->cts = cts;
+    frame->nalu = in;
+    frame->nalu_size = frame->size - (u_int32_t) (in - frame->data);
+
+    return SUCCESS;
+}
+
+
+/* slice NAL in the AnnexB, the SAMPLE-AES outputs encrypt it */
+static int
+hls_frame_add_slice(hls_frame_t *frame, u_int32_t offset, u_int32_t size)
+{
+    u_int32_t                       *slices, max;
+
+    if (frame->nslices == frame->max_slices) {
+        max = frame->max_slices ? frame->max_slices * 2 : 8;
+
+        slices = (u_int32_t *) realloc(frame->slices,
+                                       max * 2 * sizeof(u_int32_t));
+        if (slices == NULL) {
+            return ERROR_NORMAL;
+        }
+
+        frame->slices = slices;
+        frame->max_slices = max;
+    }
+
+    frame->slices[2 * frame->nslices] = offset;
+    frame->slices[2 * frame->nslices + 1] = size;
+    frame->nslices++;
+
+    return SUCCESS;
+}
+
+
+/*
+ * AnnexB of the AVCC NAL units with AUD and SPS/PPS before IDR,
+ * the mpegts payload. each NAL grows by the AnnexB prefix at most.
+ */
+static int
+hls_frame_annexb(hls_frame_t *frame, av_codec_ctx_t *codec_ctx)
+{
+    u_int8_t                        nal_type, src_nal_type;
+    u_int32_t                       len, rlen;
+    u_int32_t                       nal_bytes;
+    u_int32_t                       aud_sent, sps_pps_sent;
+    u_int8_t                        *in, *end;
+    size_t                          cap;
+    str_buf_t                       out;
+
+    cap = 2 * frame->nalu_size + 2 * codec_ctx->avc_header_size + 64;
+    frame->annexb = new u_char[cap];
+
+    out.start = frame->annexb;
+    out.end = frame->annexb + cap;
+    out.last = out.pos = out.start;
+
+    in = frame->nalu;
+    end = frame->nalu + frame->nalu_size;
+
+    nal_bytes = codec_ctx->avc_nal_bytes;
+    aud_sent = 0;
+    sps_pps_sent = 0;
+    DEBUG("cts:%04x, data_len:%d, nal_bytes:%d\n",
+        frame->cts, frame->nalu_size, nal_bytes);
+
+    while (in < end) {
+        if (end - in < (int) nal_bytes) {
+            ERROR("read rlen failed\n");
+            return ERROR_NORMAL;
+        }
+
+        rlen = 0;
+        flv_hls_copy(&rlen, &in, nal_bytes);
+
+        len = 0;
+        flv_rmemcpy(&len, &rlen, nal_bytes);
+
+        if (len == 0) {
+            continue;
+        }
+
+        if (end - in < (int) len) {
+            ERROR("read src_nal_type failed\n");
+            return ERROR_NORMAL;
+        }
+
+        flv_hls_copy(&src_nal_type, &in, 1);
+
+        nal_type = src_nal_type & 0x1f;
+
+        if (nal_type >= 7 && nal_type <= 9) {
+            in += len - 1;
+            continue;
+        }
+        DEBUG("len:%d,nal_type:%d,aud_sent:%d, buf size:%d\n",
+            len,nal_type, aud_sent, out.end-out.last);
+        if (!aud_sent) {
+            switch (nal_type) {
+                case 1:
+                case 5:
+                case 6:
+                    if (hls_append_aud(&out) != SUCCESS) {
+                        ERROR("error: fail to append AUD NAL");
+                    }
+                    DEBUG("add %d bytes for aud\n", out.last-out.start);
+                case 9:
+                    aud_sent = 1;
+                    break;
+            }
+        }
+
+        switch (nal_type) {
+            case 1:
+                sps_pps_sent = 0;
+                break;
+            case 5:
+                if (sps_pps_sent) {
+                    break;
+                }
+                if (hls_append_sps_pps(codec_ctx, &out) != SUCCESS) {
+                    ERROR("error: fail to append SPS/PPS NALs");
+                }
+                sps_pps_sent = 1;
+                break;
+        }
+
+        /* AnnexB prefix */
+
+        if (out.end - out.last < 5) {
+            ERROR("error: not enough buffer for AnnexB prefix");
+            return ERROR_NORMAL;
+        }
+
+        /* first AnnexB prefix is long (4 bytes) */
+
+        if (out.last == out.pos) {
+            *out.last++ = 0;
+        }
+
+        *out.last++ = 0;
+        *out.last++ = 0;
+        *out.last++ = 1;
+        *out.last++ = src_nal_type;
+
+        /* NAL body */
+
+        if (out.end - out.last < (int) len) {
+            ERROR( "error: not enough buffer for NAL");
+            return ERROR_NORMAL;
+        }
+
+        if (frame->slices_on && (nal_type == 1 || nal_type == 5)
+            && hls_frame_add_slice(frame, out.last - 1 - out.start, len)
+               != SUCCESS)
+        {
+            return ERROR_NORMAL;
+        }
+
+        flv_hls_copy(out.last, &in, len - 1);
+        out.last += (len - 1);
+    }
+
+    frame->annexb_len = out.last - out.start;
+    frame->annexb_ok = 1;
+
+    return SUCCESS;
+}
+
+
+/*
+ * everything the outputs need from the frame, made once before
+ * it is given to them. the frame is read only from then on.
+ */
+static void
+hls_frame_prepare(hls_frame_t *frame, av_codec_ctx_t *codec, int mpegts)
+{
+    if (frame->type == NGX_RTMP_MSG_VIDEO) {
+        if (hls_frame_avc(frame) == SUCCESS && frame->pict && mpegts) {
+            hls_frame_annexb(frame, codec);
+        }
+
+        frame->boundary = frame->key;
+
+        return;
+    }
+
+    if (mpegts) {
+        hls_frame_adts(frame, codec);
+    }
+}
+
+
+static int
+hls_audio(hls_ctx_t *ctx, hls_frame_t *frame)
+{
+    av_codec_ctx_t           *codec;
+    u_int64_t                        pts, est_pts;
+    int64_t                         dpts;
+    str_buf_t                      *b;
+    u_int8_t                      *p;
+    u_int32_t                   size;
+    hls_frag_t                  *f;
+    int                         video;
+
+    codec = ctx->codec;
+    DEBUG("enter hls_audio,ts:%u\n", frame->timestamp);
+    b = ctx->aframe;
+    if (b == NULL) {
+        b = new str_buf_t;
+        
+        b->end = b->buf + MAX_FRAME_SIZE;
+        b->last = b->pos = b->start = b->buf;
+        ctx->aframe = b;
+    }
+    
+ 
+    size = frame->size - 2 + 7;
+    pts = (u_int64_t) frame->timestamp * 90;
+
+    if (b->start + size > b->end) {
+        ERROR("error: hls_audio too big audio frame\n");
+        return SUCCESS;
+    }
+    /*
+     * start new fragment here if
+     * there's no video at all, otherwise
+     * do it in video handler
+     */
+
+    video = (codec->avc_header != NULL && !ctx->audio_only);
+
+    hls_update_fragment(ctx, pts, !video, 2);
+
+    /* without video any part starts clean */
+    if (ctx->opened && !video) {
+        f = hls_get_frag(ctx, ctx->nfrags);
+        f->parts[f->nparts].independent = 1;
+    }
+
+    /* raw AAC frame goes to mdat as is */
+    if (ctx->fmp4) {
+        if (!ctx->opened) {
+            return SUCCESS;
+        }
+
+        return flv_mp4_add_sample(&ctx->mp4.audio, pts, 0, 1,
+                                  frame->data + 2, frame->size - 2);
+    }
+
+    if (!frame->adts_ok) {
+        return SUCCESS;
+    }
+
+    if (b->last + size > b->end) {
+        hls_flush_audio(ctx);
+    }
+
+    
+
+    if (b->last + 7 > b->end) {
+        ERROR( "error: hls_audio not enough buffer for audio header\n");
+        return SUCCESS;
+    }
+
+    /* ADTS header and the payload after 2 bytes of RTMP frame header */
+
+    p = b->last;
+    memcpy(p, frame->adts, 7);
+    memcpy(p + 7, frame->data + 2, frame->size - 2);
+    b->last += size;
+
+    if (p != b->start) {
+        ctx->aframe_num++;
+        DEBUG("hls_audio, aframe_num:%d\n", ctx->aframe_num);
+        return SUCCESS;
+    }
+
+    ctx->aframe_pts = pts;
+
+    if (!ctx->sync || codec->sample_rate == 0) {
+        return SUCCESS;
+    }
+
+    /* align audio frames */
+
+    /* TODO: We assume here AAC frame size is 1024
+     *       Need to handle AAC frames with frame size of 960 */
+
+    est_pts = ctx->aframe_base + ctx->aframe_num * 90000 * 1024 /
+                                 codec->sample_rate;
+    dpts = (int64_t) (est_pts - pts);
+
+    DEBUG("hls: audio sync dpts=%L (%.5fs)\n",
+                   dpts, dpts / 90000.);
+
+    if (dpts <= (int64_t) ctx->sync * 90 &&
+        dpts >= (int64_t) ctx->sync * -90)
+    {
+        ctx->aframe_num++;
+        ctx->aframe_pts = est_pts;
+        return SUCCESS;
+    }
+
+    ctx->aframe_base = pts;
+    ctx->aframe_num  = 1;
+
+    DEBUG("hls: audio sync gap dpts=%L (%.5fs)\n",
+                   dpts, dpts / 90000.);
+
+    return SUCCESS;
+}
+
+
+
+/* the NAL without the emulation prevention bytes */
+static size_t
+hls_nal_unescape(const u_char *src, size_t len, u_char *dst)
+{
+    const u_char                    *p, *end, *z;
+    u_char                          *d;
+
+    p = src;
+    end = src + len;
+    d = dst;
+
+    while (p < end) {
+        z = (const u_char *) memchr(p, 0, end - p);
+
+        if (z == NULL || end - z < 3) {
+            d = (u_char *) memcpy(d, p, end - p) + (end - p);
+            break;
+        }
+
+        if (z[1] == 0 && z[2] == 3) {
+            d = (u_char *) memcpy(d, p, z + 2 - p) + (z + 2 - p);
+            p = z + 3;
+            continue;
+        }
+
+        d = (u_char *) memcpy(d, p, z + 1 - p) + (z + 1 - p);
+        p = z + 1;
+    }
+
+    return d - dst;
+}
+
+
+/* emulation prevention back, zero runs are found by memchr */
+static size_t
+hls_nal_escape(const u_char *src, size_t len, u_char *dst)
+{
+    const u_char                    *p, *end, *z;
+    u_char                          *d;
+
+    p = src;
+    end = src + len;
+    d = dst;
+
+    while (p < end) {
+        z = (const u_char *) memchr(p, 0, end - p);
+
+        if (z == NULL || end - z < 3) {
+            d = (u_char *) memcpy(d, p, end - p) + (end - p);
+            break;
+        }
+
+        if (z[1] == 0 && z[2] <= 3) {
+            d = (u_char *) memcpy(d, p, z + 2 - p) + (z + 2 - p);
+            *d++ = 3;
+            p = z + 2;
+            continue;
+        }
+
+        d = (u_char *) memcpy(d, p, z + 1 - p) + (z + 1 - p);
+        p = z + 1;
+    }
+
+    return d - dst;
+}
+
+
+/*
+ * SAMPLE-AES of the slices in the shared AnnexB into a buffer of the
+ * output. a slice longer than 48 bytes keeps its first 32 bytes
+ * clear, then one block in ten is encrypted, the cbc chain restarts
+ * with every NAL and a last block short of 16 bytes is left clear.
+ */
+static int
+hls_sample_aes_video(hls_ctx_t *ctx, hls_frame_t *in, str_buf_t *out)
+{
+    u_char                          iv[16], *d, *p;
+    u_int32_t                       i, off, len, last;
+    size_t                          cap, n, rem, clear;
+
+    /* escaping adds one byte in three at most */
+    cap = in->annexb_len + in->annexb_len / 2 + 16;
+
+    if (cap > ctx->saes_cap) {
+        delete [] ctx->saes;
+        ctx->saes = new u_char[cap];
+        ctx->saes_cap = cap;
+    }
+
+    d = ctx->saes;
+    last = 0;
+
+    for (i = 0; i < in->nslices; i++) {
+        off = in->slices[2 * i];
+        len = in->slices[2 * i + 1];
+
+        d = (u_char *) memcpy(d, in->annexb + last, off + len - last)
+            + (off + len - last);
+        last = off + len;
+
+        if (len <= 48) {
+            continue;
+        }
+
+        if (len > ctx->rbsp_cap) {
+            delete [] ctx->rbsp;
+            ctx->rbsp = new u_char[len];
+            ctx->rbsp_cap = len;
+        }
+
+        n = hls_nal_unescape(in->annexb + off, len, ctx->rbsp);
+        if (n <= 48) {
+            continue;
+        }
+
+        memcpy(iv, ctx->aes_iv, 16);
+
+        p = ctx->rbsp + 32;
+        rem = n - 32;
+
+        while (rem > 0) {
+            if (rem > 16) {
+                flv_aes_cbc_encrypt(&ctx->aes, iv, p, p, 16);
+                p += 16;
+                rem -= 16;
+            }
+
+            clear = rem < 144 ? rem : 144;
+            p += clear;
+            rem -= clear;
+        }
+
+        /* the clear slice copied above is replaced */
+        d -= len;
+        d += hls_nal_escape(ctx->rbsp, n, d);
+    }
+
+    d = (u_char *) memcpy(d, in->annexb + last, in->annexb_len - last)
+        + (in->annexb_len - last);
+
+    out->start = out->pos = ctx->saes;
+    out->last = out->end = d;
+
+    return SUCCESS;
+}
+
+
+/*
+ * the AVCC NAL units of the tag are the fmp4 sample,
+ * no AUD, SPS/PPS or AnnexB prefix are needed.
+ */
+static int
+hls_video_mp4(hls_ctx_t *ctx, u_int8_t *in, int size, u_int64_t dts,
+    u_int32_t cts, int key, int boundary)
+{
+    hls_frag_t                      *f;
+
+    hls_update_fragment(ctx, dts, boundary, 1);
+
+    if (!ctx->opened) {
+        return SUCCESS;
+    }
+
+    if (key) {
+        f = hls_get_frag(ctx, ctx->nfrags);
+        f->parts[f->nparts].independent = 1;
+    }
+
+    return flv_mp4_add_sample(&ctx->mp4.video, dts, cts, key, in, size);
+}
+
+
+static int
+hls_video(hls_ctx_t *ctx, hls_frame_t *in)
+{
+    flv_mpegts_frame_t         frame;
+    u_int32_t                       boundary;
+    str_buf_t                        out;
+    hls_frag_t                      *f;
+    off_t                           offset;
+
+    DEBUG("enter hls_video, ts:%u\n", in->timestamp);
+
+    if (!in->pict) {
+        return SUCCESS;
+    }
+
+    if (ctx->fmp4) {
+        return hls_video_mp4(ctx, in->nalu, in->nalu_size,
+                             (u_int64_t) in->timestamp * 90, in->cts * 90,
+                             in->key, in->boundary);
+    }
+
+    if (!in->annexb_ok) {
+        return SUCCESS;
+    }
+
+    memset(&frame, 0, sizeof(frame));
+
+    frame.cc = ctx->video_cc;
+    frame.dts = (u_int64_t) in->timestamp * 90;
+    frame.pts = frame.dts + in->cts * 90;
+    frame.pid = 0x100;
+    frame.sid = 0xe0;
+    frame.key = in->key;
+    DEBUG("####have key frame:%d\n", frame.key);
+
+    /*
+     * start new fragment if
+     * - we have video key frame AND
+     * - we have audio buffered or have no audio at all or stream is closed
+     */
+/*
+    b = ctx->aframe;
+    boundary = frame.key && (codec_ctx->aac_header == NULL || !ctx->opened ||
+                             (b && b->last > b->pos));
+*/
+    boundary = in->boundary;
+
+    hls_update_fragment(ctx, frame.dts, boundary, 1);
+
+    if (!ctx->opened) {
+        DEBUG("ctx not opened\n");
+        return SUCCESS;
+    }
+
+    /* the shared AnnexB is consumed through a buffer of this output */
+    out.start = out.pos = in->annexb;
+    out.last = out.end = in->annexb + in->annexb_len;
+
+    /* with the key of the fragment the frame starts */
+    if (ctx->sample_aes) {
+        if (hls_sample_aes_video(ctx, in, &out) != SUCCESS) {
+            ERROR("error: hls SAMPLE-AES video frame failed\n");
+            return SUCCESS;
+        }
+    }
+
+    DEBUG("hls_video pts=%u, dts=%u\n", frame.pts, frame.dts);
+
+    if (frame.key) {
+        f = hls_get_frag(ctx, ctx->nfrags);
+        f->parts[f->nparts].independent = 1;
+    }
+
+    offset = ctx->file.offset;
+
+    if (flv_mpegts_write_frame(&ctx->file, &frame, &out) != SUCCESS) {
+        ERROR("error: flv_mpegts_write_frame video frame failed");
+    }
+
+    if (frame.key && ctx->iframes) {
+        hls_iframes_add(ctx, frame.dts, offset);
+    }
+
+    ctx->video_cc = frame.cc;
+
+    return SUCCESS;
+}
+
+
+static void
+av_codec_parse_aac_header(Flv2hlsContext*context, u_int8_t*data, int data_len)
+{
+    u_int32_t               idx;
+    av_codec_ctx_t          *ctx = &context->codec;
+    stream_bit_reader_t     br;
+    DEBUG("enter av_codec_parse_aac_header\n");
+    static u_int32_t    aac_sample_rates[] =
+        { 96000, 88200, 64000, 48000,
+          44100, 32000, 24000, 22050,
+          16000, 12000, 11025,  8000,
+           7350,     0,     0,     0 };
+
+    stream_bit_init_reader(&br, data, data+data_len);
+
+    stream_bit_read(&br, 16);
+
+    ctx->aac_profile = (u_int32_t) stream_bit_read(&br, 5);
+    if (ctx->aac_profile == 31) {
+        ctx->aac_profile = (u_int32_t) stream_bit_read(&br, 6) + 32;
+    }
+
+    idx = (u_int32_t) stream_bit_read(&br, 4);
+    if (idx == 15) {
+        ctx->sample_rate = (u_int32_t) stream_bit_read(&br, 24);
+    } else {
+        ctx->sample_rate = aac_sample_rates[idx];
+    }
+
+    ctx->aac_chan_conf = (u_int32_t) stream_bit_read(&br, 4);
+
+    if (ctx->aac_profile == 5 || ctx->aac_profile == 29) {
+        
+        if (ctx->aac_profile == 29) {
+            ctx->aac_ps = 1;
+        }
+
+        ctx->aac_sbr = 1;
+
+        idx = (u_int32_t) stream_bit_read(&br, 4);
+        if (idx == 15) {
+            ctx->sample_rate = (u_int32_t) stream_bit_read(&br, 24);
+        } else {
+            ctx->sample_rate = aac_sample_rates[idx];
+        }
+
+        ctx->aac_profile = (u_int32_t) stream_bit_read(&br, 5);
+        if (ctx->aac_profile == 31) {
+            ctx->aac_profile = (u_int32_t) stream_bit_read(&br, 6) + 32;
+        }
+    }
+
+    /* MPEG-4 Audio Specific Config
+
+       5 bits: object type
+       if (object type == 31)
+         6 bits + 32: object type
+       4 bits: frequency index
+       if (frequency index == 15)
+         24 bits: frequency
+       4 bits: channel configuration
+
+       if (object_type == 5)
+           4 bits: frequency index
+           if (frequency index == 15)
+             24 bits: frequency
+           5 bits: object type
+           if (object type == 31)
+             6 bits + 32: object type
+             
+       var bits: AOT Specific Config
+     */
+
+    DEBUG("codec: aac header profile=%u, "
+           "sample_rate=%u, chan_conf=%u\n",
+           ctx->aac_profile, ctx->sample_rate, ctx->aac_chan_conf);
+}
+
+
+/*
+ * onMetaData, the tag is kept as codec meta and the keyframes table
+ * points into it. only the first one is taken, like the headers.
+ */
+static int
+av_codec_parse_meta(Flv2hlsContext *context, u_int8_t *data, int data_len)
+{
+    av_codec_ctx_t                  *ctx = &context->codec;
+    flv_amf_meta_t                  *meta = &context->meta;
+    u_int32_t                       i;
+
+    if (flv_amf_parse_meta(meta, data, data_len) != SUCCESS) {
+        return ERROR_NORMAL;
+    }
+
+    ctx->meta = data;
+    ctx->meta_version++;
+
+    ctx->duration = (u_int32_t) (meta->duration * 1000);
+    ctx->frame_rate = (u_int32_t) meta->framerate;
+    ctx->video_data_rate = (u_int32_t) meta->videodatarate;
+    ctx->audio_data_rate = (u_int32_t) meta->audiodatarate;
+    ctx->video_codec_id = (u_int32_t) meta->videocodecid;
+    ctx->audio_codec_id = (u_int32_t) meta->audiocodecid;
+
+    /* the sps is what the decoder sees */
+    if (ctx->avc_header == NULL) {
+        ctx->width = (u_int32_t) meta->width;
+        ctx->height = (u_int32_t) meta->height;
+    }
+
+    DEBUG("codec: meta duration=%ums, %ux%u, %u fps, %u keyframes\n",
+          ctx->duration, ctx->width, ctx->height, ctx->frame_rate,
+          meta->nkeys);
+
+    for (i = 0; i < context->noutputs; i++) {
+        hls_meta_target(&context->outputs[i], meta);
+    }
+
+    return SUCCESS;
+}
+
+
+static void
+av_codec_parse_avc_header(Flv2hlsContext*context, u_int8_t*data, int data_len)
+{
+    u_int32_t               profile_idc, width, height, crop_left, crop_right,
+                            crop_top, crop_bottom, frame_mbs_only, n, cf_idc,
+                            num_ref_frames;
+    av_codec_ctx_t   *ctx = &context->codec;
+    stream_bit_reader_t   br;
+    u_int8_t                *p = data;
+    printf("enter av_codec_parse_avc_header\n");
+    stream_bit_init_reader(&br, data, data+data_len);
+
+    stream_bit_read(&br, 48);
+
+    ctx->avc_profile = (u_int32_t) stream_bit_read_8(&br);
+    ctx->avc_compat = (u_int32_t) stream_bit_read_8(&br);
+    ctx->avc_level = (u_int32_t) stream_bit_read_8(&br);
+
+    /* nal bytes */
+    ctx->avc_nal_bytes = (u_int32_t) ((stream_bit_read_8(&br) & 0x03) + 1);
+
+    /* nnals */
+    if ((stream_bit_read_8(&br) & 0x1f) == 0) {
+        return;
+    }
+
+    /* nal size */
+    stream_bit_read(&br, 16);
+
+    /* nal type */
+    if (stream_bit_read_8(&br) != 0x67) {
+        return;
+    }
+
+    /* SPS */
+
+    /* profile idc */
+    profile_idc = (u_int32_t) stream_bit_read(&br, 8);
+
+    /* flags */
+    stream_bit_read(&br, 8);
+
+    /* level idc */
+    stream_bit_read(&br, 8);
+
+    /* SPS id */
+    stream_bit_read_golomb(&br);
+
+    if (profile_idc == 100 || profile_idc == 110 ||
+        profile_idc == 122 || profile_idc == 244 || profile_idc == 44 ||
+        profile_idc == 83 || profile_idc == 86 || profile_idc == 118)
+    {
+        /* chroma format idc */
+        cf_idc = (u_int32_t) stream_bit_read_golomb(&br);
+        
+        if (cf_idc == 3) {
+
+            /* separate color plane */
+            stream_bit_read(&br, 1);
+        }
+
+        /* bit depth luma - 8 */
+        stream_bit_read_golomb(&br);
+
+        /* bit depth chroma - 8 */
+        stream_bit_read_golomb(&br);
+
+        /* qpprime y zero transform bypass */
+        stream_bit_read(&br, 1);
+
+        /* seq scaling matrix present */
+        if (stream_bit_read(&br, 1)) {
+
+            for (n = 0; n < (cf_idc != 3 ? 8u : 12u); n++) {
+
+                /* seq scaling list present */
+                if (stream_bit_read(&br, 1)) {
+
+                    /* TODO: scaling_list()
+                    if (n < 6) {
+                    } else {
+                    }
+                    */
+                }
+            }
+        }
+    }
+
+    /* log2 max frame num */
+    stream_bit_read_golomb(&br);
+
+    /* pic order cnt type */
+    switch (stream_bit_read_golomb(&br)) {
+    case 0:
+
+        /* max pic order cnt */
+        stream_bit_read_golomb(&br);
+        break;
+
+    case 1:
+
+        /* delta pic order alwys zero */
+        stream_bit_read(&br, 1);
+
+        /* offset for non-ref pic */
+        stream_bit_read_golomb(&br);
+
+        /* offset for top to bottom field */
+        stream_bit_read_golomb(&br);
+
+        /* num ref frames in pic order */
+        num_ref_frames = (u_int32_t) stream_bit_read_golomb(&br);
+
+        for (n = 0; n < num_ref_frames; n++) {
+
+            /* offset for ref frame */
+            stream_bit_read_golomb(&br);
+        }
+    }
+
+    /* num ref frames */
+    ctx->avc_ref_frames = (u_int32_t) stream_bit_read_golomb(&br);
+
+    /* gaps in frame num allowed */
+    stream_bit_read(&br, 1);
+
+    /* pic width in mbs - 1 */
+    width = (u_int32_t) stream_bit_read_golomb(&br);
+
+    /* pic height in map units - 1 */
+    height = (u_int32_t) stream_bit_read_golomb(&br);
+
+    /* frame mbs only flag */
+    frame_mbs_only = (u_int32_t) stream_bit_read(&br, 1);
+
+    if (!frame_mbs_only) {
+
+        /* mbs adaprive frame field */
+        stream_bit_read(&br, 1);
+    }
+
+    /* direct 8x8 inference flag */
+    stream_bit_read(&br, 1);
+
+    /* frame cropping */
+    if (stream_bit_read(&br, 1)) {
+
+        crop_left = (u_int32_t) stream_bit_read_golomb(&br);
+        crop_right = (u_int32_t) stream_bit_read_golomb(&br);
+        crop_top = (u_int32_t) stream_bit_read_golomb(&br);
+        crop_bottom = (u_int32_t) stream_bit_read_golomb(&br);
+
+    } else {
+
+        crop_left = 0;
+        crop_right = 0;
+        crop_top = 0;
+        crop_bottom = 0;
+    }
+
+    ctx->width = (width + 1) * 16 - (crop_left + crop_right) * 2;
+    ctx->height = (2 - frame_mbs_only) * (height + 1) * 16 -
+                  (crop_top + crop_bottom) * 2;
+
+}
+
+/*
+ * output spec
+ * "dir[,f=ms][,m=ms][,w=n][,t=ts|fmp4][,b][,v][,a][,i][,e][,s][,k=n][,c][,C]",
+ * options not given are the ones of the command line, "a" is audio only,
+ * "i" adds the I-frame playlist, "e" encrypts the segments and "s" the
+ * samples with a key every "k", "c" hashes the segments to the sidecar
+ * and "C" to the m3u8 too.
+ */
+static int
+hls_parse_output(hls_ctx_t *ctx, char *spec)
+{
+    char                            *p, *v;
+
+    p = strchr(spec, ',');
+    if (p) {
+        *p++ = 0;
+    }
+
+    if (*spec) {
+        if (mkdir(spec, FLV_HLS_DIR_ACCESS | S_IXUSR | S_IRGRP | S_IXGRP
+                  | S_IROTH | S_IXOTH) != 0 && errno != EEXIST)
+        {
+            ERROR("error: hls create dir %s failed\n", spec);
+            return ERROR_NORMAL;
+        }
+
+        ctx->stream_len = snprintf(ctx->stream, sizeof(ctx->stream) - 32,
+                                   "%s/", spec);
+    }
+
+    for (spec = p; spec && *spec; spec = p) {
+        p = strchr(spec, ',');
+        if (p) {
+            *p++ = 0;
+        }
+
+        v = strchr(spec, '=');
+        v = v ? v + 1 : (char *) "";
+
+        switch (spec[0]) {
+            case 'f':
+                ctx->fraglen = atoi(v);
+                break;
+            case 'm':
+                ctx->max_fraglen = atoi(v);
+                break;
+            case 'w':
+                ctx->winfrags = atoi(v);
+                break;
+            case 't':
+                ctx->fmp4 = (strcmp(v, "fmp4") == 0);
+                break;
+            case 'b':
+                ctx->single = 1;
+                break;
+            case 'v':
+                ctx->vod = 1;
+                break;
+            case 'a':
+                ctx->audio_only = 1;
+                break;
+            case 'i':
+                ctx->iframes = 1;
+                break;
+            case 'e':
+                ctx->encrypt = 1;
+                break;
+            case 's':
+                ctx->encrypt = 1;
+                ctx->sample_aes = 1;
+                break;
+            case 'k':
+                ctx->frags_per_key = atoi(v);
+                break;
+            case 'c':
+                ctx->crc = 1;
+                break;
+            case 'C':
+                ctx->crc = 2;
+                break;
+            case 'd':
+                ctx->expire = atoi(v);
+                break;
+            case 'D':
+                ctx->durable = atoi(v);
+                break;
+            default:
+                ERROR("error: unknown output option '%s'\n", spec);
+                return ERROR_NORMAL;
+        }
+    }
+
+    if (ctx->winfrags == 0) {
+        ERROR("error: output window must not be empty\n");
+        return ERROR_NORMAL;
+    }
+
+    return SUCCESS;
+}
+
+
+static int
+hls_init_output(hls_ctx_t *ctx, av_codec_ctx_t *codec, const char *name,
+    char *spec)
+{
+    char                            hls_path[1024];
+    const char                      *base;
+
+    ctx->winfrags = g_winfrages;
+    ctx->nfrags = 0;
+    ctx->frag = 0;
+    ctx->fraglen = g_fraglen;
+    ctx->max_fraglen = g_max_fraglen;
+    ctx->bStart = 0;
+    ctx->fmp4 = g_fmp4;
+    ctx->single = g_single;
+    ctx->vod = g_vod;
+    ctx->iframes = g_iframes;
+    ctx->encrypt = g_encrypt || g_sample_aes;
+    ctx->sample_aes = g_sample_aes;
+    ctx->frags_per_key = g_frags_per_key;
+    ctx->crc = g_crc;
+    ctx->expire = g_expire;
+    ctx->durable = g_durable;
+    ctx->sink = g_sink;
+
+    if (spec && hls_parse_output(ctx, spec) != SUCCESS) {
+        return ERROR_NORMAL;
+    }
+
+    if (ctx->durable > HLS_SYNC_MAX) {
+        ctx->durable = HLS_SYNC_MAX;
+    }
+
+    /* the sink takes whole segments, the single file is appended to */
+    if (ctx->single && !flv_hls_sink_local(ctx->sink)) {
+        ERROR("error: the single file is written locally only, ignore -b.\n");
+        ctx->single = 0;
+    }
+
+    /* the cbcs scheme of fmp4 is not done, the segment is encrypted */
+    if (ctx->sample_aes && ctx->fmp4) {
+        ERROR("error: SAMPLE-AES is mpeg2ts only, encrypt the segments.\n");
+        ctx->sample_aes = 0;
+    }
+
+    /* the whole segment is encrypted, nothing addresses a part of it */
+    if (ctx->encrypt && !ctx->sample_aes && (ctx->single || ctx->iframes)) {
+        ERROR("error: encrypted segments have no byte ranges, ignore -b -i.\n");
+        ctx->single = 0;
+        ctx->iframes = 0;
+    }
+
+    /* byte ranges of the IDR packets need mpegts with video */
+    if (ctx->iframes && (ctx->fmp4 || ctx->audio_only)) {
+        ctx->iframes = 0;
+    }
+
+    snprintf(hls_path, sizeof(hls_path), "%.*shls_%s",
+             ctx->stream_len, ctx->stream, name);
+
+    if (hls_init_playlist(ctx, hls_path) != SUCCESS) {
+        ERROR("error: hls_init_playlist failed.\n");
+        return ERROR_NORMAL;
+    }
+
+    ctx->codec = codec;
+    flv_mp4_init(&ctx->mp4);
+
+    /* own PMT with the PCR on audio */
+    if (ctx->audio_only) {
+        flv_mpegts_make_header(ctx->ts_header, FLV_MPEGTS_AUDIO, NULL, 0);
+        ctx->file.header = ctx->ts_header;
+    }
+    ctx->single_name = std::string(hls_path) + "." + hls_segment_ext(ctx);
+    ctx->single_fd = -1;
+    ctx->crc_path = std::string(hls_path) + ".crc32c";
+    ctx->crc_fd = -1;
+    ctx->iframes_playlist = std::string(hls_path) + ".iframes.m3u8";
+    ctx->iframes_playlist_bak = ctx->iframes_playlist + ".bak";
+
+    base = strrchr(hls_path, '/');
+    ctx->key_path = std::string(hls_path) + "-";
+    ctx->key_uri = std::string(g_key_url) + (base ? base + 1 : hls_path) + "-";
+
+    if (ctx->encrypt && ctx->key_uri.size() > HLS_KEY_URI_MAX) {
+        ERROR("error: key uri %s longer than %d\n", ctx->key_uri.c_str(),
+              HLS_KEY_URI_MAX);
+        return ERROR_NORMAL;
+    }
+    
+    if (ctx->frags == NULL) {
+        ctx->frags = (hls_frag_t*) new hls_frag_t [ctx->winfrags*2+1];   
+        memset(ctx->frags, 0, sizeof(hls_frag_t)*(ctx->winfrags*2+1));
+    }
+
+    if (ctx->targets == NULL) {
+        ctx->targets = new hls_target_t[ctx->winfrags + 1];
+    }
+
+    return SUCCESS;
+}
+
+
+/* the buffers of an output, the files are closed by then */
+static void
+hls_free_output(hls_ctx_t *ctx)
+{
+    delete [] ctx->frags;
+    delete [] ctx->targets;
+    delete [] ctx->expired;
+    delete [] ctx->saes;
+    delete [] ctx->rbsp;
+    delete ctx->aframe;
+
+    free(ctx->keys);
+    free(ctx->entries.data);
+    free(ctx->iframe_entries.data);
+}
+
+
+Flv2hlsContext* init_context(char*flv_meta_path)
+{
+    Flv2hlsContext* context = new Flv2hlsContext();
+    static char audio[] = "audio,a";
+    hls_checkpoint_t *cp;
+    const char *name;
+    u_int32_t i;
+
+    name = strcmp(flv_meta_path, "-") == 0 ? "stdin" : flv_meta_path;
+
+    if (context->flvreader.open(flv_meta_path) != SUCCESS) {
+        flv_freep(context);
+        return NULL;
+    }
+    
+    if (context->flvdec.initialize(&context->flvreader) != SUCCESS) {
+        flv_freep(context);
+        return NULL;
+    }
+
+    /* without -o the one output is in the working directory */
+    if (g_noutputs == 0) {
+        g_outputs[g_noutputs++] = NULL;
+    }
 
-    DEBUG("hls: flush audio frame pts=%u\n", frame.pts);
+    if (g_audio) {
+        g_outputs[g_noutputs++] = audio;
+    }
 
-    rc = flv_mpegts_write_frame(&ctx->file, &frame, b);
+    context->noutputs = g_noutputs;
+    context->outputs = new hls_ctx_t[context->noutputs]();
 
-    if (rc != SUCCESS) {
-        ERROR("error: hls_flush_audio call flv_mpegts_write_frame failed");
+    for (i = 0; i < context->noutputs; i++) {
+        if (hls_init_output(&context->outputs[i], &context->codec, name,
+                            g_outputs[i]) != SUCCESS)
+        {
+            return NULL;
+        }
     }
 
-    ctx->audio_cc = frame.cc;
-    b->pos = b->last = b->start;
+    /* the renditions are listed in a master playlist */
+    if (context->noutputs > 1) {
+        context->master = new hls_master_t;
+        context->master->path = std::string("hls_") + name + ".master.m3u8";
+        context->master->path_bak = context->master->path + ".bak";
+        context->master->sink = g_sink;
+        context->master->outputs = context->outputs;
+        context->master->noutputs = context->noutputs;
+        pthread_mutex_init(&context->master->lock, NULL);
 
-    return rc;
+        for (i = 0; i < context->noutputs; i++) {
+            context->outputs[i].master = context->master;
+        }
+    }
+
+    /* the tag that opens a fragment is of one output only */
+    if ((g_checkpoint || g_incremental) && context->noutputs > 1) {
+        ERROR("error: a checkpoint is of one output, ignore -R -I.\n");
+
+    } else if (g_checkpoint || g_incremental) {
+        cp = new hls_checkpoint_t();
+        cp->codec = &context->codec;
+
+        if (!context->flvreader.is_stream()) {
+            cp->input = flv_meta_path;
+        }
+
+        /* the state of the output next to its playlist */
+        if (g_checkpoint) {
+            cp->path = g_checkpoint;
+        } else {
+            cp->path = context->outputs[0].playlist;
+            cp->path.replace(cp->path.size() - 5, 5, ".state");
+        }
+
+        cp->path_bak = cp->path + HLS_TMP_EXT;
+
+        if (g_incremental && cp->input.empty()) {
+            ERROR("error: a stream is not converted incrementally, "
+                  "ignore -I.\n");
+
+        } else if (g_incremental) {
+            cp->incremental = 1;
+            cp->aframe = new u_char[MAX_FRAME_SIZE];
+        }
+
+        context->checkpoint = cp;
+        context->outputs[0].checkpoint = cp;
+    }
+
+    return context;    
 }
-
-
-static int
-hls_open_fragment(hls_ctx_t*ctx, u_int64_t ts,
-    int discont)
-{
-    u_int64_t                  id;
-    int                            fd;
-    u_int32_t                  g;
-    hls_frag_t                 *f;
-
-
-    id = flv_hls_get_fragment_id(ctx);
-    DEBUG("hls_open_fragment, id:%d\n", id);
-    sprintf(ctx->stream + ctx->stream_len, "%u.ts", id);
-
-    if (flv_mpegts_open_file(&ctx->file, ctx->stream)!= SUCCESS)
-    {
-        printf("hls_open_fragment:open file failed\n");
-        return ERROR_NORMAL;
-    }
-
-    ctx->opened = 1;
-
-    f = hls_get_frag(ctx, ctx->nfrags);
-
-    memset(f, 0, sizeof(*f));
-
-    f->active = 1;
-    f->discont = discont;
-    f->id = id;
-
-    ctx->frag_ts = ts;
-
-    /* start fragment with audio to make iPhone happy */
-
-    hls_flush_audio(ctx);
-
-    return SUCCESS;
-}
-
-
-
-
-static void
-hls_update_fragment(hls_ctx_t  *ctx, u_int64_t ts, int boundary, u_int32_t flush_rate)
-{
-    hls_frag_t        *f;
-    int                  ts_frag_len;
-    int                   same_frag, force,discont;
-    str_buf_t       *b;
-    int64_t                     d;
-
-    f = NULL;
-    force = 0;
-    discont = 0;
-    DEBUG("hls_update_fragment, boundary:%d, ts:%lld, frag_ts:%lld, max_fraglen:%u\n", 
-        boundary, ts, ctx->frag_ts, ctx->max_fraglen);
-    if (ctx->opened) {
-        f = hls_get_frag(ctx, ctx->nfrags);
-        d = (int64_t) (ts - ctx->frag_ts);
-
-        if (d > (int64_t) ctx->max_fraglen * 90 || d < -90000) {
-            DEBUG("**************force fragment split: %.3f sec, \n", d / 90000.);
-            force = 1;
-            if( !boundary )
-            {
-                DEBUG("not key frame, so not split\n");
-                f->duration = (ts - ctx->frag_ts) / 90000.;
-                discont = 0;
-                force = 0;
-            }
-        } else {
-            f->duration = (ts - ctx->frag_ts) / 90000.;
-            discont = 0;
-        }
-        DEBUG("duration:%d\n", f->duration);
-    }
-    
-    if (f && f->duration < ctx->fraglen / 1000.) {
-        boundary = 0;
-    }
-  
-    if (boundary || force) {
-
-        hls_close_fragment(ctx, ts);
-        
-        hls_open_fragment(ctx, ts, discont);
-    }
-
-    b = ctx->aframe;
-    if (ctx->opened && b && b->last > b->pos &&
-        ctx->aframe_pts + (u_int64_t) ctx->max_audio_delay * 90 / flush_rate
-        < ts)
-    {
-        hls_flush_audio(ctx);
-    }
-}
-
-static int
-hls_parse_aac_header(av_codec_ctx_t   *codec_ctx, u_int32_t *objtype,
-    u_int32_t *srindex, u_int32_t *chconf)
-{
-    u_int8_t            *cl;
-    u_char             p[2];
-    u_char              b0, b1;
-    DEBUG("enter hls_parse_aac_header\n");
-    cl = codec_ctx->aac_header;
-
-    if (flv_hls_copy(p, &cl, 2) != SUCCESS) {
-        return ERROR_NORMAL;
+
+
+/* the rendition has video, its keyframes count from now on */
+static void
+hls_align_video(hls_align_t *align, u_int32_t id)
+{
+    pthread_mutex_lock(&align->lock);
+    align->inputs[id].video = 1;
+    pthread_mutex_unlock(&align->lock);
+}
+
+
+/*
+ * publish the keyframe of the rendition, wait until every other one
+ * has passed it and tell whether all of them have it. the renditions
+ * that ended, have no video or no keyframe yet do not hold the others,
+ * the ones with video and no keyframe yet share none.
+ */
+static int
+hls_align_key(hls_align_t *align, u_int32_t id, u_int32_t ts)
+{
+    hls_align_input_t               *in;
+    u_int32_t                       i, k, n, d;
+    int                             shared;
+
+    pthread_mutex_lock(&align->lock);
+
+    in = &align->inputs[id];
+    in->keys[in->nkeys++ % HLS_ALIGN_KEYS] = ts;
+    in->video = 1;
+
+    pthread_cond_broadcast(&align->cond);
+
+    for ( ;; ) {
+        for (i = 0; i < align->ninputs; i++) {
+            in = &align->inputs[i];
+
+            if (!in->done && in->video && in->nkeys
+                && in->keys[(in->nkeys - 1) % HLS_ALIGN_KEYS] + HLS_ALIGN_SLACK
+                   < ts)
+            {
+                break;
+            }
+        }
+
+        if (i == align->ninputs) {
+            break;
+        }
+
+        pthread_cond_wait(&align->cond, &align->lock);
+    }
+
+    shared = 1;
+
+    for (i = 0; i < align->ninputs && shared; i++) {
+        in = &align->inputs[i];
+
+        if (in->done || !in->video) {
+            continue;
+        }
+
+        n = in->nkeys < HLS_ALIGN_KEYS ? in->nkeys : HLS_ALIGN_KEYS;
+
+        shared = 0;
+        for (k = 0; k < n; k++) {
+            d = in->keys[k] > ts ? in->keys[k] - ts : ts - in->keys[k];
+
+            if (d <= HLS_ALIGN_SLACK) {
+                shared = 1;
+                break;
+            }
+        }
     }
 
-    if (flv_hls_copy(&b0, &cl, 1) != SUCCESS) {
-        return ERROR_NORMAL;
+    pthread_mutex_unlock(&align->lock);
+
+    return shared;
+}
+
+
+static void
+hls_align_done(hls_align_t *align, u_int32_t id)
+{
+    pthread_mutex_lock(&align->lock);
+    align->inputs[id].done = 1;
+    pthread_cond_broadcast(&align->cond);
+    pthread_mutex_unlock(&align->lock);
+}
+
+
+/*
+ * give the frame to every output, mpegts ones share the AnnexB
+ * and ADTS made once here.
+ */
+static void
+hls_fanout(Flv2hlsContext *context, hls_frame_t *frame)
+{
+    u_int32_t                       i;
+    int                             video, mpegts;
+    hls_ctx_t                       *ctx;
+
+    video = (frame->type == NGX_RTMP_MSG_VIDEO);
+
+    mpegts = 0;
+    for (i = 0; i < context->noutputs; i++) {
+        ctx = &context->outputs[i];
+        mpegts |= !ctx->fmp4 && !(video && ctx->audio_only);
+        frame->slices_on |= ctx->sample_aes;
     }
 
-    if (flv_hls_copy(&b1, &cl, 1) != SUCCESS) {
-        return ERROR_NORMAL;
+    hls_frame_prepare(frame, &context->codec, mpegts);
+
+    if (context->align && frame->pict && frame->key) {
+        frame->boundary = hls_align_key(context->align, context->rendition,
+                                        frame->timestamp);
     }
 
-    *objtype = b0 >> 3;
-    if (*objtype == 0 || *objtype == 0x1f) {
-        ERROR( "error: hls_parse_aac_header unsupported adts object type:%u\n", *objtype);
-        return ERROR_NORMAL;
+    for (i = 0; i < context->noutputs; i++) {
+        ctx = &context->outputs[i];
+
+        if (!video) {
+            hls_audio(ctx, frame);
+        } else if (!ctx->audio_only) {
+            hls_video(ctx, frame);
+        }
     }
+}
 
-    if (*objtype > 4) {
 
-        /*
-         * Mark all extended profiles as LC
-         * to make Android as happy as possible.
-         */
+static void
+hls_finish_outputs(Flv2hlsContext *context)
+{
+    u_int32_t                       i;
 
-        *objtype = 2;
+    for (i = 0; i < context->noutputs; i++) {
+        hls_finish(&context->outputs[i]);
     }
 
-    *srindex = ((b0 << 1) & 0x0f) | ((b1 & 0x80) >> 7);
-    if (*srindex == 0x0f) {
-        ERROR( "error: hls_parse_aac_header unsupported adts sample rate:%u\n", *srindex);
-        return ERROR_NORMAL;
+    if (context->master) {
+        pthread_mutex_lock(&context->master->lock);
+        hls_write_master(context->master);
+        pthread_mutex_unlock(&context->master->lock);
     }
+}
 
-    *chconf = (b1 >> 3) & 0x0f;
 
-    DEBUG( "hls: aac object_type:%u, sample_rate_index:%u, "
-                   "channel_config:%u\n", *objtype, *srindex, *chconf);
-
-    return SUCCESS;
-}
-
-static int
-hls_audio(Flv2hlsContext*context, u_int8_t*data, int data_len, u_int32_t timestamp)
-{
-    hls_ctx_t                   *ctx;
-    av_codec_ctx_t           *codec;
-    u_int64_t                        pts, est_pts;
-    int64_t                         dpts;
-    size_t                          bsize;
-    str_buf_t                      *b;
-    u_int8_t                      *p;
-    u_int32_t                   objtype, srindex, chconf, size;
-
-    codec = &context->codec;
-    ctx = &context->hls_ctx;
-    int idx = 0;
-    DEBUG("enter hls_audio,ts:%u\n", timestamp);
-    b = ctx->aframe;
-    if (b == NULL) {
-        b = new str_buf_t;
-        
-        b->end = b->buf + MAX_FRAME_SIZE;
-        b->last = b->pos = b->start = b->buf;
-        ctx->aframe = b;
-    }
-    
- 
-    size = data_len - 2 + 7;
-    pts = (u_int64_t) timestamp * 90;
-
-    if (b->start + size > b->end) {
-        ERROR("error: hls_audio too big audio frame\n");
-        return SUCCESS;
-    }
-    /*
-     * start new fragment here if
-     * there's no video at all, otherwise
-     * do it in video handler
-     */
-
-    hls_update_fragment(ctx, pts, codec->avc_header == NULL, 2);
-
-    if (b->last + size > b->end) {
-        hls_flush_audio(ctx);
-    }
-
-    
-
-    if (b->last + 7 > b->end) {
-        ERROR( "error: hls_audio not enough buffer for audio header\n");
-        return SUCCESS;
-    }
-
-    p = b->last;
-    b->last += 5;
-
-    /* copy payload */
-    memcpy(b->last, data, data_len);
-    b->last += data_len;
-    
-    /* make up ADTS header */
-
-    if (hls_parse_aac_header(&context->codec, &objtype, &srindex, &chconf)
-        != SUCCESS)
-    {
-        ERROR( "error: hls_audio aac header error\n");
-        return SUCCESS;
-    }
-
-    /* we have 5 free bytes + 2 bytes of RTMP frame header */
-
-    p[0] = 0xff;
-    p[1] = 0xf1;
-    p[2] = (u_char) (((objtype - 1) << 6) | (srindex << 2) |
-                     ((chconf & 0x04) >> 2));
-    p[3] = (u_char) (((chconf & 0x03) << 6) | ((size >> 11) & 0x03));
-    p[4] = (u_char) (size >> 3);
-    p[5] = (u_char) ((size << 5) | 0x1f);
-    p[6] = 0xfc;
-
-    if (p != b->start) {
-        ctx->aframe_num++;
-        DEBUG("hls_audio, aframe_num:%d\n", ctx->aframe_num);
-        return SUCCESS;
-    }
-
-    ctx->aframe_pts = pts;
-
-    if (!ctx->sync || context->codec.sample_rate == 0) {
-        return SUCCESS;
-    }
-
-    /* align audio frames */
-
-    /* TODO: We assume here AAC frame size is 1024
-     *       Need to handle AAC frames with frame size of 960 */
-
-    est_pts = ctx->aframe_base + ctx->aframe_num * 90000 * 1024 /
-                                 context->codec.sample_rate;
-    dpts = (int64_t) (est_pts - pts);
-
-    DEBUG("hls: audio sync dpts=%L (%.5fs)\n",
-                   dpts, dpts / 90000.);
-
-    if (dpts <= (int64_t) ctx->sync * 90 &&
-        dpts >= (int64_t) ctx->sync * -90)
-    {
-        ctx->aframe_num++;
-        ctx->aframe_pts = est_pts;
-        return SUCCESS;
-    }
-
-    ctx->aframe_base = pts;
-    ctx->aframe_num  = 1;
-
-    DEBUG("hls: audio sync gap dpts=%L (%.5fs)\n",
-                   dpts, dpts / 90000.);
-
-    return SUCCESS;
-}
-
-
-
-int hls_video(Flv2hlsContext*context, u_int8_t*data, int data_len, u_int32_t timestamp)
-{
-    av_codec_ctx_t                  *codec_ctx;
-    hls_ctx_t                       *ctx;
-    u_int8_t                        fmt, ftype, htype, nal_type, src_nal_type;
-    u_int32_t                       len, rlen;
-    u_int32_t                        cts;
-    flv_mpegts_frame_t         frame;
-    u_int32_t                        nal_bytes;
-    u_int32_t                       aud_sent, sps_pps_sent, boundary;
-    u_int8_t                        buffer[FLV_HLS_BUFSIZE];
-    u_int8_t                        dummy[FLV_HLS_BUFSIZE];
-    u_int8_t                        *in = data;
-    int                                idx = 0;
-    str_buf_t                        out;
-    codec_ctx = &context->codec;
-    ctx = &context->hls_ctx;
-    DEBUG("enter hls_video, ts:%u\n", timestamp);
-    if (flv_hls_copy(&fmt, &in, 1) != SUCCESS) {
-        return -1;
-    }
-
-    if ( (fmt&0xf) != 7 )
-    {
-        ERROR("error: not a h264 frame:%02x, %x\n", fmt, fmt&0xf);
-        return -1;
-    }
-  /* 1: keyframe (IDR)
-     * 2: inter frame
-     * 3: disposable inter frame */
-
-    ftype = (fmt & 0xf0) >> 4;
-
-    /* H264 HDR/PICT */
-
-    if (flv_hls_copy(&htype, &in, 1) != SUCCESS) {
-        ERROR("error: read htype failed\n");
-        return -1;
-    }
-
-    /* proceed only with PICT */
-    /* 0: sequence header
-            1: nalu
-            2: end of sequence
-        */
-    DEBUG("htype:%x, ftype:%x\n", htype, ftype);
-    if (htype != 1) {        
-        return SUCCESS;
-    }
-
-    /* 3 bytes: cts */
-
-    if (flv_hls_copy(&cts, &in, 3) != SUCCESS) {
-        ERROR("error: read cts failed\n");
-        return -1;
-    }
-
-    cts = ((cts & 0x00FF0000) >> 16) | ((cts & 0x000000FF) << 16) |
-          (cts & 0x0000FF00);
-    
-    memset(&out, 0, sizeof(out));
-    out.start = buffer;
-    out.end = buffer + sizeof(buffer);
-    out.last = out.pos = out.start;
-
-    nal_bytes = codec_ctx->avc_nal_bytes;
-    aud_sent = 0;
-    sps_pps_sent = 0;
-    DEBUG("cts:%04x, data_len:%d, in-data:%d,nal_bytes:%d\n", 
-        cts, data_len, in-data, nal_bytes);
-
-    while (in-data < data_len) {
-        if (flv_hls_copy(&rlen, &in, nal_bytes) != SUCCESS) {
-            ERROR("read rlen failed\n");
-            return SUCCESS;
-        }
-
-        len = 0;
-        flv_rmemcpy(&len, &rlen, nal_bytes);
-
-        if (len == 0) {
-            continue;
-        }
-
-        if (flv_hls_copy(&src_nal_type, &in, 1) != SUCCESS) {
-            ERROR("read src_nal_type failed\n");
-            return SUCCESS;
-        }
-
-        nal_type = src_nal_type & 0x1f;
-
-        if (nal_type >= 7 && nal_type <= 9) {
-            if (flv_hls_copy(dummy, &in, len - 1) != SUCCESS) {
-                ERROR("read dummy failed\n");
-                return SUCCESS;
-            }
-            continue;
-        }
-        DEBUG("len:%d,nal_type:%d,aud_sent:%d, buf size:%d\n",
-            len,nal_type, aud_sent, out.end-out.last);
-        if (!aud_sent) {        
-            switch (nal_type) {
-                case 1:
-                case 5:
-                case 6:
-                    if (hls_append_aud(&out) != SUCCESS) {
-                        ERROR("error: fail to append AUD NAL");
-                    }
-                    DEBUG("add %d bytes for aud\n", out.last-out.start);
-                case 9:
-                    aud_sent = 1;
-                    break;
-            }
-        }
-       
-        switch (nal_type) {
-            case 1:
-                sps_pps_sent = 0;
-                break;
-            case 5:
-                if (sps_pps_sent) {
-                    break;
-                }
-                if (hls_append_sps_pps(codec_ctx, &out) != SUCCESS) {
-                    ERROR("error: fail to append SPS/PPS NALs");
-                }
-                sps_pps_sent = 1;
-                break;
-        }
-
-        /* AnnexB prefix */
-
-        if (out.end - out.last < 5) {
-            ERROR("error: not enough buffer for AnnexB prefix");
-            return SUCCESS;
-        }
-
-        /* first AnnexB prefix is long (4 bytes) */
-
-        if (out.last == out.pos) {
-            *out.last++ = 0;
-        }
-
-        *out.last++ = 0;
-        *out.last++ = 0;
-        *out.last++ = 1;
-        *out.last++ = src_nal_type;
-
-        /* NAL body */
-
-        if (out.end - out.last < (int) len) {
-            ERROR( "error: not enough buffer for NAL");
-            return SUCCESS;
-        }
-
-
-        if (flv_hls_copy(out.last, &in, len - 1) != SUCCESS) {
-            ERROR( "error: read out last failed");
-            return SUCCESS;
-        }
-
-        out.last += (len - 1);
-
-    }
-
-    memset(&frame, 0, sizeof(frame));
-
-    frame.cc = ctx->video_cc;
-    frame.dts = (u_int64_t) timestamp * 90;
-    frame.pts = frame.dts + cts * 90;
-    frame.pid = 0x100;
-    frame.sid = 0xe0;
-    frame.key = (ftype == 1);
-    DEBUG("####have key frame:%d\n", frame.key);
-
-    /*
-     * start new fragment if
-     * - we have video key frame AND
-     * - we have audio buffered or have no audio at all or stream is closed
-     */
-/*
-    b = ctx->aframe;
-    boundary = frame.key && (codec_ctx->aac_header == NULL || !ctx->opened ||
-                             (b && b->last > b->pos));
-*/
-    boundary = frame.key;
-
-    hls_update_fragment(ctx, frame.dts, boundary, 1);
-
-    if (!ctx->opened) {
-        DEBUG("ctx not opened\n");
-        return SUCCESS;
-    }
-
-    DEBUG("hls_video pts=%u, dts=%u\n", frame.pts, frame.dts);
-
-    if (flv_mpegts_write_frame(&ctx->file, &frame, &out) != SUCCESS) {
-        ERROR("error: flv_mpegts_write_frame video frame failed");
-    }
-
-    ctx->video_cc = frame.cc;
-
-    return SUCCESS;
-}
-
-
-static void
-av_codec_parse_aac_header(Flv2hlsContext*context, u_int8_t*data, int data_len)
-{
-    u_int32_t               idx;
-    av_codec_ctx_t          *ctx = &context->codec;
-    stream_bit_reader_t     br;
-    DEBUG("enter av_codec_parse_aac_header\n");
-    static u_int32_t    aac_sample_rates[] =
-        { 96000, 88200, 64000, 48000,
-          44100, 32000, 24000, 22050,
-          16000, 12000, 11025,  8000,
-           7350,     0,     0,     0 };
-
-    stream_bit_init_reader(&br, data, data+data_len);
-
-    stream_bit_read(&br, 16);
-
-    ctx->aac_profile = (u_int32_t) stream_bit_read(&br, 5);
-    if (ctx->aac_profile == 31) {
-        ctx->aac_profile = (u_int32_t) stream_bit_read(&br, 6) + 32;
-    }
-
-    idx = (u_int32_t) stream_bit_read(&br, 4);
-    if (idx == 15) {
-        ctx->sample_rate = (u_int32_t) stream_bit_read(&br, 24);
-    } else {
-        ctx->sample_rate = aac_sample_rates[idx];
-    }
-
-    ctx->aac_chan_conf = (u_int32_t) stream_bit_read(&br, 4);
-
-    if (ctx->aac_profile == 5 || ctx->aac_profile == 29) {
-        
-        if (ctx->aac_profile == 29) {
-            ctx->aac_ps = 1;
-        }
-
-        ctx->aac_sbr = 1;
-
-        idx = (u_int32_t) stream_bit_read(&br, 4);
-        if (idx == 15) {
-            ctx->sample_rate = (u_int32_t) stream_bit_read(&br, 24);
-        } else {
-            ctx->sample_rate = aac_sample_rates[idx];
-        }
-
-        ctx->aac_profile = (u_int32_t) stream_bit_read(&br, 5);
-        if (ctx->aac_profile == 31) {
-            ctx->aac_profile = (u_int32_t) stream_bit_read(&br, 6) + 32;
-        }
-    }
-
-    /* MPEG-4 Audio Specific Config
-
-       5 bits: object type
-       if (object type == 31)
-         6 bits + 32: object type
-       4 bits: frequency index
-       if (frequency index == 15)
-         24 bits: frequency
-       4 bits: channel configuration
-
-       if (object_type == 5)
-           4 bits: frequency index
-           if (frequency index == 15)
-             24 bits: frequency
-           5 bits: object type
-           if (object type == 31)
-             6 bits + 32: object type
-             
-       var bits: AOT Specific Config
-     */
-
-    DEBUG("codec: aac header profile=%u, "
-           "sample_rate=%u, chan_conf=%u\n",
-           ctx->aac_profile, ctx->sample_rate, ctx->aac_chan_conf);
-}
-
-
-static void
-av_codec_parse_avc_header(Flv2hlsContext*context, u_int8_t*data, int data_len)
-{
-    u_int32_t               profile_idc, width, height, crop_left, crop_right,
-                            crop_top, crop_bottom, frame_mbs_only, n, cf_idc,
-                            num_ref_frames;
-    av_codec_ctx_t   *ctx = &context->codec;
-    stream_bit_reader_t   br;
-    u_int8_t                *p = data;
-    printf("enter av_codec_parse_avc_header\n");
-    stream_bit_init_reader(&br, data, data+data_len);
-
-    stream_bit_read(&br, 48);
-
-    ctx->avc_profile = (u_int32_t) stream_bit_read_8(&br);
-    ctx->avc_compat = (u_int32_t) stream_bit_read_8(&br);
-    ctx->avc_level = (u_int32_t) stream_bit_read_8(&br);
-
-    /* nal bytes */
-    ctx->avc_nal_bytes = (u_int32_t) ((stream_bit_read_8(&br) & 0x03) + 1);
-
-    /* nnals */
-    if ((stream_bit_read_8(&br) & 0x1f) == 0) {
-        return;
-    }
-
-    /* nal size */
-    stream_bit_read(&br, 16);
-
-    /* nal type */
-    if (stream_bit_read_8(&br) != 0x67) {
-        return;
-    }
-
-    /* SPS */
-
-    /* profile idc */
-    profile_idc = (u_int32_t) stream_bit_read(&br, 8);
-
-    /* flags */
-    stream_bit_read(&br, 8);
-
-    /* level idc */
-    stream_bit_read(&br, 8);
-
-    /* SPS id */
-    stream_bit_read_golomb(&br);
-
-    if (profile_idc == 100 || profile_idc == 110 ||
-        profile_idc == 122 || profile_idc == 244 || profile_idc == 44 ||
-        profile_idc == 83 || profile_idc == 86 || profile_idc == 118)
-    {
-        /* chroma format idc */
-        cf_idc = (u_int32_t) stream_bit_read_golomb(&br);
-        
-        if (cf_idc == 3) {
-
-            /* separate color plane */
-            stream_bit_read(&br, 1);
-        }
-
-        /* bit depth luma - 8 */
-        stream_bit_read_golomb(&br);
-
-        /* bit depth chroma - 8 */
-        stream_bit_read_golomb(&br);
-
-        /* qpprime y zero transform bypass */
-        stream_bit_read(&br, 1);
-
-        /* seq scaling matrix present */
-        if (stream_bit_read(&br, 1)) {
-
-            for (n = 0; n < (cf_idc != 3 ? 8u : 12u); n++) {
-
-                /* seq scaling list present */
-                if (stream_bit_read(&br, 1)) {
-
-                    /* TODO: scaling_list()
-                    if (n < 6) {
-                    } else {
-                    }
-                    */
-                }
-            }
-        }
-    }
-
-    /* log2 max frame num */
-    stream_bit_read_golomb(&br);
-
-    /* pic order cnt type */
-    switch (stream_bit_read_golomb(&br)) {
-    case 0:
-
-        /* max pic order cnt */
-        stream_bit_read_golomb(&br);
-        break;
-
-    case 1:
-
-        /* delta pic order alwys zero */
-        stream_bit_read(&br, 1);
-
-        /* offset for non-ref pic */
-        stream_bit_read_golomb(&br);
-
-        /* offset for top to bottom field */
-        stream_bit_read_golomb(&br);
-
-        /* num ref frames in pic order */
-        num_ref_frames = (u_int32_t) stream_bit_read_golomb(&br);
-
-        for (n = 0; n < num_ref_frames; n++) {
-
-            /* offset for ref frame */
-            stream_bit_read_golomb(&br);
-        }
-    }
-
-    /* num ref frames */
-    ctx->avc_ref_frames = (u_int32_t) stream_bit_read_golomb(&br);
-
-    /* gaps in frame num allowed */
-    stream_bit_read(&br, 1);
-
-    /* pic width in mbs - 1 */
-    width = (u_int32_t) stream_bit_read_golomb(&br);
-
-    /* pic height in map units - 1 */
-    height = (u_int32_t) stream_bit_read_golomb(&br);
-
-    /* frame mbs only flag */
-    frame_mbs_only = (u_int32_t) stream_bit_read(&br, 1);
-
-    if (!frame_mbs_only) {
-
-        /* mbs adaprive frame field */
-        stream_bit_read(&br, 1);
-    }
-
-    /* direct 8x8 inference flag */
-    stream_bit_read(&br, 1);
-
-    /* frame cropping */
-    if (stream_bit_read(&br, 1)) {
-
-        crop_left = (u_int32_t) stream_bit_read_golomb(&br);
-        crop_right = (u_int32_t) stream_bit_read_golomb(&br);
-        crop_top = (u_int32_t) stream_bit_read_golomb(&br);
-        crop_bottom = (u_int32_t) stream_bit_read_golomb(&br);
-
-    } else {
-
-        crop_left = 0;
-        crop_right = 0;
-        crop_top = 0;
-        crop_bottom = 0;
-    }
-
-    ctx->width = (width + 1) * 16 - (crop_left + crop_right) * 2;
-    ctx->height = (2 - frame_mbs_only) * (height + 1) * 16 -
-                  (crop_top + crop_bottom) * 2;
-
-}
-
-Flv2hlsContext* init_context(char*flv_meta_path)
-{
-    Flv2hlsContext* context = new Flv2hlsContext();
-    hls_ctx_t   *ctx;
-    char hls_path[1024] = {0};
-    snprintf(hls_path, 1024,  "hls_%s", flv_meta_path);
-    if (context->flvreader.open(flv_meta_path) != SUCCESS) {
-        flv_freep(context);
-        return NULL;
-    }
-    
-    if (context->flvdec.initialize(&context->flvreader) != SUCCESS) {
-        flv_freep(context);
-        return NULL;
-    }
-
-    if (hls_init_playlist(&context->hls_ctx, hls_path) != SUCCESS) {
-        ERROR("error: hls_init_playlist failed.\n");
-        return NULL;
-    }
-
-    ctx = &context->hls_ctx;
-    ctx->winfrags = g_winfrages;
-    ctx->nfrags = 0;
-    ctx->frag = 0;
-    ctx->fraglen = g_fraglen;
-    ctx->max_fraglen = g_max_fraglen;
-    ctx->bStart = 0;
-    
-    if (ctx->frags == NULL) {
-        ctx->frags = (hls_frag_t*) new hls_frag_t [ctx->winfrags*2+1];   
-        memset(ctx->frags, 0, sizeof(hls_frag_t)*(ctx->winfrags*2+1));
-    }
-    return context;    
-}
-
-int main(int argc, char*argv[])
-{
-    char header[9];
-    u_int32_t g_pos4firstpkt = 0;
-    int ret = SUCCESS;
-    u_int32_t vstartime = 0;
-    char *source = "test";
-    int c;
-
-    while ((c = getopt(argc, argv, "w:f:m:s:")) != -1) {
-        switch (c) {
-            case 'c':
-                g_winfrages = atoi(optarg);
-                printf("g_winfrages:%d\n", g_winfrages);
-                break;
-            case 'f':
-                g_fraglen = atoi(optarg);
-                printf("g_fraglen:%d\n", g_fraglen);
-                break;
-            case 'm':
-                g_max_fraglen = atoi(optarg);
-                printf("g_max_fraglen:%d\n", g_max_fraglen);
-                break;
-            case 's':
-                source = optarg;
-                break;
-            default:
-                exit(0);
-        }
-    }
-
-    time_t startid = time(NULL);
-
-    Flv2hlsContext* g_con = init_context(source);  
-    if( !g_con )
-    {
-        ERROR("error: fail to open test.flv\n");
-        return 0;
-    }
-
-    if (flv_read_header(g_con, &header, &g_pos4firstpkt) != SUCCESS) {
-        ERROR("error: read flv header failed.\n");
-        return 0;
-    }
-
-    DEBUG("startid:%d\n", startid);
-    startid = startid - 10;
-    while(true){
-        char type;
-        u_int32_t timestamp=0;
-        u_int32_t size = 0;
-        
-        
-        if ((ret = flv_read_tag_header(g_con, &type, &size, &timestamp)) != SUCCESS) {        
-            ERROR("error: flv_read_tag_header failed \n"); 
-            return 0;
-            /*
-                    if( g_con->hls_ctx.nfrags > 0 )
-                    {
-                        //hls_close_fragment(&g_con->hls_ctx);
-                    }
-                    */
-            char tmpname[35] = {0};
-            sprintf(tmpname, "test-%d.flv", startid);
-            std::string clippath = tmpname;
-            g_con->flvreader.close();
-            if (g_con->flvreader.open(clippath) != SUCCESS) {
-               DEBUG("open clip:%s failed, try 1s later\n", clippath.c_str());
-               sleep(1);
-               continue;
-            }
-
-            if (g_con->flvdec.initialize(&g_con->flvreader) != SUCCESS) {
-                ERROR("init new clip failed\n");
-                return 0;
-            }
-            DEBUG("using new clip:%s\n", clippath.c_str());
-            startid++;
-            if ((ret = flv_read_tag_header(g_con, &type, &size, &timestamp)) != SUCCESS) {        
-                ERROR("real error: flv_read_tag_header failed \n"); 
-                return 0;
-            }
-        }
-        if( vstartime == 0 )
-        {
-            vstartime = timestamp;
-        }
-        char* data = new char[size];
-        DEBUG("flv frametype:%d, timestamp:%u\n", type, timestamp);
-        if ((ret = flv_read_tag_data(g_con, &data, size, type)) != SUCCESS) {
-            ERROR("error: flv_read_tag_data failed\n");
-            delete data;
-            return 0;
-        }
-        if( type == NGX_RTMP_MSG_VIDEO )
-        {
-            if( !g_con->codec.avc_header )
-            {
-                g_con->codec.avc_header = new unsigned char[size];
-                memcpy(g_con->codec.avc_header, data, size);
-                av_codec_parse_avc_header(g_con, (u_int8_t*)data, size);
-            }else
-            {
-                /*
-                        if ( g_con->hls_ctx.bStart == 0)
-                        {
-                            vstartime = timestamp;
-                        }
-                        */
-                hls_video(g_con, (u_int8_t*)data, size, timestamp - vstartime);
-            }
-        }
-        else if( type == NGX_RTMP_MSG_AUDIO )
-        {
-            if( !g_con->codec.aac_header )
-            {
-                g_con->codec.aac_header = new unsigned char[size];
-                memcpy(g_con->codec.aac_header, data, size);
-                av_codec_parse_aac_header(g_con, (u_int8_t*)data, size);
-            }else
-            {
-                hls_audio(g_con, (u_char*)data, size, timestamp - vstartime);
-            }
-
-        }
-    }
-    
-    flv_close(g_con);
-    ERROR(" job finished\n"); 
-    return 0;
-}
+/*
+ * serve the playlist and the recent segments from memory,
+ * listen is "port" or "addr:port".
+ */
+static int
+hls_start_http(Flv2hlsContext *context, char *listen)
+{
+    char                            addr[64];
+    const char                      *name, *colon;
+    int                             port;
+    hls_ctx_t                       *ctx;
+
+    ctx = &context->outputs[0];
+
+    colon = strrchr(listen, ':');
+    if (colon) {
+        snprintf(addr, sizeof(addr), "%.*s", (int) (colon - listen), listen);
+        port = atoi(colon + 1);
+    } else {
+        snprintf(addr, sizeof(addr), "0.0.0.0");
+        port = atoi(listen);
+    }
+
+    name = strrchr(ctx->playlist.c_str(), '/');
+    name = name ? name + 1 : ctx->playlist.c_str();
+
+    hls_store_init(&context->store, name,
+                   g_http_segs > 0 ? g_http_segs : ctx->winfrags);
+    context->store.root.assign(ctx->stream, ctx->stream_len);
+
+    if (ctx->single) {
+        name = strrchr(ctx->single_name.c_str(), '/');
+        name = name ? name + 1 : ctx->single_name.c_str();
+        context->store.single_name = name;
+    }
+
+    if (ctx->iframes) {
+        name = strrchr(ctx->iframes_playlist.c_str(), '/');
+        name = name ? name + 1 : ctx->iframes_playlist.c_str();
+        context->store.iframes_name = name;
+    }
+
+    context->http = flv_hls_http_start(addr, port, &context->store,
+                                       3 * ctx->max_fraglen);
+
+    /* a part of an encrypted segment is not decrypted alone */
+    ctx->partlen = (ctx->encrypt && !ctx->sample_aes) ? 0 : g_partlen;
+    if (context->http == NULL) {
+        return ERROR_NORMAL;
+    }
+
+    ctx->store = &context->store;
+
+    return SUCCESS;
+}
+
+/* the entries of the window as they were, room to grow after them */
+static int
+hls_entries_restore(hls_entries_t *e, u_char *p, size_t len, u_int64_t base)
+{
+    u_char                          *data;
+
+    data = (u_char *) realloc(e->data, len + 4096);
+    if (data == NULL) {
+        return ERROR_NORMAL;
+    }
+
+    memcpy(data, p, len);
+
+    e->data = data;
+    e->cap = len + 4096;
+    e->pos = 0;
+    e->last = len;
+    e->base = base;
+
+    return SUCCESS;
+}
+
+
+/*
+ * the output continues from the checkpoint when there is one. a file
+ * is read again from the tag that opened the fragment after the last
+ * one closed, the fragments come out as the run before would have
+ * made them. a stream goes on where it is now with a discontinuity,
+ * the codec headers and the audio buffered are of the one before.
+ */
+static int
+hls_read_checkpoint(Flv2hlsContext *context, u_int32_t *vstartime)
+{
+    hls_checkpoint_t                *cp;
+    hls_checkpoint_head_t           h;
+    hls_ctx_t                       *ctx;
+    str_buf_t                       *b;
+    struct stat                     st;
+    u_char                          *data, *p;
+    u_int32_t                       crc;
+    size_t                          size;
+    int                             fd, stream;
+
+    cp = context->checkpoint;
+    ctx = &context->outputs[0];
+
+    fd = open(cp->path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return errno == ENOENT ? SUCCESS : ERROR_NORMAL;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(h)) {
+        ERROR("error: hls checkpoint %s is broken\n", cp->path.c_str());
+        close(fd);
+        return ERROR_NORMAL;
+    }
+
+    data = new u_char[st.st_size];
+
+    if (read(fd, data, st.st_size) != st.st_size) {
+        ERROR("error: hls read %s failed\n", cp->path.c_str());
+        close(fd);
+        delete [] data;
+        return ERROR_NORMAL;
+    }
+
+    close(fd);
+
+    memcpy(&h, data, sizeof(h));
+
+    size = sizeof(h) + (h.winfrags * 2 + 1) * sizeof(hls_frag_t)
+           + (h.winfrags + 1) * sizeof(hls_target_t)
+           + h.nexpired_max * sizeof(hls_expired_t)
+           + h.entries_len + h.iframes_len + h.aframe_len
+           + h.avc_header_size + h.aac_header_size;
+
+    if (memcmp(h.magic, HLS_CHECKPOINT_MAGIC, sizeof(h.magic)) != 0
+        || h.head_size != sizeof(h) || h.frag_size != sizeof(hls_frag_t)
+        || size != (size_t) st.st_size || h.aframe_len > MAX_FRAME_SIZE)
+    {
+        ERROR("error: hls checkpoint %s is broken\n", cp->path.c_str());
+        delete [] data;
+        return ERROR_NORMAL;
+    }
+
+    /* another conversion, its state means nothing to this one */
+    if (h.winfrags != ctx->winfrags || h.flags != hls_checkpoint_flags(ctx)
+        || (h.nexpired_max
+            && h.nexpired_max != ctx->expire * ctx->winfrags + 1))
+    {
+        ERROR("error: hls checkpoint %s is of other options, remove it to "
+              "start over\n", cp->path.c_str());
+        delete [] data;
+        return ERROR_NORMAL;
+    }
+
+    stream = context->flvreader.is_stream();
+
+    /*
+     * rewritten rather than appended to. the playlist and the segments
+     * out there are of the old bytes, going on from the start would
+     * number them back from the first.
+     */
+    if (!stream && !cp->input.empty()
+        && (context->flvreader.filesize() < h.offset
+            || hls_input_hash(cp->input.c_str(), h.offset, &crc) != SUCCESS
+            || crc != h.input_crc))
+    {
+        ERROR("error: hls input %s changed before the checkpoint %s, "
+              "remove it and the output to start over\n",
+              cp->input.c_str(), cp->path.c_str());
+        delete [] data;
+        return ERROR_NORMAL;
+    }
+
+    if (!stream && context->flvreader.lseek(h.offset) != h.offset) {
+        ERROR("error: hls seek the input to %lld failed\n",
+              (long long) h.offset);
+        delete [] data;
+        return ERROR_NORMAL;
+    }
+
+    p = data + sizeof(h);
+
+    ctx->frag = h.frag;
+    ctx->nfrags = h.nfrags;
+    memcpy(ctx->frags, p, (ctx->winfrags * 2 + 1) * sizeof(hls_frag_t));
+    p += (ctx->winfrags * 2 + 1) * sizeof(hls_frag_t);
+
+    ctx->target = h.target;
+    ctx->ntargets = h.ntargets;
+    memcpy(ctx->targets, p, (ctx->winfrags + 1) * sizeof(hls_target_t));
+    p += (ctx->winfrags + 1) * sizeof(hls_target_t);
+
+    if (h.nexpired_max) {
+        ctx->expired = new hls_expired_t[h.nexpired_max];
+        memcpy(ctx->expired, p, h.nexpired_max * sizeof(hls_expired_t));
+        p += h.nexpired_max * sizeof(hls_expired_t);
+    }
+
+    ctx->expired_head = h.expired_head;
+    ctx->nexpired = h.nexpired;
+
+    if (hls_entries_restore(&ctx->entries, p, h.entries_len, h.entries_base)
+        != SUCCESS
+        || hls_entries_restore(&ctx->iframe_entries, p + h.entries_len,
+                               h.iframes_len, h.iframes_base)
+           != SUCCESS)
+    {
+        delete [] data;
+        return ERROR_NORMAL;
+    }
+
+    p += h.entries_len + h.iframes_len;
+
+    ctx->iframe_seq = h.iframe_seq;
+    ctx->iframe_bw = h.iframe_bw;
+
+    ctx->audio_cc = h.audio_cc;
+    ctx->video_cc = h.video_cc;
+    ctx->aframe_base = h.aframe_base;
+    ctx->aframe_num = h.aframe_num;
+    ctx->aframe_pts = h.aframe_pts;
+    ctx->bStart = h.bStart;
+    ctx->vod_target = h.vod_target;
+    ctx->meta_target = h.meta_target;
+    ctx->part_last_ts = h.part_last_ts;
+    ctx->part_gap = h.part_gap;
+
+    ctx->init_written = h.init_written;
+    ctx->mp4.seq = h.mp4_seq;
+    ctx->mp4.video.last_duration = h.mp4_video_duration;
+    ctx->mp4.audio.last_duration = h.mp4_audio_duration;
+
+    memcpy(ctx->key, h.key, sizeof(ctx->key));
+    ctx->key_id = h.key_id;
+    ctx->key_frags = h.key_frags;
+
+    ctx->peak_bw = h.peak_bw;
+    ctx->bytes = h.bytes;
+    ctx->seconds = h.seconds;
+
+    if (!stream) {
+        if (h.aframe_len) {
+            b = new str_buf_t;
+            b->end = b->buf + MAX_FRAME_SIZE;
+            b->pos = b->start = b->buf;
+            memcpy(b->pos, p, h.aframe_len);
+            b->last = b->pos + h.aframe_len;
+            ctx->aframe = b;
+        }
+
+        p += h.aframe_len;
+
+        if (h.avc_header_size) {
+            context->codec.avc_header = new unsigned char[h.avc_header_size];
+            context->codec.avc_header_size = h.avc_header_size;
+            memcpy(context->codec.avc_header, p, h.avc_header_size);
+            av_codec_parse_avc_header(context, p, h.avc_header_size);
+        }
+
+        p += h.avc_header_size;
+
+        if (h.aac_header_size) {
+            context->codec.aac_header = new unsigned char[h.aac_header_size];
+            context->codec.aac_header_size = h.aac_header_size;
+            memcpy(context->codec.aac_header, p, h.aac_header_size);
+            av_codec_parse_aac_header(context, p, h.aac_header_size);
+        }
+
+        *vstartime = h.vstartime;
+        cp->vstartime = h.vstartime;
+
+    } else {
+        ctx->discont = 1;
+    }
+
+    delete [] data;
+
+    /* the single file and the sidecar end where the fragment closed */
+    if (ctx->single) {
+        ctx->single_fd = open(ctx->single_name.c_str(), O_WRONLY|O_CREAT,
+                              0644);
+        if (ctx->single_fd == -1
+            || ftruncate(ctx->single_fd, h.single_size) != 0
+            || lseek(ctx->single_fd, h.single_size, SEEK_SET) == -1)
+        {
+            ERROR("error: hls open %s failed\n", ctx->single_name.c_str());
+            return ERROR_NORMAL;
+        }
+
+        ctx->file.fd = ctx->single_fd;
+        ctx->file.offset = h.single_size;
+        ctx->single_alloc = h.single_size;
+    }
+
+    if (ctx->crc) {
+        ctx->crc_fd = open(ctx->crc_path.c_str(),
+                           O_WRONLY|O_CREAT|O_APPEND, 0644);
+        if (ctx->crc_fd == -1 || ftruncate(ctx->crc_fd, h.crc_size) != 0) {
+            ERROR("error: hls open %s failed\n", ctx->crc_path.c_str());
+            return ERROR_NORMAL;
+        }
+    }
+
+    ctx->resumed = 1;
+
+    printf("resume %s at fragment %llu\n", cp->path.c_str(),
+           (unsigned long long) (ctx->frag + ctx->nfrags));
+
+    return SUCCESS;
+}
+
+
+/*
+ * the tag at offset is damaged or cut short, go on from the next one
+ * that looks right. the file after it is mapped a window at a time,
+ * a candidate too close to the end of one to be checked is looked at
+ * again by the next. a stream can not be read again and ends.
+ */
+static int
+flv_salvage(Flv2hlsContext *context, int64_t offset)
+{
+    hls_salvage_t                   *s;
+    hls_ctx_t                       *ctx;
+    int64_t                         size, start, base, found;
+    size_t                          len;
+    u_char                          *p;
+    u_int32_t                       ts, min_ts, i;
+    int                             last;
+
+    s = &context->salvage;
+
+    if (context->flvreader.is_stream()) {
+        return ERROR_NORMAL;
+    }
+
+    size = context->flvreader.filesize();
+    if (size <= offset + FLV_SALVAGE_TAG_MIN) {
+        return ERROR_NORMAL;
+    }
+
+    min_ts = s->last_ts > FLV_SALVAGE_TS_BACK
+             ? s->last_ts - FLV_SALVAGE_TS_BACK : 0;
+
+    start = offset + 1;
+    found = -1;
+    ts = 0;
+
+    for ( ;; ) {
+        base = start & ~((int64_t) sysconf(_SC_PAGESIZE) - 1);
+        len = (size_t) (size - base < HLS_SALVAGE_WINDOW
+                        ? size - base : HLS_SALVAGE_WINDOW);
+        last = (base + (int64_t) len == size);
+
+        p = (u_char *) mmap(NULL, len, PROT_READ, MAP_SHARED,
+                            context->flvreader.fd(), base);
+        if (p == MAP_FAILED) {
+            ERROR("error: map the input failed, %s\n", strerror(errno));
+            return ERROR_NORMAL;
+        }
+
+        madvise(p, len, MADV_SEQUENTIAL);
+
+        found = flv_salvage_scan(p + (start - base),
+                                 len - (size_t) (start - base), min_ts,
+                                 s->trailers ? FLV_SALVAGE_TRAILERS : 0);
+
+        if (found >= 0) {
+            found += start;
+
+            if (!last && found + FLV_SALVAGE_AHEAD > base + (int64_t) len) {
+                found = -1;
+
+            } else {
+                ts = flv_salvage_ts(p + (found - base));
+            }
+        }
+
+        munmap(p, len);
+
+        if (found >= 0 || last) {
+            break;
+        }
+
+        start = base + (int64_t) len - FLV_SALVAGE_AHEAD;
+    }
+
+    if (found < 0) {
+        DEBUG("no tag after %lld, the input ends there\n", (long long) offset);
+        return ERROR_NORMAL;
+    }
+
+    if (context->flvreader.lseek(found) != found) {
+        return ERROR_NORMAL;
+    }
+
+    s->nranges++;
+    s->bytes += found - offset;
+
+    printf("damaged input, bytes %lld-%lld skipped, %u ms lost\n",
+           (long long) offset, (long long) found - 1,
+           ts > s->last_ts ? ts - s->last_ts : 0);
+
+    /*
+     * the timeline broke, the fragment ends at the damage as at the end
+     * of the input and the next keyframe starts over.
+     */
+    if (ts > s->last_ts + HLS_SALVAGE_GAP) {
+        for (i = 0; i < context->noutputs; i++) {
+            ctx = &context->outputs[i];
+            ctx->discont = 1;
+
+            if (ctx->opened && !ctx->resumed) {
+                hls_flush_audio(ctx);
+                hls_close_fragment(ctx, 0);
+                hls_update_checkpoint(ctx);
+                ctx->resumed = 1;
+            }
+        }
+    }
+
+    return SUCCESS;
+}
+
+
+/*
+ * read the tags of the input to the end and give them to its outputs.
+ */
+static int
+hls_convert(Flv2hlsContext *context)
+{
+    char header[9];
+    u_int32_t g_pos4firstpkt = 0;
+    int ret = SUCCESS;
+    u_int32_t vstartime = 0;
+    int64_t offset;
+    time_t startid = time(NULL);
+
+    if (flv_read_header(context, &header, &g_pos4firstpkt) != SUCCESS) {
+        ERROR("error: read flv header failed.\n");
+        return ERROR_NORMAL;
+    }
+
+    if (context->checkpoint
+        && hls_read_checkpoint(context, &vstartime) != SUCCESS)
+    {
+        return ERROR_NORMAL;
+    }
+
+    DEBUG("startid:%d\n", startid);
+    startid = startid - 10;
+    while(true){
+        char type;
+        u_int32_t timestamp=0;
+        u_int32_t size = 0;
+        
+        offset = context->flvreader.tellg();
+
+        if (context->checkpoint) {
+            context->checkpoint->offset = offset;
+        }
+
+        ret = flv_read_tag_header(context, &type, &size, &timestamp);
+
+        if (ret == ERROR_FLV_DAMAGED_TAG) {
+            if (flv_salvage(context, offset) == SUCCESS) {
+                continue;
+            }
+
+            ERROR("error: damaged tag at %lld\n", (long long) offset);
+            ret = ERROR_SYSTEM_FILE_EOF;
+        }
+        
+        if (ret != SUCCESS) {        
+            if (ret != ERROR_SYSTEM_FILE_EOF) {
+                ERROR("error: flv_read_tag_header failed \n"); 
+            }
+            /* before the fragment in progress is closed by the end */
+            if (ret == ERROR_SYSTEM_FILE_EOF && context->checkpoint) {
+                hls_end_checkpoint(&context->outputs[0]);
+            }
+
+            hls_finish_outputs(context);
+            break;
+            /*
+                    if( context->outputs[0].nfrags > 0 )
+                    {
+                        //hls_close_fragment(&context->outputs[0]);
+                    }
+                    */
+            char tmpname[35] = {0};
+            sprintf(tmpname, "test-%d.flv", startid);
+            std::string clippath = tmpname;
+            context->flvreader.close();
+            if (context->flvreader.open(clippath) != SUCCESS) {
+               DEBUG("open clip:%s failed, try 1s later\n", clippath.c_str());
+               sleep(1);
+               continue;
+            }
+
+            if (context->flvdec.initialize(&context->flvreader) != SUCCESS) {
+                ERROR("init new clip failed\n");
+                return ERROR_NORMAL;
+            }
+            DEBUG("using new clip:%s\n", clippath.c_str());
+            startid++;
+            if ((ret = flv_read_tag_header(context, &type, &size, &timestamp)) != SUCCESS) {        
+                ERROR("real error: flv_read_tag_header failed \n"); 
+                return ERROR_NORMAL;
+            }
+        }
+        char* data = new char[size];
+        hls_frame_t *frame = NULL;
+        DEBUG("flv frametype:%d, timestamp:%u\n", type, timestamp);
+        if ((ret = flv_read_tag_data(context, &data, size)) != SUCCESS) {
+            delete [] data;
+
+            if (flv_salvage(context, offset) == SUCCESS) {
+                continue;
+            }
+
+            /* a damaged trailer ends the input as a short tag does */
+            if (ret == ERROR_FLV_DAMAGED_TAG) {
+                ERROR("error: damaged tag at %lld\n", (long long) offset);
+                ret = ERROR_SYSTEM_FILE_EOF;
+
+            } else {
+                ERROR("error: flv_read_tag_data failed\n");
+            }
+
+            /* the last tag of an input being appended to */
+            if (ret == ERROR_SYSTEM_FILE_EOF && context->checkpoint) {
+                hls_end_checkpoint(&context->outputs[0]);
+            }
+
+            hls_finish_outputs(context);
+            break;
+        }
+
+        context->salvage.last_ts = timestamp;
+
+        if( vstartime == 0 )
+        {
+            vstartime = timestamp;
+            if (context->checkpoint) {
+                context->checkpoint->vstartime = vstartime;
+            }
+        }
+
+        if( type == NGX_RTMP_MSG_VIDEO )
+        {
+            if( !context->codec.avc_header )
+            {
+                context->codec.avc_header = new unsigned char[size];
+                context->codec.avc_header_size = size;
+                memcpy(context->codec.avc_header, data, size);
+                av_codec_parse_avc_header(context, (u_int8_t*)data, size);
+
+                if (context->align) {
+                    hls_align_video(context->align, context->rendition);
+                }
+            }else
+            {
+                /*
+                        if ( context->outputs[0].bStart == 0)
+                        {
+                            vstartime = timestamp;
+                        }
+                        */
+                frame = hls_frame_create(type, timestamp - vstartime,
+                                         (u_char*)data, size);
+            }
+        }
+        else if( type == NGX_RTMP_MSG_AUDIO )
+        {
+            if( !context->codec.aac_header )
+            {
+                context->codec.aac_header = new unsigned char[size];
+                context->codec.aac_header_size = size;
+                memcpy(context->codec.aac_header, data, size);
+                av_codec_parse_aac_header(context, (u_int8_t*)data, size);
+            }else
+            {
+                frame = hls_frame_create(type, timestamp - vstartime,
+                                         (u_char*)data, size);
+            }
+
+        }
+
+        else if (type == NGX_RTMP_MSG_AMF_META && !context->codec.meta
+                 && av_codec_parse_meta(context, (u_int8_t *) data, size)
+                    == SUCCESS)
+        {
+            /* the codec keeps it */
+            continue;
+        }
+
+        /* the frame owns the data now */
+        if (frame) {
+            hls_fanout(context, frame);
+            hls_frame_free(frame);
+        } else {
+            delete [] data;
+        }
+    }
+
+    if (context->salvage.nranges) {
+        printf("salvaged the input, %u damaged ranges, %lld bytes skipped\n",
+               context->salvage.nranges, (long long) context->salvage.bytes);
+    }
+
+    return SUCCESS;
+}
+
+
+static void *
+hls_convert_thread(void *data)
+{
+    Flv2hlsContext                  *context;
+
+    context = (Flv2hlsContext *) data;
+
+    hls_convert(context);
+    hls_align_done(context->align, context->rendition);
+
+    return NULL;
+}
+
+
+/*
+ * rendition spec "flv[,output options]", each goes to the directory
+ * named by the flv without extension and is converted by its own
+ * thread. the master playlist lists them all.
+ */
+static int
+hls_run_renditions(const char *name)
+{
+    Flv2hlsContext                  **contexts;
+    hls_ctx_t                       *outputs;
+    hls_master_t                    *master;
+    hls_align_t                     *align;
+    pthread_t                       tids[HLS_MAX_OUTPUTS];
+    char                            spec[1024], base[256];
+    char                            *path, *opts, *p;
+    u_int32_t                       i, n, started;
+    int                             rc;
+
+    n = g_nrenditions;
+    rc = ERROR_NORMAL;
+
+    contexts = new Flv2hlsContext *[n]();
+    outputs = new hls_ctx_t[n]();
+
+    align = new hls_align_t();
+    pthread_mutex_init(&align->lock, NULL);
+    pthread_cond_init(&align->cond, NULL);
+    align->ninputs = n;
+
+    master = new hls_master_t;
+    master->path = std::string("hls_") + name + ".master.m3u8";
+    master->path_bak = master->path + ".bak";
+    master->sink = g_sink;
+    master->outputs = outputs;
+    master->noutputs = n;
+    pthread_mutex_init(&master->lock, NULL);
+
+    for (i = 0; i < n; i++) {
+        path = g_renditions[i];
+
+        opts = strchr(path, ',');
+        if (opts) {
+            *opts++ = 0;
+        }
+
+        p = strrchr(path, '/');
+        snprintf(base, sizeof(base), "%s", p ? p + 1 : path);
+        snprintf(spec, sizeof(spec), "%.*s%s%s",
+                 (int) strcspn(base, "."), base,
+                 opts ? "," : "", opts ? opts : "");
+
+        contexts[i] = flv_open_read(path);
+        if (contexts[i] == NULL) {
+            ERROR("error: open rendition %s failed\n", path);
+            goto failed;
+        }
+
+        contexts[i]->outputs = &outputs[i];
+        contexts[i]->noutputs = 1;
+        contexts[i]->master = master;
+        contexts[i]->align = align;
+        contexts[i]->rendition = i;
+
+        if (hls_init_output(&outputs[i], &contexts[i]->codec, base, spec)
+            != SUCCESS)
+        {
+            goto failed;
+        }
+
+        outputs[i].master = master;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (pthread_create(&tids[i], NULL, hls_convert_thread, contexts[i])
+            != 0)
+        {
+            ERROR("error: start rendition %s failed\n", g_renditions[i]);
+            break;
+        }
+    }
+
+    /* the ones not started must not hold the others */
+    started = i;
+    for ( ; i < n; i++) {
+        hls_align_done(align, i);
+    }
+
+    for (i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+    }
+
+    rc = SUCCESS;
+
+failed:
+
+    for (i = 0; i < n; i++) {
+        if (contexts[i]) {
+            flv_close(contexts[i]);
+        }
+
+        hls_free_output(&outputs[i]);
+    }
+
+    pthread_mutex_destroy(&master->lock);
+    pthread_cond_destroy(&align->cond);
+    pthread_mutex_destroy(&align->lock);
+
+    delete master;
+    delete align;
+    delete [] outputs;
+    delete [] contexts;
+
+    return rc;
+}
+
+
+int main(int argc, char*argv[])
+{
+    char *source = "test";
+    int c;
+
+    while ((c = getopt(argc, argv, "w:f:m:s:H:n:p:t:bvaieScCk:K:o:r:u:d:D:R:I")) != -1) {
+        switch (c) {
+            case 'w':
+                g_winfrages = atoi(optarg);
+                printf("g_winfrages:%d\n", g_winfrages);
+                break;
+            case 'f':
+                g_fraglen = atoi(optarg);
+                printf("g_fraglen:%d\n", g_fraglen);
+                break;
+            case 'm':
+                g_max_fraglen = atoi(optarg);
+                printf("g_max_fraglen:%d\n", g_max_fraglen);
+                break;
+            case 's':
+                source = optarg;
+                break;
+            case 'H':
+                g_http_listen = optarg;
+                break;
+            case 'n':
+                g_http_segs = atoi(optarg);
+                break;
+            case 'p':
+                g_partlen = atoi(optarg);
+                break;
+            case 't':
+                g_fmp4 = (strcmp(optarg, "fmp4") == 0);
+                break;
+            case 'b':
+                g_single = 1;
+                break;
+            case 'v':
+                g_vod = 1;
+                break;
+            case 'a':
+                g_audio = 1;
+                break;
+            case 'i':
+                g_iframes = 1;
+                break;
+            case 'e':
+                g_encrypt = 1;
+                break;
+            case 'S':
+                g_sample_aes = 1;
+                break;
+            case 'c':
+                g_crc = g_crc ? g_crc : 1;
+                break;
+            case 'C':
+                g_crc = 2;
+                break;
+            case 'k':
+                g_frags_per_key = atoi(optarg);
+                break;
+            case 'K':
+                if (strlen(optarg) > HLS_KEY_URI_MAX) {
+                    ERROR("error: key url longer than %d\n", HLS_KEY_URI_MAX);
+                    exit(0);
+                }
+                g_key_url = optarg;
+                break;
+            case 'u':
+                g_sink_url = optarg;
+                break;
+            case 'd':
+                g_expire = atoi(optarg);
+                break;
+            case 'D':
+                g_durable = atoi(optarg);
+                break;
+            case 'R':
+                g_checkpoint = optarg;
+                break;
+            case 'I':
+                g_incremental = 1;
+                break;
+            case 'o':
+                if (g_noutputs == HLS_MAX_OUTPUTS - 1) {
+                    ERROR("error: at most %d outputs\n", HLS_MAX_OUTPUTS - 1);
+                    exit(0);
+                }
+                g_outputs[g_noutputs++] = optarg;
+                break;
+            case 'r':
+                if (g_nrenditions == HLS_MAX_OUTPUTS) {
+                    ERROR("error: at most %d renditions\n", HLS_MAX_OUTPUTS);
+                    exit(0);
+                }
+                g_renditions[g_nrenditions++] = optarg;
+                break;
+            default:
+                exit(0);
+        }
+    }
+
+    g_sink = flv_hls_sink_create(g_sink_url);
+    if (g_sink == NULL) {
+        return 0;
+    }
+
+    if (g_nrenditions) {
+        if (g_noutputs || g_audio) {
+            ERROR("error: renditions take no -o or -a.\n");
+            return 0;
+        }
+
+        if (g_http_listen) {
+            ERROR("error: renditions are not served by http, ignore -H.\n");
+        }
+
+        if (g_checkpoint || g_incremental) {
+            ERROR("error: renditions are not checkpointed, ignore -R -I.\n");
+        }
+
+        hls_run_renditions(source);
+        flv_hls_sink_destroy(g_sink);
+        ERROR(" job finished\n");
+        return 0;
+    }
+
+    Flv2hlsContext* g_con = init_context(source);  
+    if( !g_con )
+    {
+        ERROR("error: fail to open test.flv\n");
+        return 0;
+    }
+
+    /* nothing to serve live before the vod playlist is written */
+    if (g_vod && g_http_listen) {
+        ERROR("error: vod playlist is not served by http, ignore -H.\n");
+        g_http_listen = NULL;
+    }
+
+    if (g_http_listen && hls_start_http(g_con, g_http_listen) != SUCCESS) {
+        ERROR("error: start hls http server failed.\n");
+        return 0;
+    }
+
+    if (hls_convert(g_con) != SUCCESS) {
+        flv_hls_sink_destroy(g_sink);
+        return 0;
+    }
+
+    flv_hls_http_stop(g_con->http);
+    flv_close(g_con);
+    flv_hls_sink_destroy(g_sink);
+    ERROR(" job finished\n"); 
+    return 0;
+}
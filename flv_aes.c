@@ -0,0 +1,243 @@
+/*
+ * AES-128 as in FIPS-197, encryption only since the segments are
+ * only written. the portable code is the usual one with the four
+ * round tables built once from the S-box.
+ */
+
+
+#include <pthread.h>
+
+#include "flv_aes.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <wmmintrin.h>
+#define FLV_AES_NI                  1
+#endif
+
+
+#define flv_aes_get32(p)                                                     \
+    (((u_int32_t) (p)[0] << 24) | ((u_int32_t) (p)[1] << 16)                 \
+     | ((u_int32_t) (p)[2] << 8) | (u_int32_t) (p)[3])
+
+#define flv_aes_put32(p, v)                                                  \
+    (p)[0] = (u_char) ((v) >> 24); (p)[1] = (u_char) ((v) >> 16);            \
+    (p)[2] = (u_char) ((v) >> 8); (p)[3] = (u_char) (v)
+
+
+static const u_char flv_aes_sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5,
+    0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0,
+    0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc,
+    0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a,
+    0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0,
+    0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b,
+    0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85,
+    0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5,
+    0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17,
+    0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88,
+    0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c,
+    0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9,
+    0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6,
+    0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e,
+    0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94,
+    0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68,
+    0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+
+static const u_int32_t flv_aes_rcon[10] = {
+    0x01000000, 0x02000000, 0x04000000, 0x08000000, 0x10000000,
+    0x20000000, 0x40000000, 0x80000000, 0x1b000000, 0x36000000
+};
+
+
+static u_int32_t flv_aes_te[4][256];
+static pthread_once_t flv_aes_once = PTHREAD_ONCE_INIT;
+
+
+static void
+flv_aes_init_tables(void)
+{
+    u_int32_t                           i, s, s2, s3, t;
+
+    for (i = 0; i < 256; i++) {
+        s = flv_aes_sbox[i];
+        s2 = ((s << 1) ^ ((s & 0x80) ? 0x1b : 0)) & 0xff;
+        s3 = s2 ^ s;
+
+        t = (s2 << 24) | (s << 16) | (s << 8) | s3;
+
+        flv_aes_te[0][i] = t;
+        flv_aes_te[1][i] = (t >> 8) | (t << 24);
+        flv_aes_te[2][i] = (t >> 16) | (t << 16);
+        flv_aes_te[3][i] = (t >> 24) | (t << 8);
+    }
+}
+
+
+void
+flv_aes_set_key(flv_aes_key_t *key, const u_char *k)
+{
+    u_int32_t                           *rk, t, i;
+
+    pthread_once(&flv_aes_once, flv_aes_init_tables);
+
+    rk = key->rk;
+
+    for (i = 0; i < 4; i++) {
+        rk[i] = flv_aes_get32(k + 4 * i);
+    }
+
+    for (i = 0; i < 10; i++, rk += 4) {
+        t = rk[3];
+        rk[4] = rk[0] ^ flv_aes_rcon[i]
+                ^ ((u_int32_t) flv_aes_sbox[(t >> 16) & 0xff] << 24)
+                ^ ((u_int32_t) flv_aes_sbox[(t >> 8) & 0xff] << 16)
+                ^ ((u_int32_t) flv_aes_sbox[t & 0xff] << 8)
+                ^ (u_int32_t) flv_aes_sbox[t >> 24];
+        rk[5] = rk[1] ^ rk[4];
+        rk[6] = rk[2] ^ rk[5];
+        rk[7] = rk[3] ^ rk[6];
+    }
+
+    for (i = 0; i < 44; i++) {
+        flv_aes_put32(key->rkb + 4 * i, key->rk[i]);
+    }
+
+#ifdef FLV_AES_NI
+    key->aesni = __builtin_cpu_supports("aes") ? 1 : 0;
+#else
+    key->aesni = 0;
+#endif
+}
+
+
+static void
+flv_aes_encrypt_block(flv_aes_key_t *key, const u_char *in, u_char *out)
+{
+    const u_int32_t                     *rk;
+    u_int32_t                           s0, s1, s2, s3, t0, t1, t2, t3;
+    u_int32_t                           r;
+
+    rk = key->rk;
+
+    s0 = flv_aes_get32(in) ^ rk[0];
+    s1 = flv_aes_get32(in + 4) ^ rk[1];
+    s2 = flv_aes_get32(in + 8) ^ rk[2];
+    s3 = flv_aes_get32(in + 12) ^ rk[3];
+
+#define flv_aes_round(a, b, c, d, k)                                         \
+    (flv_aes_te[0][(a) >> 24] ^ flv_aes_te[1][((b) >> 16) & 0xff]            \
+     ^ flv_aes_te[2][((c) >> 8) & 0xff] ^ flv_aes_te[3][(d) & 0xff] ^ (k))
+
+    for (r = 1; r < 10; r++) {
+        rk += 4;
+
+        t0 = flv_aes_round(s0, s1, s2, s3, rk[0]);
+        t1 = flv_aes_round(s1, s2, s3, s0, rk[1]);
+        t2 = flv_aes_round(s2, s3, s0, s1, rk[2]);
+        t3 = flv_aes_round(s3, s0, s1, s2, rk[3]);
+
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+
+#undef flv_aes_round
+
+    /* the last round has no MixColumns */
+#define flv_aes_last(a, b, c, d, k)                                          \
+    (((u_int32_t) flv_aes_sbox[(a) >> 24] << 24)                             \
+     ^ ((u_int32_t) flv_aes_sbox[((b) >> 16) & 0xff] << 16)                  \
+     ^ ((u_int32_t) flv_aes_sbox[((c) >> 8) & 0xff] << 8)                    \
+     ^ (u_int32_t) flv_aes_sbox[(d) & 0xff] ^ (k))
+
+    rk += 4;
+
+    t0 = flv_aes_last(s0, s1, s2, s3, rk[0]);
+    t1 = flv_aes_last(s1, s2, s3, s0, rk[1]);
+    t2 = flv_aes_last(s2, s3, s0, s1, rk[2]);
+    t3 = flv_aes_last(s3, s0, s1, s2, rk[3]);
+
+#undef flv_aes_last
+
+    flv_aes_put32(out, t0);
+    flv_aes_put32(out + 4, t1);
+    flv_aes_put32(out + 8, t2);
+    flv_aes_put32(out + 12, t3);
+}
+
+
+#ifdef FLV_AES_NI
+
+__attribute__((target("aes,sse2")))
+static void
+flv_aes_cbc_encrypt_ni(flv_aes_key_t *key, u_char *iv, const u_char *in,
+    u_char *out, size_t len)
+{
+    __m128i                             k[11], c;
+    size_t                              i;
+    int                                 r;
+
+    for (r = 0; r < 11; r++) {
+        k[r] = _mm_loadu_si128((const __m128i *) (key->rkb + 16 * r));
+    }
+
+    c = _mm_loadu_si128((const __m128i *) iv);
+
+    for (i = 0; i < len; i += FLV_AES_BLOCK) {
+        c = _mm_xor_si128(c, _mm_loadu_si128((const __m128i *) (in + i)));
+        c = _mm_xor_si128(c, k[0]);
+
+        for (r = 1; r < 10; r++) {
+            c = _mm_aesenc_si128(c, k[r]);
+        }
+
+        c = _mm_aesenclast_si128(c, k[10]);
+
+        _mm_storeu_si128((__m128i *) (out + i), c);
+    }
+
+    _mm_storeu_si128((__m128i *) iv, c);
+}
+
+#endif
+
+
+void
+flv_aes_cbc_encrypt(flv_aes_key_t *key, u_char *iv, const u_char *in,
+    u_char *out, size_t len)
+{
+    u_char                              block[FLV_AES_BLOCK];
+    size_t                              i;
+    int                                 j;
+
+#ifdef FLV_AES_NI
+    if (key->aesni) {
+        flv_aes_cbc_encrypt_ni(key, iv, in, out, len);
+        return;
+    }
+#endif
+
+    for (i = 0; i < len; i += FLV_AES_BLOCK) {
+        for (j = 0; j < FLV_AES_BLOCK; j++) {
+            block[j] = in[i + j] ^ iv[j];
+        }
+
+        flv_aes_encrypt_block(key, block, out + i);
+        memcpy(iv, out + i, FLV_AES_BLOCK);
+    }
+}
@@ -0,0 +1,30 @@
+/*
+ * AES-128 CBC encryption of the segments, AES-NI when the cpu has
+ * it and a table based implementation otherwise.
+ */
+
+
+#ifndef _FLV_AES_H_INCLUDED_
+#define _FLV_AES_H_INCLUDED_
+
+#include "common.h"
+
+
+#define FLV_AES_BLOCK               16
+
+
+typedef struct {
+    u_int32_t                           rk[44];   /* round keys */
+    u_char                              rkb[176]; /* same, in bytes */
+    unsigned                            aesni:1;
+} flv_aes_key_t;
+
+
+void flv_aes_set_key(flv_aes_key_t *key, const u_char *k);
+
+/* len is a multiple of the block, iv is the last cipher block after */
+void flv_aes_cbc_encrypt(flv_aes_key_t *key, u_char *iv, const u_char *in,
+    u_char *out, size_t len);
+
+
+#endif /* _FLV_AES_H_INCLUDED_ */
@@ -0,0 +1,413 @@
+/*
+ * AMF0 as in the Action Message Format spec of 2007, only what
+ * script tags carry. nothing is copied, the values not used are
+ * stepped over by their markers.
+ */
+
+
+#include <stddef.h>
+
+#include "flv_amf.h"
+#include "FlvDecoder.h"
+
+
+#define FLV_AMF_NUMBER              0x00
+#define FLV_AMF_BOOLEAN             0x01
+#define FLV_AMF_STRING              0x02
+#define FLV_AMF_OBJECT              0x03
+#define FLV_AMF_NULL                0x05
+#define FLV_AMF_UNDEFINED           0x06
+#define FLV_AMF_REFERENCE           0x07
+#define FLV_AMF_ECMA_ARRAY          0x08
+#define FLV_AMF_OBJECT_END          0x09
+#define FLV_AMF_STRICT_ARRAY        0x0a
+#define FLV_AMF_DATE                0x0b
+#define FLV_AMF_LONG_STRING         0x0c
+#define FLV_AMF_UNSUPPORTED         0x0d
+#define FLV_AMF_XML_DOCUMENT        0x0f
+#define FLV_AMF_TYPED_OBJECT        0x10
+
+/* objects in objects, deeper is taken as broken */
+#define FLV_AMF_DEPTH               16
+
+
+#define flv_amf_get16(p)  (((u_int32_t) (p)[0] << 8) | (u_int32_t) (p)[1])
+
+#define flv_amf_get32(p)                                                     \
+    (((u_int32_t) (p)[0] << 24) | ((u_int32_t) (p)[1] << 16)                 \
+     | ((u_int32_t) (p)[2] << 8) | (u_int32_t) (p)[3])
+
+
+typedef struct {
+    const char                          *name;
+    size_t                              len;
+    size_t                              offset;
+} flv_amf_prop_t;
+
+
+#define flv_amf_prop(name)                                                   \
+    { #name, sizeof(#name) - 1, offsetof(flv_amf_meta_t, name) }
+
+static flv_amf_prop_t flv_amf_meta_props[] = {
+    flv_amf_prop(duration),
+    flv_amf_prop(width),
+    flv_amf_prop(height),
+    flv_amf_prop(framerate),
+    flv_amf_prop(videodatarate),
+    flv_amf_prop(audiodatarate),
+    flv_amf_prop(videocodecid),
+    flv_amf_prop(audiocodecid),
+    { NULL, 0, 0 }
+};
+
+
+static int flv_amf_skip(const u_char **pp, const u_char *last, int depth);
+
+
+double
+flv_amf_number(const u_char *p)
+{
+    u_int64_t                           v;
+    double                              d;
+
+    v = ((u_int64_t) flv_amf_get32(p) << 32) | flv_amf_get32(p + 4);
+    memcpy(&d, &v, sizeof(d));
+
+    return d;
+}
+
+
+/* the name of a property, NULL at the object end marker */
+static int
+flv_amf_name(const u_char **pp, const u_char *last, const u_char **name,
+    size_t *len)
+{
+    const u_char                        *p;
+
+    p = *pp;
+
+    if (last - p < 3) {
+        return ERROR_NORMAL;
+    }
+
+    *len = flv_amf_get16(p);
+    p += 2;
+
+    if (*len == 0 && *p == FLV_AMF_OBJECT_END) {
+        *pp = p + 1;
+        *name = NULL;
+        return SUCCESS;
+    }
+
+    if ((size_t) (last - p) < *len) {
+        return ERROR_NORMAL;
+    }
+
+    *name = p;
+    *pp = p + *len;
+
+    return SUCCESS;
+}
+
+
+static int
+flv_amf_skip_props(const u_char **pp, const u_char *last, int depth)
+{
+    const u_char                        *name;
+    size_t                              len;
+
+    for ( ;; ) {
+        if (flv_amf_name(pp, last, &name, &len) != SUCCESS) {
+            return ERROR_NORMAL;
+        }
+
+        if (name == NULL) {
+            return SUCCESS;
+        }
+
+        if (flv_amf_skip(pp, last, depth) != SUCCESS) {
+            return ERROR_NORMAL;
+        }
+    }
+}
+
+
+static int
+flv_amf_skip(const u_char **pp, const u_char *last, int depth)
+{
+    const u_char                        *p;
+    size_t                              n;
+    u_int32_t                           i, count;
+
+    p = *pp;
+
+    if (p == last || depth == 0) {
+        return ERROR_NORMAL;
+    }
+
+    switch (*p++) {
+
+    case FLV_AMF_NUMBER:
+        n = 8;
+        break;
+
+    case FLV_AMF_BOOLEAN:
+        n = 1;
+        break;
+
+    case FLV_AMF_STRING:
+        if (last - p < 2) {
+            return ERROR_NORMAL;
+        }
+        n = 2 + flv_amf_get16(p);
+        break;
+
+    case FLV_AMF_REFERENCE:
+        n = 2;
+        break;
+
+    case FLV_AMF_DATE:
+        n = 10;
+        break;
+
+    case FLV_AMF_LONG_STRING:
+    case FLV_AMF_XML_DOCUMENT:
+        if (last - p < 4) {
+            return ERROR_NORMAL;
+        }
+        n = 4 + (size_t) flv_amf_get32(p);
+        break;
+
+    case FLV_AMF_NULL:
+    case FLV_AMF_UNDEFINED:
+    case FLV_AMF_UNSUPPORTED:
+        n = 0;
+        break;
+
+    case FLV_AMF_TYPED_OBJECT:
+        if (last - p < 2 || (size_t) (last - p) < 2 + flv_amf_get16(p)) {
+            return ERROR_NORMAL;
+        }
+        p += 2 + flv_amf_get16(p);
+
+        /* fall through */
+
+    case FLV_AMF_OBJECT:
+        *pp = p;
+        return flv_amf_skip_props(pp, last, depth - 1);
+
+    case FLV_AMF_ECMA_ARRAY:
+        if (last - p < 4) {
+            return ERROR_NORMAL;
+        }
+        *pp = p + 4;
+        return flv_amf_skip_props(pp, last, depth - 1);
+
+    case FLV_AMF_STRICT_ARRAY:
+        if (last - p < 4) {
+            return ERROR_NORMAL;
+        }
+        count = flv_amf_get32(p);
+        *pp = p + 4;
+
+        for (i = 0; i < count; i++) {
+            if (flv_amf_skip(pp, last, depth - 1) != SUCCESS) {
+                return ERROR_NORMAL;
+            }
+        }
+        return SUCCESS;
+
+    default:
+        return ERROR_NORMAL;
+    }
+
+    if ((size_t) (last - p) < n) {
+        return ERROR_NORMAL;
+    }
+
+    *pp = p + n;
+
+    return SUCCESS;
+}
+
+
+/*
+ * a strict array of numbers only, the usual form of the keyframe
+ * tables. any other is skipped and the table left out.
+ */
+static int
+flv_amf_numbers(const u_char **pp, const u_char *last, const u_char **a,
+    u_int32_t *count)
+{
+    const u_char                        *p, *q;
+    u_int32_t                           n, i;
+
+    p = *pp;
+
+    if (last - p < 5 || p[0] != FLV_AMF_STRICT_ARRAY) {
+        *a = NULL;
+        return flv_amf_skip(pp, last, FLV_AMF_DEPTH);
+    }
+
+    n = flv_amf_get32(p + 1);
+    p += 5;
+
+    if ((size_t) (last - p) / FLV_AMF_NUMBER_SIZE < n) {
+        return ERROR_NORMAL;
+    }
+
+    for (i = 0, q = p; i < n; i++, q += FLV_AMF_NUMBER_SIZE) {
+        if (*q != FLV_AMF_NUMBER) {
+            *a = NULL;
+            return flv_amf_skip(pp, last, FLV_AMF_DEPTH);
+        }
+    }
+
+    *a = p;
+    *count = n;
+    *pp = q;
+
+    return SUCCESS;
+}
+
+
+static int
+flv_amf_keyframes(flv_amf_meta_t *meta, const u_char **pp, const u_char *last)
+{
+    const u_char                        *p, *name;
+    size_t                              len;
+    u_int32_t                           ntimes, npositions;
+
+    p = *pp;
+
+    if (p < last && *p == FLV_AMF_OBJECT) {
+        *pp = p + 1;
+
+    } else if (last - p >= 5 && *p == FLV_AMF_ECMA_ARRAY) {
+        *pp = p + 5;
+
+    } else {
+        return flv_amf_skip(pp, last, FLV_AMF_DEPTH);
+    }
+
+    ntimes = 0;
+    npositions = 0;
+
+    for ( ;; ) {
+        if (flv_amf_name(pp, last, &name, &len) != SUCCESS) {
+            return ERROR_NORMAL;
+        }
+
+        if (name == NULL) {
+            break;
+        }
+
+        if (len == 5 && memcmp(name, "times", 5) == 0) {
+            if (flv_amf_numbers(pp, last, &meta->times, &ntimes) != SUCCESS) {
+                return ERROR_NORMAL;
+            }
+            continue;
+        }
+
+        if (len == 13 && memcmp(name, "filepositions", 13) == 0) {
+            if (flv_amf_numbers(pp, last, &meta->positions, &npositions)
+                != SUCCESS)
+            {
+                return ERROR_NORMAL;
+            }
+            continue;
+        }
+
+        if (flv_amf_skip(pp, last, FLV_AMF_DEPTH) != SUCCESS) {
+            return ERROR_NORMAL;
+        }
+    }
+
+    if (meta->times == NULL) {
+        meta->positions = NULL;
+        return SUCCESS;
+    }
+
+    meta->nkeys = ntimes;
+
+    if (meta->positions && npositions < ntimes) {
+        meta->nkeys = npositions;
+    }
+
+    return SUCCESS;
+}
+
+
+int
+flv_amf_parse_meta(flv_amf_meta_t *meta, const u_char *p, size_t len)
+{
+    const u_char                        *last, *name;
+    flv_amf_prop_t                      *prop;
+    size_t                              n;
+
+    last = p + len;
+
+    if (len < 13 || p[0] != FLV_AMF_STRING || flv_amf_get16(p + 1) != 10
+        || memcmp(p + 3, "onMetaData", 10) != 0)
+    {
+        return ERROR_NORMAL;
+    }
+
+    p += 13;
+
+    if (p == last) {
+        return ERROR_NORMAL;
+    }
+
+    if (*p == FLV_AMF_ECMA_ARRAY) {
+        if (last - p < 5) {
+            return ERROR_NORMAL;
+        }
+        p += 5;
+
+    } else if (*p == FLV_AMF_OBJECT) {
+        p++;
+
+    } else {
+        return ERROR_NORMAL;
+    }
+
+    meta->times = NULL;
+    meta->positions = NULL;
+    meta->nkeys = 0;
+
+    for ( ;; ) {
+        if (flv_amf_name(&p, last, &name, &n) != SUCCESS) {
+            /* encoders cut the ecma array short, keep what was read */
+            return SUCCESS;
+        }
+
+        if (name == NULL) {
+            return SUCCESS;
+        }
+
+        if (n == 9 && memcmp(name, "keyframes", 9) == 0) {
+            if (flv_amf_keyframes(meta, &p, last) != SUCCESS) {
+                meta->times = NULL;
+                meta->positions = NULL;
+                meta->nkeys = 0;
+                return SUCCESS;
+            }
+            continue;
+        }
+
+        if (p < last && *p == FLV_AMF_NUMBER && last - p >= 9) {
+            for (prop = flv_amf_meta_props; prop->name; prop++) {
+                if (prop->len == n && memcmp(prop->name, name, n) == 0) {
+                    *(double *) ((u_char *) meta + prop->offset) =
+                        flv_amf_number(p + 1);
+                    break;
+                }
+            }
+        }
+
+        if (flv_amf_skip(&p, last, FLV_AMF_DEPTH) != SUCCESS) {
+            return SUCCESS;
+        }
+    }
+}
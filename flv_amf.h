@@ -0,0 +1,51 @@
+/*
+ * AMF0 of the onMetaData script tag, read in place. the numbers are
+ * kept as they are and the keyframe arrays point into the tag.
+ */
+
+
+#ifndef _FLV_AMF_H_INCLUDED_
+#define _FLV_AMF_H_INCLUDED_
+
+#include "common.h"
+
+
+/* a number of a strict array, the marker and the double */
+#define FLV_AMF_NUMBER_SIZE         9
+
+
+typedef struct {
+    double                              duration;      /* sec */
+    double                              width;
+    double                              height;
+    double                              framerate;
+    double                              videodatarate; /* kbit/s */
+    double                              audiodatarate;
+    double                              videocodecid;
+    double                              audiocodecid;
+
+    /* keyframes.times and keyframes.filepositions, NULL when absent */
+    const u_char                        *times;
+    const u_char                        *positions;
+    u_int32_t                           nkeys;
+} flv_amf_meta_t;
+
+
+/*
+ * the tag data is onMetaData with an object or an ecma array. the
+ * properties not there are left as they were, the tag must outlive
+ * the keyframe arrays.
+ */
+int flv_amf_parse_meta(flv_amf_meta_t *meta, const u_char *p, size_t len);
+
+/* the big endian double after a number marker */
+double flv_amf_number(const u_char *p);
+
+#define flv_amf_key_time(meta, i)                                            \
+    flv_amf_number((meta)->times + FLV_AMF_NUMBER_SIZE * (i) + 1)
+
+#define flv_amf_key_position(meta, i)                                        \
+    flv_amf_number((meta)->positions + FLV_AMF_NUMBER_SIZE * (i) + 1)
+
+
+#endif /* _FLV_AMF_H_INCLUDED_ */
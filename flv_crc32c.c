@@ -0,0 +1,202 @@
+/*
+ * CRC32C of RFC 3720, the reflected polynomial 0x82f63b78. the
+ * hardware one runs three streams of the buffer at once and joins
+ * them by the shift tables, the crc32 instruction has a latency of
+ * three cycles.
+ */
+
+
+#include <pthread.h>
+
+#include "flv_crc32c.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define FLV_CRC32C_SSE42            1
+#endif
+
+
+#define FLV_CRC32C_POLY             0x82f63b78
+
+/* bytes of each of the three streams */
+#define FLV_CRC32C_STRIDE           1024
+
+
+static u_int32_t flv_crc32c_table[8][256];
+static pthread_once_t flv_crc32c_once = PTHREAD_ONCE_INIT;
+static int flv_crc32c_hw;
+
+#ifdef FLV_CRC32C_SSE42
+/* crc of a stride of zeros after a crc, one table per byte of it */
+static u_int32_t flv_crc32c_shift[4][256];
+#endif
+
+
+/* multiply crc by x^(8 * len) modulo the polynomial */
+static u_int32_t
+flv_crc32c_zeros(u_int32_t crc, size_t len)
+{
+    u_int32_t                           k;
+
+    while (len--) {
+        for (k = 0; k < 8; k++) {
+            crc = (crc & 1) ? (crc >> 1) ^ FLV_CRC32C_POLY : crc >> 1;
+        }
+    }
+
+    return crc;
+}
+
+
+static void
+flv_crc32c_init(void)
+{
+    u_int32_t                           i, j, crc;
+
+    for (i = 0; i < 256; i++) {
+        crc = i;
+        for (j = 0; j < 8; j++) {
+            crc = (crc & 1) ? (crc >> 1) ^ FLV_CRC32C_POLY : crc >> 1;
+        }
+        flv_crc32c_table[0][i] = crc;
+    }
+
+    for (i = 0; i < 256; i++) {
+        crc = flv_crc32c_table[0][i];
+        for (j = 1; j < 8; j++) {
+            crc = flv_crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+            flv_crc32c_table[j][i] = crc;
+        }
+    }
+
+#ifdef FLV_CRC32C_SSE42
+    for (j = 0; j < 4; j++) {
+        for (i = 0; i < 256; i++) {
+            flv_crc32c_shift[j][i] = flv_crc32c_zeros(i << (8 * j),
+                                                      FLV_CRC32C_STRIDE);
+        }
+    }
+
+    flv_crc32c_hw = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+
+static u_int32_t
+flv_crc32c_sw(u_int32_t crc, const u_char *p, size_t len)
+{
+    u_int32_t                           lo, hi;
+
+    while (len && ((uintptr_t) p & 7)) {
+        crc = flv_crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+
+    while (len >= 8) {
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+
+        crc = flv_crc32c_table[7][lo & 0xff]
+              ^ flv_crc32c_table[6][(lo >> 8) & 0xff]
+              ^ flv_crc32c_table[5][(lo >> 16) & 0xff]
+              ^ flv_crc32c_table[4][lo >> 24]
+              ^ flv_crc32c_table[3][hi & 0xff]
+              ^ flv_crc32c_table[2][(hi >> 8) & 0xff]
+              ^ flv_crc32c_table[1][(hi >> 16) & 0xff]
+              ^ flv_crc32c_table[0][hi >> 24];
+
+        p += 8;
+        len -= 8;
+    }
+
+    while (len--) {
+        crc = flv_crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+
+#ifdef FLV_CRC32C_SSE42
+
+static u_int32_t
+flv_crc32c_shift_stride(u_int32_t crc)
+{
+    return flv_crc32c_shift[0][crc & 0xff]
+           ^ flv_crc32c_shift[1][(crc >> 8) & 0xff]
+           ^ flv_crc32c_shift[2][(crc >> 16) & 0xff]
+           ^ flv_crc32c_shift[3][crc >> 24];
+}
+
+
+__attribute__((target("sse4.2")))
+static u_int32_t
+flv_crc32c_sse42(u_int32_t crc, const u_char *p, size_t len)
+{
+    u_int64_t                           c0, c1, c2, v0, v1, v2;
+    size_t                              i;
+
+    while (len && ((uintptr_t) p & 7)) {
+        crc = _mm_crc32_u8(crc, *p++);
+        len--;
+    }
+
+    while (len >= 3 * FLV_CRC32C_STRIDE) {
+        c0 = crc;
+        c1 = 0;
+        c2 = 0;
+
+        for (i = 0; i < FLV_CRC32C_STRIDE; i += 8) {
+            memcpy(&v0, p + i, 8);
+            memcpy(&v1, p + FLV_CRC32C_STRIDE + i, 8);
+            memcpy(&v2, p + 2 * FLV_CRC32C_STRIDE + i, 8);
+
+            c0 = _mm_crc32_u64(c0, v0);
+            c1 = _mm_crc32_u64(c1, v1);
+            c2 = _mm_crc32_u64(c2, v2);
+        }
+
+        crc = flv_crc32c_shift_stride((u_int32_t) c0) ^ (u_int32_t) c1;
+        crc = flv_crc32c_shift_stride(crc) ^ (u_int32_t) c2;
+
+        p += 3 * FLV_CRC32C_STRIDE;
+        len -= 3 * FLV_CRC32C_STRIDE;
+    }
+
+    c0 = crc;
+
+    while (len >= 8) {
+        memcpy(&v0, p, 8);
+        c0 = _mm_crc32_u64(c0, v0);
+        p += 8;
+        len -= 8;
+    }
+
+    crc = (u_int32_t) c0;
+
+    while (len--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+
+    return crc;
+}
+
+#endif
+
+
+u_int32_t
+flv_crc32c(u_int32_t crc, const u_char *p, size_t len)
+{
+    pthread_once(&flv_crc32c_once, flv_crc32c_init);
+
+    crc = ~crc;
+
+#ifdef FLV_CRC32C_SSE42
+    if (flv_crc32c_hw) {
+        return ~flv_crc32c_sse42(crc, p, len);
+    }
+#endif
+
+    return ~flv_crc32c_sw(crc, p, len);
+}
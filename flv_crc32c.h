@@ -0,0 +1,17 @@
+/*
+ * CRC32C (Castagnoli) of the written bytes, SSE4.2 crc32 when the cpu
+ * has it and slicing by 8 tables otherwise.
+ */
+
+
+#ifndef _FLV_CRC32C_H_INCLUDED_
+#define _FLV_CRC32C_H_INCLUDED_
+
+#include "common.h"
+
+
+/* crc of the bytes before, 0 to start */
+u_int32_t flv_crc32c(u_int32_t crc, const u_char *p, size_t len);
+
+
+#endif /* _FLV_CRC32C_H_INCLUDED_ */
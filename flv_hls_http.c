@@ -0,0 +1,923 @@
+#include "flv_hls_http.h"
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <signal.h>
+
+
+#define FLV_HLS_HTTP_HEADER_MAX     4096
+#define FLV_HLS_HTTP_EVENTS         256
+#define FLV_HLS_HTTP_BACKLOG        1024
+
+#define FLV_HLS_HTTP_PLAYLIST       1
+#define FLV_HLS_HTTP_SEGMENT        2
+#define FLV_HLS_HTTP_PART           3
+#define FLV_HLS_HTTP_INIT           4
+#define FLV_HLS_HTTP_FILE           5
+#define FLV_HLS_HTTP_IFRAMES        6
+
+/* the request is parked until the snapshot is ready */
+#define FLV_HLS_HTTP_BLOCKED        1
+
+
+typedef struct flv_hls_http_conn_s {
+    int                                 fd;
+
+    char                                in[FLV_HLS_HTTP_HEADER_MAX];
+    size_t                              nin;
+    size_t                              req_len;
+
+    char                                out[512];
+    size_t                              nout;
+    size_t                              out_pos;
+
+    /* body from memory, the parts of a segment */
+    hls_buf_t                           *body[HLS_STORE_MAX_PARTS];
+    u_int32_t                           nbody;
+    off_t                               body_pos;
+    off_t                               body_end;
+
+    /* body from disk */
+    int                                 file;
+    off_t                               file_pos;
+    off_t                               file_end;
+
+    /* the parsed request */
+    int                                 kind;
+    u_int64_t                           id;
+    u_int32_t                           part;
+    char                                path[256];
+    char                                range[64];
+
+    /* LL-HLS blocking reload, _HLS_msn and _HLS_part */
+    u_int64_t                           msn;
+    u_int32_t                           msn_part;
+    int64_t                             deadline;
+    struct flv_hls_http_conn_s          *next_blocked;
+
+    unsigned                            head:1;
+    unsigned                            mp4:1;
+    unsigned                            block:1;
+    unsigned                            skip:1;  /* _HLS_skip delta update */
+    unsigned                            keepalive:1;
+    unsigned                            writing:1;
+} flv_hls_http_conn_t;
+
+
+struct flv_hls_http_s {
+    int                                 lfd;
+    int                                 ep;
+    int                                 efd;     /* stop */
+    int                                 nfd;     /* store published */
+    pthread_t                           tid;
+    hls_store_t                         *store;
+    int                                 reader;
+    int                                 block_ms;
+    flv_hls_http_conn_t                 *blocked;
+};
+
+
+static int64_t
+flv_hls_http_msec()
+{
+    struct timespec                     ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+static void
+flv_hls_http_release(flv_hls_http_conn_t *c)
+{
+    u_int32_t                           i;
+
+    for (i = 0; i < c->nbody; i++) {
+        hls_buf_unref(c->body[i]);
+    }
+    c->nbody = 0;
+
+    if (c->file != -1) {
+        close(c->file);
+        c->file = -1;
+    }
+}
+
+
+static void
+flv_hls_http_unblock(flv_hls_http_t *http, flv_hls_http_conn_t *c)
+{
+    flv_hls_http_conn_t                 **pp;
+
+    for (pp = &http->blocked; *pp; pp = &(*pp)->next_blocked) {
+        if (*pp == c) {
+            *pp = c->next_blocked;
+            break;
+        }
+    }
+
+    c->next_blocked = NULL;
+}
+
+
+static void
+flv_hls_http_close(flv_hls_http_t *http, flv_hls_http_conn_t *c)
+{
+    epoll_ctl(http->ep, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+
+    flv_hls_http_unblock(http, c);
+    flv_hls_http_release(c);
+
+    delete c;
+}
+
+
+static void
+flv_hls_http_reset(flv_hls_http_conn_t *c)
+{
+    flv_hls_http_release(c);
+
+    /* keep the pipelined bytes of next request */
+    memmove(c->in, c->in + c->req_len, c->nin - c->req_len);
+    c->nin -= c->req_len;
+    c->req_len = 0;
+
+    c->nout = c->out_pos = 0;
+    c->writing = 0;
+}
+
+
+static char *
+flv_hls_http_header(char *req, const char *name)
+{
+    char                                *p;
+    size_t                              n;
+
+    n = strlen(name);
+
+    for (p = strstr(req, "\r\n"); p; p = strstr(p, "\r\n")) {
+        p += 2;
+        if (strncasecmp(p, name, n) == 0 && p[n] == ':') {
+            for (p += n + 1; *p == ' ' || *p == '\t'; p++) {
+            }
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+
+static char *
+flv_hls_http_arg(char *query, const char *name)
+{
+    char                                *p;
+    size_t                              n;
+
+    n = strlen(name);
+
+    for (p = query; p; p = strchr(p, '&')) {
+        if (*p == '&') {
+            p++;
+        }
+        if (strncmp(p, name, n) == 0 && p[n] == '=') {
+            return p + n + 1;
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * parse single range of "bytes=a-b", "bytes=a-" and "bytes=-n".
+ * @return 0 for full body, 1 for range, -1 not satisfiable.
+ */
+static int
+flv_hls_http_range(char *value, off_t size, off_t *start, off_t *end)
+{
+    char                                *p;
+    long long                           a, b;
+
+    if (value == NULL || strncmp(value, "bytes=", 6) != 0) {
+        return 0;
+    }
+
+    p = value + 6;
+
+    if (*p == '-') {
+        b = strtoll(p + 1, NULL, 10);
+        if (b <= 0) {
+            return -1;
+        }
+        *start = (b > size) ? 0 : size - b;
+        *end = size;
+        return 1;
+    }
+
+    a = strtoll(p, &p, 10);
+    if (*p != '-' || a >= size) {
+        return -1;
+    }
+
+    p++;
+    b = (*p >= '0' && *p <= '9') ? strtoll(p, NULL, 10) + 1 : size;
+    if (b > size) {
+        b = size;
+    }
+    if (b <= a) {
+        return -1;
+    }
+
+    *start = a;
+    *end = b;
+    return 1;
+}
+
+
+/* "/N.ts" for segment, "/N.P.ts" for LL-HLS part, or ".m4s" for fmp4 */
+static int
+flv_hls_http_media(flv_hls_http_conn_t *c, const char *uri)
+{
+    const char                          *p;
+
+    p = uri + 1;
+    if (*p < '0' || *p > '9') {
+        return ERROR_NORMAL;
+    }
+
+    c->id = strtoull(p, (char **) &p, 10);
+    c->kind = FLV_HLS_HTTP_SEGMENT;
+
+    if (*p == '.' && p[1] >= '0' && p[1] <= '9') {
+        c->part = (u_int32_t) strtoul(p + 1, (char **) &p, 10);
+        c->kind = FLV_HLS_HTTP_PART;
+    }
+
+    c->mp4 = (strcmp(p, ".m4s") == 0);
+
+    return (c->mp4 || strcmp(p, ".ts") == 0) ? SUCCESS : ERROR_NORMAL;
+}
+
+
+static void
+flv_hls_http_status(flv_hls_http_conn_t *c, int status, const char *reason)
+{
+    c->nout = snprintf(c->out, sizeof(c->out),
+                       "HTTP/1.1 %d %s\r\n"
+                       "Server: flv2hls\r\n"
+                       "Content-Length: 0\r\n"
+                       "Connection: %s\r\n\r\n",
+                       status, reason, c->keepalive ? "keep-alive" : "close");
+}
+
+
+/*
+ * parse the request line and headers, the error status response
+ * is ready in out buffer when failed.
+ */
+static int
+flv_hls_http_parse(flv_hls_http_t *http, flv_hls_http_conn_t *c)
+{
+    char                                *req, *uri, *p, *v, *query;
+
+    req = c->in;
+    c->in[c->req_len - 1] = 0;
+
+    c->kind = 0;
+    c->mp4 = 0;
+    c->block = 0;
+    c->skip = 0;
+    c->range[0] = 0;
+
+    c->head = (strncmp(req, "HEAD ", 5) == 0);
+    if (!c->head && strncmp(req, "GET ", 4) != 0) {
+        c->keepalive = 0;
+        flv_hls_http_status(c, 405, "Method Not Allowed");
+        return ERROR_NORMAL;
+    }
+
+    uri = strchr(req, ' ') + 1;
+    p = strchr(uri, ' ');
+    if (p == NULL || *uri != '/') {
+        c->keepalive = 0;
+        flv_hls_http_status(c, 400, "Bad Request");
+        return ERROR_NORMAL;
+    }
+    *p++ = 0;
+
+    /* HTTP/1.1 keep-alive by default, HTTP/1.0 only when asked */
+    v = flv_hls_http_header(p, "Connection");
+    if (strncmp(p, "HTTP/1.1", 8) == 0) {
+        c->keepalive = !(v && strncasecmp(v, "close", 5) == 0);
+    } else {
+        c->keepalive = (v && strncasecmp(v, "keep-alive", 10) == 0);
+    }
+
+    if ((v = flv_hls_http_header(p, "Range")) != NULL) {
+        snprintf(c->range, sizeof(c->range), "%.*s",
+                 (int) strcspn(v, "\r\n"), v);
+    }
+
+    query = strchr(uri, '?');
+    if (query) {
+        *query++ = 0;
+    }
+
+    snprintf(c->path, sizeof(c->path), "%s%s",
+             http->store->root.c_str(), uri + 1);
+
+    if (strcmp(uri + 1, http->store->playlist_name.c_str()) == 0) {
+        c->kind = FLV_HLS_HTTP_PLAYLIST;
+
+        if (query && (v = flv_hls_http_arg(query, "_HLS_msn")) != NULL) {
+            c->block = 1;
+            c->msn = strtoull(v, NULL, 10);
+            v = flv_hls_http_arg(query, "_HLS_part");
+            c->msn_part = v ? (u_int32_t) strtoul(v, NULL, 10) : 0;
+        }
+
+        /* no date ranges, "v2" is the same delta as "YES" */
+        if (query && (v = flv_hls_http_arg(query, "_HLS_skip")) != NULL) {
+            c->skip = (strncmp(v, "YES", 3) == 0 || strncmp(v, "v2", 2) == 0);
+        }
+
+    } else if (!http->store->iframes_name.empty()
+               && strcmp(uri + 1, http->store->iframes_name.c_str()) == 0)
+    {
+        c->kind = FLV_HLS_HTTP_IFRAMES;
+
+    } else if (!http->store->init_name.empty()
+               && strcmp(uri + 1, http->store->init_name.c_str()) == 0)
+    {
+        c->kind = FLV_HLS_HTTP_INIT;
+        c->mp4 = 1;
+
+    } else if (!http->store->single_name.empty()
+               && strcmp(uri + 1, http->store->single_name.c_str()) == 0)
+    {
+        /* all fragments in one file, requested by byte ranges */
+        c->kind = FLV_HLS_HTTP_FILE;
+        c->mp4 = (strstr(uri, ".m4s") != NULL);
+
+    } else if (flv_hls_http_media(c, uri) != SUCCESS) {
+        flv_hls_http_status(c, 404, "Not Found");
+        return ERROR_NORMAL;
+    }
+
+    /* preload hint of a part not yet ready, wait for it */
+    if (c->kind == FLV_HLS_HTTP_PART) {
+        c->block = 1;
+        c->msn = c->id;
+        c->msn_part = c->part;
+    }
+
+    c->deadline = flv_hls_http_msec() + http->block_ms;
+
+    return SUCCESS;
+}
+
+
+/*
+ * get the body from snapshot and make the response header.
+ * @return FLV_HLS_HTTP_BLOCKED when the snapshot is not ready.
+ */
+static int
+flv_hls_http_respond(flv_hls_http_t *http, flv_hls_http_conn_t *c)
+{
+    hls_snap_t                          *snap;
+    const char                          *type, *cache;
+    int                                 rc;
+    off_t                               size, start, end;
+    u_int32_t                           i;
+    struct stat                         st;
+
+    snap = hls_store_enter(http->store, http->reader);
+
+    if (c->block && !hls_snap_ready(snap, c->msn, c->msn_part)) {
+
+        /* too far in future, never block for it */
+        if (snap->nsegs && c->msn > snap->segs[snap->nsegs - 1].id + 2) {
+            hls_store_leave(http->store, http->reader);
+            flv_hls_http_status(c, 400, "Bad Request");
+            return SUCCESS;
+        }
+
+        hls_store_leave(http->store, http->reader);
+        return FLV_HLS_HTTP_BLOCKED;
+    }
+
+    switch (c->kind) {
+
+    case FLV_HLS_HTTP_PLAYLIST:
+        c->body[0] = hls_buf_ref(c->skip && snap->delta ? snap->delta
+                                                        : snap->playlist);
+        c->nbody = c->body[0] ? 1 : 0;
+        break;
+
+    case FLV_HLS_HTTP_PART:
+        c->body[0] = hls_snap_part(snap, c->id, c->part);
+        c->nbody = c->body[0] ? 1 : 0;
+        break;
+
+    case FLV_HLS_HTTP_INIT:
+        c->body[0] = hls_buf_ref(snap->init);
+        c->nbody = c->body[0] ? 1 : 0;
+        break;
+
+    case FLV_HLS_HTTP_IFRAMES:
+        c->body[0] = hls_buf_ref(snap->iframes);
+        c->nbody = c->body[0] ? 1 : 0;
+        break;
+
+    default:
+        c->nbody = hls_snap_segment(snap, c->id, c->body);
+        break;
+    }
+
+    hls_store_leave(http->store, http->reader);
+
+    if (c->kind == FLV_HLS_HTTP_PLAYLIST || c->kind == FLV_HLS_HTTP_IFRAMES) {
+        type = "application/vnd.apple.mpegurl";
+        cache = "no-cache";
+    } else {
+        type = c->mp4 ? "video/mp4" : "video/mp2t";
+        cache = "max-age=3600";
+    }
+
+    /* evicted from memory, send from disk */
+    if (c->nbody == 0
+        && (c->kind == FLV_HLS_HTTP_SEGMENT || c->kind == FLV_HLS_HTTP_FILE))
+    {
+        c->file = open(c->path, O_RDONLY);
+        if (c->file != -1 && fstat(c->file, &st) != 0) {
+            close(c->file);
+            c->file = -1;
+        }
+    }
+
+    if (c->nbody == 0 && c->file == -1) {
+        flv_hls_http_status(c, 404, "Not Found");
+        return SUCCESS;
+    }
+
+    size = 0;
+    for (i = 0; i < c->nbody; i++) {
+        size += c->body[i]->len;
+    }
+    if (c->file != -1) {
+        size = st.st_size;
+    }
+
+    start = 0;
+    end = size;
+
+    rc = flv_hls_http_range(c->range[0] ? c->range : NULL, size,
+                            &start, &end);
+    if (rc < 0) {
+        flv_hls_http_release(c);
+
+        c->nout = snprintf(c->out, sizeof(c->out),
+                           "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                           "Server: flv2hls\r\n"
+                           "Content-Range: bytes */%lld\r\n"
+                           "Content-Length: 0\r\n"
+                           "Connection: %s\r\n\r\n",
+                           (long long) size,
+                           c->keepalive ? "keep-alive" : "close");
+        return SUCCESS;
+    }
+
+    c->nout = snprintf(c->out, sizeof(c->out),
+                       "HTTP/1.1 %s\r\n"
+                       "Server: flv2hls\r\n"
+                       "Content-Type: %s\r\n"
+                       "Content-Length: %lld\r\n"
+                       "Accept-Ranges: bytes\r\n"
+                       "Cache-Control: %s\r\n"
+                       "Connection: %s\r\n",
+                       rc ? "206 Partial Content" : "200 OK", type,
+                       (long long) (end - start), cache,
+                       c->keepalive ? "keep-alive" : "close");
+
+    if (rc) {
+        c->nout += snprintf(c->out + c->nout, sizeof(c->out) - c->nout,
+                            "Content-Range: bytes %lld-%lld/%lld\r\n",
+                            (long long) start, (long long) end - 1,
+                            (long long) size);
+    }
+
+    c->nout += snprintf(c->out + c->nout, sizeof(c->out) - c->nout, "\r\n");
+
+    if (c->head) {
+        start = end;
+    }
+
+    c->body_pos = c->file_pos = start;
+    c->body_end = c->file_end = end;
+
+    return SUCCESS;
+}
+
+
+/*
+ * @return error when connection should be closed,
+ *       EAGAIN when waiting for writable.
+ */
+static int
+flv_hls_http_send(flv_hls_http_conn_t *c)
+{
+    struct iovec                        iov[HLS_STORE_MAX_PARTS + 1];
+    struct msghdr                       msg;
+    int                                 n;
+    u_int32_t                           i;
+    off_t                               pos, len, from, to;
+    ssize_t                             rc;
+
+    while (c->out_pos < c->nout
+           || (c->nbody && c->body_pos < c->body_end))
+    {
+        n = 0;
+        if (c->out_pos < c->nout) {
+            iov[n].iov_base = c->out + c->out_pos;
+            iov[n].iov_len = c->nout - c->out_pos;
+            n++;
+        }
+
+        /* the slices of parts in [body_pos, body_end) */
+        for (i = 0, pos = 0; i < c->nbody && pos < c->body_end; i++) {
+            len = c->body[i]->len;
+
+            if (pos + len > c->body_pos) {
+                from = c->body_pos > pos ? c->body_pos - pos : 0;
+                to = c->body_end < pos + len ? c->body_end - pos : len;
+
+                iov[n].iov_base = c->body[i]->data + from;
+                iov[n].iov_len = to - from;
+                n++;
+            }
+
+            pos += len;
+        }
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n;
+
+        rc = sendmsg(c->fd, &msg, MSG_NOSIGNAL);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN ? EAGAIN : ERROR_SOCKET_WRITE;
+        }
+
+        if (c->out_pos < c->nout) {
+            n = (size_t) rc < c->nout - c->out_pos ? rc : c->nout - c->out_pos;
+            c->out_pos += n;
+            rc -= n;
+        }
+        c->body_pos += rc;
+    }
+
+    while (c->file != -1 && c->file_pos < c->file_end) {
+        rc = sendfile(c->fd, c->file, &c->file_pos, c->file_end - c->file_pos);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN ? EAGAIN : ERROR_SOCKET_WRITE;
+        }
+        if (rc == 0) {
+            return ERROR_SOCKET_WRITE;
+        }
+    }
+
+    return SUCCESS;
+}
+
+
+static void
+flv_hls_http_handle(flv_hls_http_t *http, flv_hls_http_conn_t *c)
+{
+    struct epoll_event                  ev;
+    char                                *p;
+    ssize_t                             n;
+    int                                 rc;
+
+    for ( ;; ) {
+
+        if (c->writing) {
+            rc = flv_hls_http_send(c);
+
+            if (rc == EAGAIN) {
+                ev.events = EPOLLOUT;
+                ev.data.ptr = c;
+                epoll_ctl(http->ep, EPOLL_CTL_MOD, c->fd, &ev);
+                return;
+            }
+
+            if (rc != SUCCESS || !c->keepalive) {
+                flv_hls_http_close(http, c);
+                return;
+            }
+
+            flv_hls_http_reset(c);
+
+            ev.events = EPOLLIN;
+            ev.data.ptr = c;
+            epoll_ctl(http->ep, EPOLL_CTL_MOD, c->fd, &ev);
+        }
+
+        /* a complete request, maybe pipelined */
+        c->in[c->nin] = 0;
+        p = strstr(c->in, "\r\n\r\n");
+
+        if (p) {
+            c->req_len = p + 4 - c->in;
+
+            if (flv_hls_http_parse(http, c) == SUCCESS
+                && flv_hls_http_respond(http, c) == FLV_HLS_HTTP_BLOCKED)
+            {
+                /* no more read until the response is sent */
+                ev.events = 0;
+                ev.data.ptr = c;
+                epoll_ctl(http->ep, EPOLL_CTL_MOD, c->fd, &ev);
+
+                c->next_blocked = http->blocked;
+                http->blocked = c;
+                return;
+            }
+
+            c->writing = 1;
+            continue;
+        }
+
+        if (c->nin >= sizeof(c->in) - 1) {
+            flv_hls_http_close(http, c);
+            return;
+        }
+
+        n = recv(c->fd, c->in + c->nin, sizeof(c->in) - 1 - c->nin, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN) {
+            return;
+        }
+        if (n <= 0) {
+            flv_hls_http_close(http, c);
+            return;
+        }
+
+        c->nin += n;
+    }
+}
+
+
+/* retry the blocked requests after publish or timeout */
+static void
+flv_hls_http_wakeup(flv_hls_http_t *http)
+{
+    flv_hls_http_conn_t                 *c, *next, *ready;
+    int64_t                             now;
+
+    now = flv_hls_http_msec();
+    ready = NULL;
+
+    for (c = http->blocked; c; c = next) {
+        next = c->next_blocked;
+
+        if (now >= c->deadline) {
+            flv_hls_http_status(c, 503, "Service Unavailable");
+
+        } else if (flv_hls_http_respond(http, c) == FLV_HLS_HTTP_BLOCKED) {
+            continue;
+        }
+
+        flv_hls_http_unblock(http, c);
+        c->next_blocked = ready;
+        ready = c;
+    }
+
+    for (c = ready; c; c = next) {
+        next = c->next_blocked;
+        c->next_blocked = NULL;
+        c->writing = 1;
+        flv_hls_http_handle(http, c);
+    }
+}
+
+
+static void
+flv_hls_http_accept(flv_hls_http_t *http)
+{
+    struct epoll_event                  ev;
+    flv_hls_http_conn_t                 *c;
+    int                                 fd, on;
+
+    for ( ;; ) {
+        fd = accept4(http->lfd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
+        if (fd == -1) {
+            return;
+        }
+
+        on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        c = new flv_hls_http_conn_t;
+        memset(c, 0, sizeof(*c));
+        c->fd = fd;
+        c->file = -1;
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        if (epoll_ctl(http->ep, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            delete c;
+        }
+    }
+}
+
+
+static void *
+flv_hls_http_cycle(void *arg)
+{
+    flv_hls_http_t                      *http;
+    struct epoll_event                  events[FLV_HLS_HTTP_EVENTS];
+    u_int64_t                           v;
+    int                                 i, n;
+
+    http = (flv_hls_http_t *) arg;
+
+    for ( ;; ) {
+        n = epoll_wait(http->ep, events, FLV_HLS_HTTP_EVENTS,
+                       http->blocked ? 100 : -1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            ERROR("error: hls http epoll_wait failed, errno=%d\n", errno);
+            return NULL;
+        }
+
+        for (i = 0; i < n; i++) {
+            if (events[i].data.ptr == &http->efd) {
+                return NULL;
+            }
+
+            if (events[i].data.ptr == &http->nfd) {
+                if (read(http->nfd, &v, sizeof(v)) < 0) {
+                    DEBUG("hls http read notify failed, errno=%d\n", errno);
+                }
+                continue;
+            }
+
+            if (events[i].data.ptr == &http->lfd) {
+                flv_hls_http_accept(http);
+                continue;
+            }
+
+            flv_hls_http_handle(http,
+                                (flv_hls_http_conn_t *) events[i].data.ptr);
+        }
+
+        if (http->blocked) {
+            flv_hls_http_wakeup(http);
+        }
+    }
+
+    return NULL;
+}
+
+
+flv_hls_http_t *
+flv_hls_http_start(const char *addr, int port, hls_store_t *store,
+    int block_ms)
+{
+    flv_hls_http_t                      *http;
+    struct sockaddr_in                  sin;
+    struct epoll_event                  ev;
+    int                                 on;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    http = new flv_hls_http_t;
+    memset(http, 0, sizeof(*http));
+    http->store = store;
+    http->block_ms = block_ms;
+    http->ep = http->efd = http->nfd = -1;
+
+    http->reader = hls_store_reader(store);
+    if (http->reader == -1) {
+        ERROR("error: hls http too many store readers\n");
+        delete http;
+        return NULL;
+    }
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(port);
+    if (inet_pton(AF_INET, addr, &sin.sin_addr) != 1) {
+        ERROR("error: hls http invalid address %s\n", addr);
+        delete http;
+        return NULL;
+    }
+
+    http->lfd = socket(AF_INET, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+    if (http->lfd == -1) {
+        ERROR("error: hls http create socket failed\n");
+        delete http;
+        return NULL;
+    }
+
+    on = 1;
+    setsockopt(http->lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    if (bind(http->lfd, (struct sockaddr *) &sin, sizeof(sin)) != 0
+        || listen(http->lfd, FLV_HLS_HTTP_BACKLOG) != 0)
+    {
+        ERROR("error: hls http listen %s:%d failed, errno=%d\n",
+              addr, port, errno);
+        goto failed;
+    }
+
+    http->ep = epoll_create1(EPOLL_CLOEXEC);
+    http->efd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    http->nfd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if (http->ep == -1 || http->efd == -1 || http->nfd == -1) {
+        goto failed;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = &http->lfd;
+    epoll_ctl(http->ep, EPOLL_CTL_ADD, http->lfd, &ev);
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = &http->efd;
+    epoll_ctl(http->ep, EPOLL_CTL_ADD, http->efd, &ev);
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = &http->nfd;
+    epoll_ctl(http->ep, EPOLL_CTL_ADD, http->nfd, &ev);
+
+    store->notify = http->nfd;
+
+    if (pthread_create(&http->tid, NULL, flv_hls_http_cycle, http) != 0) {
+        store->notify = -1;
+        goto failed;
+    }
+
+    DEBUG("hls http listen on %s:%d\n", addr, port);
+
+    return http;
+
+failed:
+
+    close(http->lfd);
+    if (http->ep != -1) {
+        close(http->ep);
+    }
+    if (http->efd != -1) {
+        close(http->efd);
+    }
+    if (http->nfd != -1) {
+        close(http->nfd);
+    }
+    delete http;
+
+    return NULL;
+}
+
+
+void
+flv_hls_http_stop(flv_hls_http_t *http)
+{
+    u_int64_t                           v;
+
+    if (http == NULL) {
+        return;
+    }
+
+    http->store->notify = -1;
+
+    v = 1;
+    if (write(http->efd, &v, sizeof(v)) == sizeof(v)) {
+        pthread_join(http->tid, NULL);
+    }
+
+    /* the connections are closed with the process */
+    close(http->lfd);
+    close(http->ep);
+    close(http->efd);
+    close(http->nfd);
+
+    delete http;
+}
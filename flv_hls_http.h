@@ -0,0 +1,20 @@
+#ifndef FLV_HLS_HTTP_H
+#define FLV_HLS_HTTP_H
+
+#include "flv_hls_store.h"
+
+
+/*
+ * embedded http/1.1 origin, serves the live playlist and recent
+ * segments from the store, older segments from disk by sendfile.
+ * the LL-HLS blocking reload is held at most block_ms.
+ */
+typedef struct flv_hls_http_s flv_hls_http_t;
+
+
+flv_hls_http_t *flv_hls_http_start(const char *addr, int port,
+    hls_store_t *store, int block_ms);
+void flv_hls_http_stop(flv_hls_http_t *http);
+
+
+#endif
@@ -0,0 +1,970 @@
+#include "flv_hls_sink.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <signal.h>
+
+
+#define FLV_HLS_SINK_QUEUE          64
+#define FLV_HLS_SINK_RETRIES        3
+#define FLV_HLS_SINK_BACKOFF_MS     100
+#define FLV_HLS_SINK_TIMEOUT        5     /* seconds, http send and receive */
+#define FLV_HLS_SINK_RESPONSE_MAX   4096
+#define FLV_HLS_SINK_MEM_MAX        256
+#define FLV_HLS_SINK_UNLINK_GAP     2000  /* usec between two unlinks */
+
+
+typedef struct {
+    std::string                         path;
+    hls_buf_t                           *data;   /* NULL once superseded */
+    unsigned                            del:1;
+} flv_hls_sink_job_t;
+
+
+typedef struct {
+    std::string                         path;
+    hls_buf_t                           *data;
+    u_int64_t                           seq;     /* of the last put */
+} flv_hls_sink_obj_t;
+
+
+struct flv_hls_sink_s {
+    int                                 type;
+
+    /* the objects waiting for the thread, only deletes for the file */
+    pthread_t                           tid;
+    pthread_mutex_t                     lock;
+    pthread_cond_t                      cond;    /* queued or stopping */
+    pthread_cond_t                      room;    /* taken from the queue */
+    flv_hls_sink_job_t                  jobs[FLV_HLS_SINK_QUEUE];
+    u_int32_t                           head;
+    u_int32_t                           njobs;
+    unsigned                            started:1;
+    unsigned                            stop:1;
+    int                                 busy;    /* a job taken, not written */
+
+    /* pipe */
+    std::string                         pipe_path;
+    int                                 fd;
+
+    /* http, the connection is kept alive between objects */
+    std::string                         host;
+    std::string                         port;
+    std::string                         prefix;  /* "/" or "/p/" */
+    int                                 sock;
+
+    /* mem */
+    flv_hls_sink_obj_t                  objs[FLV_HLS_SINK_MEM_MAX];
+    u_int64_t                           seq;
+};
+
+
+static const char *
+flv_hls_sink_type(const std::string &path)
+{
+    size_t                              dot;
+    std::string                         ext;
+
+    dot = path.rfind('.');
+    ext = dot == std::string::npos ? "" : path.substr(dot + 1);
+
+    if (ext == "m3u8") {
+        return "application/vnd.apple.mpegurl";
+    }
+
+    if (ext == "ts") {
+        return "video/mp2t";
+    }
+
+    if (ext == "m4s" || ext == "mp4") {
+        return "video/mp4";
+    }
+
+    return "application/octet-stream";
+}
+
+
+static int
+flv_hls_sink_write_all(int fd, struct iovec *iov, int niov, int sock)
+{
+    struct msghdr                       msg;
+    ssize_t                             n;
+
+    while (niov > 0) {
+        if (sock) {
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = niov;
+
+            n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        } else {
+            n = writev(fd, iov, niov);
+        }
+
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return ERROR_NORMAL;
+        }
+
+        while (niov > 0 && (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            niov--;
+        }
+
+        if (niov > 0) {
+            iov->iov_base = (u_char *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+
+    return SUCCESS;
+}
+
+
+/* the name relative to the prefix, without "./" or the leading "/" */
+static const char *
+flv_hls_sink_name(const std::string &path)
+{
+    const char                          *p;
+
+    p = path.c_str();
+
+    for ( ;; ) {
+        if (p[0] == '.' && p[1] == '/') {
+            p += 2;
+        } else if (p[0] == '/') {
+            p++;
+        } else {
+            return p;
+        }
+    }
+}
+
+
+static int
+flv_hls_sink_pipe_write(flv_hls_sink_t *sink, const std::string &path,
+    hls_buf_t *data)
+{
+    char                                header[512];
+    struct iovec                        iov[2];
+    int                                 n, niov;
+
+    if (sink->fd == -1) {
+        /* a fifo blocks here until the packager reads it */
+        sink->fd = open(sink->pipe_path.c_str(),
+                        O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC, 0644);
+        if (sink->fd == -1) {
+            ERROR("error: hls sink open %s failed, errno=%d\n",
+                  sink->pipe_path.c_str(), errno);
+            return ERROR_NORMAL;
+        }
+    }
+
+    if (data) {
+        n = snprintf(header, sizeof(header), "PUT %s %zu\n",
+                     flv_hls_sink_name(path), data->len);
+        niov = 2;
+
+    } else {
+        n = snprintf(header, sizeof(header), "DELETE %s\n",
+                     flv_hls_sink_name(path));
+        niov = 1;
+    }
+
+    iov[0].iov_base = header;
+    iov[0].iov_len = n;
+
+    if (data) {
+        iov[1].iov_base = data->data;
+        iov[1].iov_len = data->len;
+    }
+
+    if (flv_hls_sink_write_all(sink->fd, iov, niov, 0) != SUCCESS) {
+        /* the reader went away, a new one starts with the next frame */
+        ERROR("error: hls sink write %s failed, errno=%d\n",
+              sink->pipe_path.c_str(), errno);
+        close(sink->fd);
+        sink->fd = -1;
+        return ERROR_NORMAL;
+    }
+
+    return SUCCESS;
+}
+
+
+static int
+flv_hls_sink_connect(flv_hls_sink_t *sink)
+{
+    struct addrinfo                     hints, *res, *ai;
+    struct timeval                      tv;
+    int                                 fd, on;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(sink->host.c_str(), sink->port.c_str(), &hints, &res)
+        != 0)
+    {
+        ERROR("error: hls sink resolve %s failed\n", sink->host.c_str());
+        return ERROR_NORMAL;
+    }
+
+    fd = -1;
+
+    for (ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype|SOCK_CLOEXEC,
+                    ai->ai_protocol);
+        if (fd == -1) {
+            continue;
+        }
+
+        tv.tv_sec = FLV_HLS_SINK_TIMEOUT;
+        tv.tv_usec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+
+        close(fd);
+        fd = -1;
+    }
+
+    freeaddrinfo(res);
+
+    if (fd == -1) {
+        ERROR("error: hls sink connect %s:%s failed, errno=%d\n",
+              sink->host.c_str(), sink->port.c_str(), errno);
+        return ERROR_NORMAL;
+    }
+
+    sink->sock = fd;
+
+    return SUCCESS;
+}
+
+
+static void
+flv_hls_sink_disconnect(flv_hls_sink_t *sink)
+{
+    if (sink->sock != -1) {
+        close(sink->sock);
+        sink->sock = -1;
+    }
+}
+
+
+/*
+ * the status of the response, the body is read past by its length.
+ * the connection is closed when it can not be used again.
+ * @return the status, -1 on error.
+ */
+static int
+flv_hls_sink_response(flv_hls_sink_t *sink)
+{
+    char                                buf[FLV_HLS_SINK_RESPONSE_MAX];
+    char                                *end, *line, *next;
+    size_t                              len;
+    ssize_t                             n;
+    long long                           body;
+    int                                 status, minor, keepalive;
+
+    len = 0;
+    end = NULL;
+
+    while (end == NULL) {
+        if (len == sizeof(buf) - 1) {
+            return -1;
+        }
+
+        n = recv(sink->sock, buf + len, sizeof(buf) - 1 - len, 0);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+
+            return -1;
+        }
+
+        len += n;
+        buf[len] = '\0';
+
+        end = strstr(buf, "\r\n\r\n");
+    }
+
+    if (sscanf(buf, "HTTP/1.%d %d", &minor, &status) != 2) {
+        return -1;
+    }
+
+    keepalive = (minor == 1);
+    body = 0;
+
+    *end = '\0';
+
+    for (line = strstr(buf, "\r\n"); line; line = next) {
+        line += 2;
+        next = strstr(line, "\r\n");
+
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            body = strtoll(line + 15, NULL, 10);
+
+        } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+            /* not worth decoding, the next object connects again */
+            keepalive = 0;
+
+        } else if (strncasecmp(line, "Connection:", 11) == 0) {
+            keepalive = (strcasestr(line + 11, "keep-alive") != NULL);
+        }
+    }
+
+    body -= len - (end + 4 - buf);
+
+    while (keepalive && body > 0) {
+        n = recv(sink->sock, buf,
+                 body < (long long) sizeof(buf) ? body : sizeof(buf), 0);
+        if (n <= 0) {
+            keepalive = 0;
+            break;
+        }
+
+        body -= n;
+    }
+
+    if (!keepalive) {
+        flv_hls_sink_disconnect(sink);
+    }
+
+    return status;
+}
+
+
+/* PUT of the data, or DELETE when there is none */
+static int
+flv_hls_sink_http_put(flv_hls_sink_t *sink, const std::string &path,
+    hls_buf_t *data)
+{
+    char                                header[1024];
+    struct iovec                        iov[2];
+    int                                 n, niov, status;
+
+    if (sink->sock == -1 && flv_hls_sink_connect(sink) != SUCCESS) {
+        return ERROR_NORMAL;
+    }
+
+    if (data) {
+        n = snprintf(header, sizeof(header),
+                     "PUT %s%s HTTP/1.1\r\n"
+                     "Host: %s\r\n"
+                     "Content-Type: %s\r\n"
+                     "Content-Length: %zu\r\n"
+                     "\r\n",
+                     sink->prefix.c_str(), flv_hls_sink_name(path),
+                     sink->host.c_str(), flv_hls_sink_type(path), data->len);
+        niov = 2;
+
+    } else {
+        n = snprintf(header, sizeof(header),
+                     "DELETE %s%s HTTP/1.1\r\n"
+                     "Host: %s\r\n"
+                     "\r\n",
+                     sink->prefix.c_str(), flv_hls_sink_name(path),
+                     sink->host.c_str());
+        niov = 1;
+    }
+
+    if (n >= (int) sizeof(header)) {
+        ERROR("error: hls sink name too long %s\n", path.c_str());
+        return ERROR_NORMAL;
+    }
+
+    iov[0].iov_base = header;
+    iov[0].iov_len = n;
+
+    if (data) {
+        iov[1].iov_base = data->data;
+        iov[1].iov_len = data->len;
+    }
+
+    if (flv_hls_sink_write_all(sink->sock, iov, niov, 1) != SUCCESS) {
+        flv_hls_sink_disconnect(sink);
+        return ERROR_NORMAL;
+    }
+
+    status = flv_hls_sink_response(sink);
+
+    /* already gone is as good as deleted */
+    if (data == NULL && status == 404) {
+        return SUCCESS;
+    }
+
+    if (status < 200 || status > 299) {
+        ERROR("error: hls sink %s %s status %d\n", data ? "PUT" : "DELETE",
+              path.c_str(), status);
+        if (status == -1) {
+            flv_hls_sink_disconnect(sink);
+        }
+        return ERROR_NORMAL;
+    }
+
+    return SUCCESS;
+}
+
+
+static void
+flv_hls_sink_upload(flv_hls_sink_t *sink, const std::string &path,
+    hls_buf_t *data)
+{
+    int                                 i, rc, ms;
+
+    /* the file sink only has deletes queued */
+    if (sink->type == FLV_HLS_SINK_FILE) {
+        if (unlink(path.c_str()) != 0 && errno != ENOENT) {
+            ERROR("error: hls unlink %s failed, errno=%d\n", path.c_str(),
+                  errno);
+        }
+
+        usleep(FLV_HLS_SINK_UNLINK_GAP);
+
+        return;
+    }
+
+    ms = FLV_HLS_SINK_BACKOFF_MS;
+
+    for (i = 0; ; i++) {
+        if (sink->type == FLV_HLS_SINK_PIPE) {
+            rc = flv_hls_sink_pipe_write(sink, path, data);
+        } else {
+            rc = flv_hls_sink_http_put(sink, path, data);
+        }
+
+        if (rc == SUCCESS) {
+            return;
+        }
+
+        if (i == FLV_HLS_SINK_RETRIES) {
+            break;
+        }
+
+        DEBUG("hls sink %s failed, retry in %dms\n", path.c_str(), ms);
+
+        usleep(ms * 1000);
+        ms *= 2;
+    }
+
+    ERROR("error: hls sink dropped %s after %d attempts\n", path.c_str(),
+          FLV_HLS_SINK_RETRIES + 1);
+}
+
+
+static void *
+flv_hls_sink_cycle(void *arg)
+{
+    flv_hls_sink_t                      *sink;
+    flv_hls_sink_job_t                  *job;
+    std::string                         path;
+    hls_buf_t                           *data;
+    unsigned                            del;
+
+    sink = (flv_hls_sink_t *) arg;
+
+    pthread_mutex_lock(&sink->lock);
+
+    for ( ;; ) {
+        while (sink->njobs == 0 && !sink->stop) {
+            pthread_cond_wait(&sink->cond, &sink->lock);
+        }
+
+        /* stopped, and everything queued is written */
+        if (sink->njobs == 0) {
+            break;
+        }
+
+        job = &sink->jobs[sink->head];
+        path.swap(job->path);
+        data = job->data;
+        del = job->del;
+        job->data = NULL;
+        job->del = 0;
+
+        sink->head = (sink->head + 1) % FLV_HLS_SINK_QUEUE;
+        sink->njobs--;
+        sink->busy = 1;
+
+        pthread_cond_signal(&sink->room);
+        pthread_mutex_unlock(&sink->lock);
+
+        if (data || del) {
+            flv_hls_sink_upload(sink, path, data);
+            hls_buf_unref(data);
+        }
+
+        pthread_mutex_lock(&sink->lock);
+
+        sink->busy = 0;
+
+        /* flush waits for the queue to be written */
+        if (sink->njobs == 0) {
+            pthread_cond_broadcast(&sink->room);
+        }
+    }
+
+    pthread_mutex_unlock(&sink->lock);
+
+    return NULL;
+}
+
+
+/*
+ * in the order of the puts, so that a playlist follows the segments
+ * it lists. a playlist still queued is dropped for the newer one.
+ */
+static void
+flv_hls_sink_enqueue(flv_hls_sink_t *sink, const char *path, hls_buf_t *data,
+    unsigned del)
+{
+    flv_hls_sink_job_t                  *job;
+    u_int32_t                           i;
+
+    pthread_mutex_lock(&sink->lock);
+
+    if (!sink->started) {
+        if (pthread_create(&sink->tid, NULL, flv_hls_sink_cycle, sink) != 0) {
+            pthread_mutex_unlock(&sink->lock);
+            ERROR("error: hls sink create thread failed\n");
+            hls_buf_unref(data);
+            return;
+        }
+
+        sink->started = 1;
+    }
+
+    for (i = 0; i < sink->njobs; i++) {
+        job = &sink->jobs[(sink->head + i) % FLV_HLS_SINK_QUEUE];
+
+        if (job->data && job->path == path) {
+            hls_buf_unref(job->data);
+            job->data = NULL;
+        }
+    }
+
+    /* the remuxer waits for the uploads to keep up */
+    while (sink->njobs == FLV_HLS_SINK_QUEUE) {
+        pthread_cond_wait(&sink->room, &sink->lock);
+    }
+
+    job = &sink->jobs[(sink->head + sink->njobs) % FLV_HLS_SINK_QUEUE];
+    job->path = path;
+    job->data = data;
+    job->del = del;
+    sink->njobs++;
+
+    pthread_cond_signal(&sink->cond);
+    pthread_mutex_unlock(&sink->lock);
+}
+
+
+static void
+flv_hls_sink_mem_put(flv_hls_sink_t *sink, const char *path, hls_buf_t *data)
+{
+    flv_hls_sink_obj_t                  *o, *oldest;
+    u_int32_t                           i;
+
+    pthread_mutex_lock(&sink->lock);
+
+    o = NULL;
+    oldest = &sink->objs[0];
+
+    for (i = 0; i < FLV_HLS_SINK_MEM_MAX; i++) {
+        if (sink->objs[i].data && sink->objs[i].path == path) {
+            o = &sink->objs[i];
+            break;
+        }
+
+        if (sink->objs[i].seq < oldest->seq) {
+            oldest = &sink->objs[i];
+        }
+    }
+
+    /* a new one takes the place of the least recently put */
+    if (o == NULL) {
+        o = oldest;
+        o->path = path;
+    }
+
+    hls_buf_unref(o->data);
+    o->data = data;
+    o->seq = ++sink->seq;
+
+    pthread_mutex_unlock(&sink->lock);
+}
+
+
+hls_buf_t *
+flv_hls_sink_get(flv_hls_sink_t *sink, const char *path)
+{
+    hls_buf_t                           *data;
+    u_int32_t                           i;
+
+    data = NULL;
+
+    pthread_mutex_lock(&sink->lock);
+
+    for (i = 0; i < FLV_HLS_SINK_MEM_MAX; i++) {
+        if (sink->objs[i].data && sink->objs[i].path == path) {
+            data = hls_buf_ref(sink->objs[i].data);
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&sink->lock);
+
+    return data;
+}
+
+
+int
+flv_hls_sink_put(flv_hls_sink_t *sink, const char *path, hls_buf_t *data)
+{
+    struct iovec                        iov;
+    int                                 rc;
+
+    switch (sink->type) {
+
+    case FLV_HLS_SINK_FILE:
+        iov.iov_base = data->data;
+        iov.iov_len = data->len;
+
+        rc = flv_hls_sink_writev(sink, path, NULL, &iov, 1, 0);
+        hls_buf_unref(data);
+
+        return rc;
+
+    case FLV_HLS_SINK_MEM:
+        flv_hls_sink_mem_put(sink, path, data);
+        return SUCCESS;
+
+    default:
+        flv_hls_sink_enqueue(sink, path, data, 0);
+        return SUCCESS;
+    }
+}
+
+
+void
+flv_hls_sink_flush(flv_hls_sink_t *sink)
+{
+    if (sink->type == FLV_HLS_SINK_MEM) {
+        return;
+    }
+
+    pthread_mutex_lock(&sink->lock);
+
+    while (sink->started && (sink->njobs || sink->busy)) {
+        pthread_cond_wait(&sink->room, &sink->lock);
+    }
+
+    pthread_mutex_unlock(&sink->lock);
+}
+
+
+void
+flv_hls_sink_delete(flv_hls_sink_t *sink, const char *path)
+{
+    u_int32_t                           i;
+
+    if (sink->type != FLV_HLS_SINK_MEM) {
+        flv_hls_sink_enqueue(sink, path, NULL, 1);
+        return;
+    }
+
+    pthread_mutex_lock(&sink->lock);
+
+    for (i = 0; i < FLV_HLS_SINK_MEM_MAX; i++) {
+        if (sink->objs[i].data && sink->objs[i].path == path) {
+            hls_buf_unref(sink->objs[i].data);
+            sink->objs[i].data = NULL;
+            sink->objs[i].seq = 0;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&sink->lock);
+}
+
+
+/* the directory entry of path, after a rename in it */
+static int
+flv_hls_sink_sync_dir(const char *path)
+{
+    const char                          *slash;
+    std::string                         dir;
+    int                                 fd, rc;
+
+    slash = strrchr(path, '/');
+    dir = slash ? std::string(path, slash - path + 1) : ".";
+
+    fd = open(dir.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (fd == -1) {
+        ERROR("error: hls open dir %s failed\n", dir.c_str());
+        return ERROR_NORMAL;
+    }
+
+    rc = fsync(fd);
+    close(fd);
+
+    if (rc != 0) {
+        ERROR("error: hls sync dir %s failed\n", dir.c_str());
+        return ERROR_NORMAL;
+    }
+
+    return SUCCESS;
+}
+
+
+int
+flv_hls_sink_rename(flv_hls_sink_t *sink, const char *from, const char *to,
+    unsigned flags)
+{
+    /* the others got the object whole by put */
+    if (!flv_hls_sink_local(sink)) {
+        ERROR("error: hls rename %s on a sink with no files\n", from);
+        return ERROR_NORMAL;
+    }
+
+    if (rename(from, to) != 0) {
+        ERROR("error: hls rename %s failed\n", from);
+        return ERROR_NORMAL;
+    }
+
+    if (flags & FLV_HLS_SINK_SYNC) {
+        return flv_hls_sink_sync_dir(to);
+    }
+
+    return SUCCESS;
+}
+
+
+int
+flv_hls_sink_writev(flv_hls_sink_t *sink, const char *path, const char *bak,
+    struct iovec *iov, int niov, unsigned flags)
+{
+    hls_buf_t                           *data;
+    size_t                              size;
+    ssize_t                             n;
+    int                                 fd, i;
+
+    size = 0;
+    for (i = 0; i < niov; i++) {
+        size += iov[i].iov_len;
+    }
+
+    if (sink->type != FLV_HLS_SINK_FILE) {
+        data = hls_buf_create(size);
+        if (data == NULL) {
+            return ERROR_NORMAL;
+        }
+
+        for (i = 0; i < niov; i++) {
+            hls_buf_append(data, (u_char *) iov[i].iov_base, iov[i].iov_len);
+        }
+
+        return flv_hls_sink_put(sink, path, data);
+    }
+
+    fd = open(bak ? bak : path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (fd == -1) {
+        ERROR("error: hls open %s failed\n", bak ? bak : path);
+        return ERROR_NORMAL;
+    }
+
+    n = writev(fd, iov, niov);
+
+    if ((flags & FLV_HLS_SINK_SYNC) && n == (ssize_t) size
+        && fdatasync(fd) != 0)
+    {
+        n = -1;
+    }
+
+    close(fd);
+
+    if (n != (ssize_t) size) {
+        ERROR("error: hls write %s failed\n", bak ? bak : path);
+        return ERROR_NORMAL;
+    }
+
+    /* readers see the old or the new object, never a partial one */
+    if (bak) {
+        return flv_hls_sink_rename(sink, bak, path, flags);
+    }
+
+    if (flags & FLV_HLS_SINK_SYNC) {
+        return flv_hls_sink_sync_dir(path);
+    }
+
+    return SUCCESS;
+}
+
+
+int
+flv_hls_sink_local(flv_hls_sink_t *sink)
+{
+    return sink->type == FLV_HLS_SINK_FILE;
+}
+
+
+static int
+flv_hls_sink_parse_http(flv_hls_sink_t *sink, const char *url)
+{
+    const char                          *host, *slash, *colon;
+
+    host = url + sizeof("http://") - 1;
+
+    slash = strchr(host, '/');
+    if (slash == NULL) {
+        slash = host + strlen(host);
+    }
+
+    colon = (const char *) memchr(host, ':', slash - host);
+
+    if (colon) {
+        sink->host.assign(host, colon - host);
+        sink->port.assign(colon + 1, slash - colon - 1);
+    } else {
+        sink->host.assign(host, slash - host);
+        sink->port = "80";
+    }
+
+    if (sink->host.empty() || sink->port.empty()) {
+        return ERROR_NORMAL;
+    }
+
+    sink->prefix = *slash ? slash : "/";
+    if (sink->prefix[sink->prefix.size() - 1] != '/') {
+        sink->prefix += '/';
+    }
+
+    return SUCCESS;
+}
+
+
+flv_hls_sink_t *
+flv_hls_sink_create(const char *url)
+{
+    flv_hls_sink_t                      *sink;
+    u_int32_t                           i;
+
+    sink = new flv_hls_sink_t;
+
+    sink->head = 0;
+    sink->njobs = 0;
+    sink->started = 0;
+    sink->stop = 0;
+    sink->busy = 0;
+    sink->fd = -1;
+    sink->sock = -1;
+    sink->seq = 0;
+
+    for (i = 0; i < FLV_HLS_SINK_QUEUE; i++) {
+        sink->jobs[i].data = NULL;
+        sink->jobs[i].del = 0;
+    }
+
+    for (i = 0; i < FLV_HLS_SINK_MEM_MAX; i++) {
+        sink->objs[i].data = NULL;
+        sink->objs[i].seq = 0;
+    }
+
+    pthread_mutex_init(&sink->lock, NULL);
+    pthread_cond_init(&sink->cond, NULL);
+    pthread_cond_init(&sink->room, NULL);
+
+    if (url == NULL || strcmp(url, "file:") == 0) {
+        sink->type = FLV_HLS_SINK_FILE;
+        return sink;
+    }
+
+    if (strcmp(url, "mem:") == 0) {
+        sink->type = FLV_HLS_SINK_MEM;
+        return sink;
+    }
+
+    if (strncmp(url, "pipe:", 5) == 0 && url[5] != '\0') {
+        sink->type = FLV_HLS_SINK_PIPE;
+        sink->pipe_path = url + 5;
+
+    } else if (strncmp(url, "http://", 7) == 0
+               && flv_hls_sink_parse_http(sink, url) == SUCCESS)
+    {
+        sink->type = FLV_HLS_SINK_HTTP;
+
+    } else {
+        ERROR("error: hls sink invalid url %s\n", url);
+        goto failed;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    /* before the thread, it reads stop next to it */
+    sink->started = 1;
+
+    if (pthread_create(&sink->tid, NULL, flv_hls_sink_cycle, sink) != 0) {
+        ERROR("error: hls sink create thread failed\n");
+        goto failed;
+    }
+
+    return sink;
+
+failed:
+
+    pthread_mutex_destroy(&sink->lock);
+    pthread_cond_destroy(&sink->cond);
+    pthread_cond_destroy(&sink->room);
+    delete sink;
+
+    return NULL;
+}
+
+
+void
+flv_hls_sink_destroy(flv_hls_sink_t *sink)
+{
+    u_int32_t                           i;
+
+    if (sink == NULL) {
+        return;
+    }
+
+    if (sink->started) {
+        pthread_mutex_lock(&sink->lock);
+        sink->stop = 1;
+        pthread_cond_signal(&sink->cond);
+        pthread_mutex_unlock(&sink->lock);
+
+        pthread_join(sink->tid, NULL);
+    }
+
+    if (sink->fd != -1) {
+        close(sink->fd);
+    }
+
+    flv_hls_sink_disconnect(sink);
+
+    for (i = 0; i < FLV_HLS_SINK_MEM_MAX; i++) {
+        hls_buf_unref(sink->objs[i].data);
+    }
+
+    pthread_mutex_destroy(&sink->lock);
+    pthread_cond_destroy(&sink->cond);
+    pthread_cond_destroy(&sink->room);
+    delete sink;
+}
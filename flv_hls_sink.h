@@ -0,0 +1,67 @@
+#ifndef FLV_HLS_SINK_H
+#define FLV_HLS_SINK_H
+
+#include "flv_hls_store.h"
+#include <sys/uio.h>
+
+
+#define FLV_HLS_SINK_FILE           1
+#define FLV_HLS_SINK_MEM            2
+#define FLV_HLS_SINK_PIPE           3
+#define FLV_HLS_SINK_HTTP           4
+
+/* the file is on disk before it is renamed, and the rename after */
+#define FLV_HLS_SINK_SYNC           0x01
+
+
+/*
+ * where the segments, playlists and keys go, by the url:
+ *
+ *   file:                 the local paths, the default
+ *   mem:                  kept in memory, see flv_hls_sink_get
+ *   pipe:path             framed "PUT name size\n" + bytes on a fifo
+ *   http://host[:port]/p  HTTP PUT of p/name to an origin
+ *
+ * pipe and http are written by a thread from a bounded queue, a put
+ * waits while the queue is full. a failed upload is retried a few
+ * times and then dropped, the stream goes on. deletes follow the puts
+ * in the same queue, the file sink unlinks from its own thread at a
+ * limited rate so that the disk is not kept busy by them.
+ */
+typedef struct flv_hls_sink_s flv_hls_sink_t;
+
+
+flv_hls_sink_t *flv_hls_sink_create(const char *url);
+
+/* waits for the queued objects to be written */
+void flv_hls_sink_destroy(flv_hls_sink_t *sink);
+
+/* whether the objects are files on the local disk */
+int flv_hls_sink_local(flv_hls_sink_t *sink);
+
+/*
+ * a whole object by its path, written to bak and renamed to the path
+ * for the file sink when bak is not NULL. put takes the reference.
+ */
+int flv_hls_sink_writev(flv_hls_sink_t *sink, const char *path,
+    const char *bak, struct iovec *iov, int niov, unsigned flags);
+int flv_hls_sink_put(flv_hls_sink_t *sink, const char *path, hls_buf_t *data);
+
+/*
+ * file sink, a complete file written under a temporary name takes
+ * its place. with FLV_HLS_SINK_SYNC the directory is synced after.
+ */
+int flv_hls_sink_rename(flv_hls_sink_t *sink, const char *from,
+    const char *to, unsigned flags);
+
+/* the objects put before are written, or dropped after the retries */
+void flv_hls_sink_flush(flv_hls_sink_t *sink);
+
+/* the object is gone, or will be once the queue is written */
+void flv_hls_sink_delete(flv_hls_sink_t *sink, const char *path);
+
+/* the last object put by the path in the mem sink, referenced */
+hls_buf_t *flv_hls_sink_get(flv_hls_sink_t *sink, const char *path);
+
+
+#endif
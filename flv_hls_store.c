@@ -0,0 +1,397 @@
+#include "flv_hls_store.h"
+
+
+hls_buf_t *
+hls_buf_create(size_t cap)
+{
+    hls_buf_t                           *b;
+
+    b = (hls_buf_t *) malloc(sizeof(hls_buf_t));
+    if (b == NULL) {
+        return NULL;
+    }
+
+    b->data = (u_char *) malloc(cap ? cap : 1);
+    if (b->data == NULL) {
+        free(b);
+        return NULL;
+    }
+
+    b->len = 0;
+    b->cap = cap ? cap : 1;
+    b->refs = 1;
+
+    return b;
+}
+
+
+int
+hls_buf_append(hls_buf_t *b, const u_char *p, size_t n)
+{
+    u_char                              *data;
+    size_t                              cap;
+
+    if (b->len + n > b->cap) {
+        for (cap = b->cap; cap < b->len + n; cap *= 2) {
+        }
+
+        data = (u_char *) realloc(b->data, cap);
+        if (data == NULL) {
+            return ERROR_NORMAL;
+        }
+
+        b->data = data;
+        b->cap = cap;
+    }
+
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+
+    return SUCCESS;
+}
+
+
+hls_buf_t *
+hls_buf_ref(hls_buf_t *b)
+{
+    if (b) {
+        __atomic_add_fetch(&b->refs, 1, __ATOMIC_RELAXED);
+    }
+
+    return b;
+}
+
+
+void
+hls_buf_unref(hls_buf_t *b)
+{
+    if (b == NULL) {
+        return;
+    }
+
+    if (__atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(b->data);
+        free(b);
+    }
+}
+
+
+static hls_snap_t *
+hls_snap_create(u_int32_t nsegs)
+{
+    hls_snap_t                          *snap;
+
+    snap = new hls_snap_t;
+    memset(snap, 0, sizeof(*snap));
+
+    snap->segs = new hls_store_seg_t[nsegs ? nsegs : 1];
+
+    return snap;
+}
+
+
+static void
+hls_store_seg_free(hls_store_seg_t *seg)
+{
+    u_int32_t                           i;
+
+    for (i = 0; i < seg->nparts; i++) {
+        hls_buf_unref(seg->parts[i]);
+    }
+
+    seg->nparts = 0;
+}
+
+
+static void
+hls_snap_free(hls_snap_t *snap)
+{
+    u_int32_t                           i;
+
+    hls_buf_unref(snap->playlist);
+    hls_buf_unref(snap->delta);
+    hls_buf_unref(snap->init);
+    hls_buf_unref(snap->iframes);
+
+    for (i = 0; i < snap->nsegs; i++) {
+        hls_store_seg_free(&snap->segs[i]);
+    }
+
+    delete [] snap->segs;
+    delete snap;
+}
+
+
+int
+hls_store_init(hls_store_t *store, const char *playlist_name,
+    u_int32_t nsegs)
+{
+    if (nsegs == 0) {
+        nsegs = 1;
+    }
+
+    store->playlist_name = playlist_name;
+    store->max_segs = nsegs;
+
+    store->current = hls_snap_create(0);
+    store->epoch = 1;
+    memset(store->readers, 0, sizeof(store->readers));
+    store->notify = -1;
+
+    /* the window and the segment in progress */
+    store->work = new hls_store_seg_t[nsegs + 1];
+    store->nwork = 0;
+    store->init = NULL;
+    store->iframes = NULL;
+    store->retired = NULL;
+
+    return SUCCESS;
+}
+
+
+void
+hls_store_add_part(hls_store_t *store, u_int64_t id, hls_buf_t *data)
+{
+    hls_store_seg_t                     *seg;
+
+    seg = store->nwork ? &store->work[store->nwork - 1] : NULL;
+
+    if (seg == NULL || seg->id != id) {
+
+        /* the oldest segment leaves memory, served from disk later */
+        if (store->nwork == store->max_segs + 1) {
+            hls_store_seg_free(&store->work[0]);
+            memmove(&store->work[0], &store->work[1],
+                    sizeof(hls_store_seg_t) * (store->nwork - 1));
+            store->nwork--;
+        }
+
+        seg = &store->work[store->nwork++];
+        seg->id = id;
+        seg->nparts = 0;
+        seg->complete = 0;
+    }
+
+    /* the published parts are immutable, writer must not cut more */
+    if (seg->nparts == HLS_STORE_MAX_PARTS) {
+        ERROR("error: hls store too many parts in segment %llu\n",
+              (unsigned long long) id);
+        hls_buf_unref(data);
+        return;
+    }
+
+    seg->parts[seg->nparts++] = data;
+}
+
+
+void
+hls_store_close_segment(hls_store_t *store, u_int64_t id)
+{
+    if (store->nwork && store->work[store->nwork - 1].id == id) {
+        store->work[store->nwork - 1].complete = 1;
+    }
+}
+
+
+void
+hls_store_set_init(hls_store_t *store, const char *name, hls_buf_t *init)
+{
+    hls_buf_unref(store->init);
+
+    store->init_name = name;
+    store->init = init;
+}
+
+
+void
+hls_store_set_iframes(hls_store_t *store, const char *name,
+    hls_buf_t *iframes)
+{
+    hls_buf_unref(store->iframes);
+
+    store->iframes_name = name;
+    store->iframes = iframes;
+}
+
+
+/* free the replaced snapshots no reader can still see */
+static void
+hls_store_reclaim(hls_store_t *store)
+{
+    hls_snap_t                          **pp, *snap;
+    u_int64_t                           oldest, e;
+    int                                 i;
+
+    oldest = (u_int64_t) -1;
+
+    for (i = 0; i < HLS_STORE_READERS; i++) {
+        e = __atomic_load_n(&store->readers[i].epoch, __ATOMIC_SEQ_CST);
+        if (e && e < oldest) {
+            oldest = e;
+        }
+    }
+
+    for (pp = &store->retired; *pp; ) {
+        snap = *pp;
+
+        if (snap->retired < oldest) {
+            *pp = snap->next;
+            hls_snap_free(snap);
+            continue;
+        }
+
+        pp = &snap->next;
+    }
+}
+
+
+int
+hls_store_publish(hls_store_t *store, hls_buf_t *playlist, hls_buf_t *delta)
+{
+    hls_snap_t                          *snap, *old;
+    hls_store_seg_t                     *seg;
+    u_int32_t                           i, j;
+    u_int64_t                           v;
+
+    snap = hls_snap_create(store->nwork);
+    snap->playlist = playlist;
+    snap->delta = delta;
+    snap->init = hls_buf_ref(store->init);
+    snap->iframes = hls_buf_ref(store->iframes);
+
+    for (i = 0; i < store->nwork; i++) {
+        seg = &snap->segs[snap->nsegs++];
+        *seg = store->work[i];
+
+        for (j = 0; j < seg->nparts; j++) {
+            hls_buf_ref(seg->parts[j]);
+        }
+    }
+
+    old = __atomic_exchange_n(&store->current, snap, __ATOMIC_SEQ_CST);
+
+    old->retired = __atomic_fetch_add(&store->epoch, 1, __ATOMIC_SEQ_CST);
+    old->next = store->retired;
+    store->retired = old;
+
+    hls_store_reclaim(store);
+
+    /* wake up the readers blocked for this update */
+    if (store->notify != -1) {
+        v = 1;
+        if (write(store->notify, &v, sizeof(v)) != sizeof(v)) {
+            DEBUG("hls store notify failed, errno=%d\n", errno);
+        }
+    }
+
+    return SUCCESS;
+}
+
+
+int
+hls_store_reader(hls_store_t *store)
+{
+    int                                 i, unused;
+
+    for (i = 0; i < HLS_STORE_READERS; i++) {
+        unused = 0;
+        if (__atomic_compare_exchange_n(&store->readers[i].used, &unused, 1,
+                                        0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+hls_snap_t *
+hls_store_enter(hls_store_t *store, int reader)
+{
+    u_int64_t                           *e;
+
+    e = &store->readers[reader].epoch;
+
+    __atomic_store_n(e, __atomic_load_n(&store->epoch, __ATOMIC_SEQ_CST),
+                     __ATOMIC_SEQ_CST);
+
+    return __atomic_load_n(&store->current, __ATOMIC_SEQ_CST);
+}
+
+
+void
+hls_store_leave(hls_store_t *store, int reader)
+{
+    __atomic_store_n(&store->readers[reader].epoch, 0, __ATOMIC_RELEASE);
+}
+
+
+static hls_store_seg_t *
+hls_snap_find(hls_snap_t *snap, u_int64_t id)
+{
+    u_int32_t                           i;
+
+    for (i = 0; i < snap->nsegs; i++) {
+        if (snap->segs[i].id == id) {
+            return &snap->segs[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+u_int32_t
+hls_snap_segment(hls_snap_t *snap, u_int64_t id, hls_buf_t **parts)
+{
+    hls_store_seg_t                     *seg;
+    u_int32_t                           i;
+
+    seg = hls_snap_find(snap, id);
+    if (seg == NULL || !seg->complete) {
+        return 0;
+    }
+
+    for (i = 0; i < seg->nparts; i++) {
+        parts[i] = hls_buf_ref(seg->parts[i]);
+    }
+
+    return seg->nparts;
+}
+
+
+hls_buf_t *
+hls_snap_part(hls_snap_t *snap, u_int64_t id, u_int32_t part)
+{
+    hls_store_seg_t                     *seg;
+
+    seg = hls_snap_find(snap, id);
+    if (seg == NULL || part >= seg->nparts) {
+        return NULL;
+    }
+
+    return hls_buf_ref(seg->parts[part]);
+}
+
+
+int
+hls_snap_ready(hls_snap_t *snap, u_int64_t msn, u_int32_t part)
+{
+    hls_store_seg_t                     *seg;
+
+    if (snap->nsegs == 0) {
+        return 0;
+    }
+
+    seg = hls_snap_find(snap, msn);
+    if (seg == NULL) {
+        return msn < snap->segs[snap->nsegs - 1].id ? 1 : 0;
+    }
+
+    if (part < seg->nparts) {
+        return 1;
+    }
+
+    return seg->complete ? hls_snap_ready(snap, msn + 1, 0) : 0;
+}
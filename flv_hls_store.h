@@ -0,0 +1,139 @@
+#ifndef FLV_HLS_STORE_H
+#define FLV_HLS_STORE_H
+
+#include "FlvDecoder.h"
+#include <pthread.h>
+
+
+#define HLS_STORE_READERS           64
+
+
+/*
+ * refcounted byte buffer, the playlist and segments
+ * are kept in memory with it and shared with the http server.
+ */
+typedef struct {
+    u_char                              *data;
+    size_t                              len;
+    size_t                              cap;
+    int                                 refs;
+} hls_buf_t;
+
+
+hls_buf_t *hls_buf_create(size_t cap);
+int hls_buf_append(hls_buf_t *b, const u_char *p, size_t n);
+hls_buf_t *hls_buf_ref(hls_buf_t *b);
+void hls_buf_unref(hls_buf_t *b);
+
+
+#define HLS_STORE_MAX_PARTS         64
+
+
+/*
+ * segment as chained parts, the whole segment is the concatenation.
+ * without LL-HLS parts a segment is a single part.
+ */
+typedef struct {
+    u_int64_t                           id;
+    hls_buf_t                           *parts[HLS_STORE_MAX_PARTS];
+    u_int32_t                           nparts;
+    unsigned                            complete:1;
+} hls_store_seg_t;
+
+
+/*
+ * immutable state seen by readers, the playlist and the segment
+ * table always match. never changed once published.
+ */
+typedef struct hls_snap_s {
+    hls_buf_t                           *playlist;
+    hls_buf_t                           *delta;  /* EXT-X-SKIP, or NULL */
+    hls_buf_t                           *init;   /* fmp4 init segment */
+    hls_buf_t                           *iframes; /* I-frame playlist */
+    hls_store_seg_t                     *segs;   /* oldest first */
+    u_int32_t                           nsegs;
+
+    u_int64_t                           retired; /* epoch when replaced */
+    struct hls_snap_s                   *next;   /* retired list */
+} hls_snap_t;
+
+
+typedef struct {
+    u_int64_t                           epoch;   /* 0 when not reading */
+    int                                 used;
+    char                                pad[64 - sizeof(u_int64_t) - sizeof(int)];
+} hls_store_reader_t;
+
+
+/*
+ * the live playlist and the most recent segments,
+ * written by the remux thread, read by any number of threads.
+ *
+ * the snapshot is swapped atomically, readers announce the epoch
+ * they entered with and the writer frees a replaced snapshot only
+ * when no reader could still see it. neither side ever waits.
+ */
+typedef struct {
+    std::string                         playlist_name;
+    std::string                         init_name;
+    std::string                         iframes_name;
+    std::string                         single_name;  /* served from disk */
+    std::string                         root;    /* of the files, "dir/" */
+    u_int32_t                           max_segs;
+
+    hls_snap_t                          *current;
+    u_int64_t                           epoch;
+    hls_store_reader_t                  readers[HLS_STORE_READERS];
+
+    int                                 notify;  /* eventfd, -1 to disable */
+
+    /* owned by the writer, the window being built */
+    hls_store_seg_t                     *work;
+    u_int32_t                           nwork;
+    hls_buf_t                           *init;
+    hls_buf_t                           *iframes;
+    hls_snap_t                          *retired;
+} hls_store_t;
+
+
+int hls_store_init(hls_store_t *store, const char *playlist_name,
+    u_int32_t nsegs);
+
+/*
+ * writer: add parts of the segment in progress and complete it, then
+ * publish them together with the playlist referencing them, and its
+ * delta update when older segments can be skipped.
+ * the store takes the buffer references.
+ */
+void hls_store_add_part(hls_store_t *store, u_int64_t id, hls_buf_t *data);
+void hls_store_close_segment(hls_store_t *store, u_int64_t id);
+void hls_store_set_init(hls_store_t *store, const char *name, hls_buf_t *init);
+void hls_store_set_iframes(hls_store_t *store, const char *name,
+    hls_buf_t *iframes);
+int hls_store_publish(hls_store_t *store, hls_buf_t *playlist,
+    hls_buf_t *delta);
+
+/*
+ * reader: register once per thread, then get the snapshot between
+ * enter and leave. buffers must be referenced to be used after leave.
+ */
+int hls_store_reader(hls_store_t *store);
+hls_snap_t *hls_store_enter(hls_store_t *store, int reader);
+void hls_store_leave(hls_store_t *store, int reader);
+
+/*
+ * get the referenced parts of a complete segment, or a single part.
+ * @return the number of parts, 0 if not in memory.
+ */
+u_int32_t hls_snap_segment(hls_snap_t *snap, u_int64_t id, hls_buf_t **parts);
+hls_buf_t *hls_snap_part(hls_snap_t *snap, u_int64_t id, u_int32_t part);
+
+/*
+ * whether the part of segment msn is published, or anything later
+ * when the segment completed with less parts.
+ * @return 1 published, 0 not yet.
+ */
+int hls_snap_ready(hls_snap_t *snap, u_int64_t msn, u_int32_t part);
+
+
+#endif
@@ -0,0 +1,808 @@
+
+/*
+ * fragmented mp4 writer, the boxes follow ISO/IEC 14496-12.
+ * samples are kept as they come in flv, the AVCC NAL units go
+ * to mdat with no AnnexB conversion.
+ */
+
+
+#include "flv_mp4.h"
+
+
+#define FLV_MP4_SAMPLE_KEY          0x02000000
+#define FLV_MP4_SAMPLE_NON_KEY      0x01010000
+
+
+typedef struct {
+    u_char                              *start;
+    u_char                              *last;
+    u_char                              *end;
+} flv_mp4_buf_t;
+
+
+static u_int32_t flv_mp4_matrix[] = {
+    0x00010000, 0, 0,
+    0, 0x00010000, 0,
+    0, 0, 0x40000000
+};
+
+
+static int
+flv_mp4_field_8(flv_mp4_buf_t *b, u_int8_t n)
+{
+    if (b->last + 1 > b->end) {
+        return ERROR_NORMAL;
+    }
+
+    *b->last++ = n;
+
+    return SUCCESS;
+}
+
+
+static int
+flv_mp4_field_16(flv_mp4_buf_t *b, u_int32_t n)
+{
+    if (b->last + 2 > b->end) {
+        return ERROR_NORMAL;
+    }
+
+    *b->last++ = (u_char) (n >> 8);
+    *b->last++ = (u_char) n;
+
+    return SUCCESS;
+}
+
+
+static int
+flv_mp4_field_24(flv_mp4_buf_t *b, u_int32_t n)
+{
+    if (b->last + 3 > b->end) {
+        return ERROR_NORMAL;
+    }
+
+    *b->last++ = (u_char) (n >> 16);
+    *b->last++ = (u_char) (n >> 8);
+    *b->last++ = (u_char) n;
+
+    return SUCCESS;
+}
+
+
+static int
+flv_mp4_field_32(flv_mp4_buf_t *b, u_int32_t n)
+{
+    if (b->last + 4 > b->end) {
+        return ERROR_NORMAL;
+    }
+
+    *b->last++ = (u_char) (n >> 24);
+    *b->last++ = (u_char) (n >> 16);
+    *b->last++ = (u_char) (n >> 8);
+    *b->last++ = (u_char) n;
+
+    return SUCCESS;
+}
+
+
+static int
+flv_mp4_field_64(flv_mp4_buf_t *b, u_int64_t n)
+{
+    flv_mp4_field_32(b, (u_int32_t) (n >> 32));
+
+    return flv_mp4_field_32(b, (u_int32_t) n);
+}
+
+
+static int
+flv_mp4_data(flv_mp4_buf_t *b, const void *data, size_t n)
+{
+    if (b->last + n > b->end) {
+        return ERROR_NORMAL;
+    }
+
+    memcpy(b->last, data, n);
+    b->last += n;
+
+    return SUCCESS;
+}
+
+
+static u_char *
+flv_mp4_start_box(flv_mp4_buf_t *b, const char box[4])
+{
+    u_char                              *pos;
+
+    pos = b->last;
+
+    if (flv_mp4_field_32(b, 0) != SUCCESS
+        || flv_mp4_data(b, box, 4) != SUCCESS)
+    {
+        return NULL;
+    }
+
+    return pos;
+}
+
+
+static void
+flv_mp4_update_box_size(flv_mp4_buf_t *b, u_char *pos)
+{
+    u_int32_t                           size;
+
+    if (pos == NULL) {
+        return;
+    }
+
+    size = (u_int32_t) (b->last - pos);
+
+    pos[0] = (u_char) (size >> 24);
+    pos[1] = (u_char) (size >> 16);
+    pos[2] = (u_char) (size >> 8);
+    pos[3] = (u_char) size;
+}
+
+
+static void
+flv_mp4_write_matrix(flv_mp4_buf_t *b)
+{
+    u_int32_t                           i;
+
+    for (i = 0; i < sizeof(flv_mp4_matrix) / sizeof(flv_mp4_matrix[0]); i++) {
+        flv_mp4_field_32(b, flv_mp4_matrix[i]);
+    }
+}
+
+
+static void
+flv_mp4_write_ftyp(flv_mp4_buf_t *b)
+{
+    u_char                              *pos;
+
+    pos = flv_mp4_start_box(b, "ftyp");
+
+    flv_mp4_data(b, "iso6", 4);
+    flv_mp4_field_32(b, 1);
+
+    flv_mp4_data(b, "iso6", 4);
+    flv_mp4_data(b, "mp41", 4);
+
+    flv_mp4_update_box_size(b, pos);
+}
+
+
+static void
+flv_mp4_write_mvhd(flv_mp4_buf_t *b, u_int32_t next_track)
+{
+    u_char                              *pos;
+
+    pos = flv_mp4_start_box(b, "mvhd");
+
+    /* version, flags, creation and modification time */
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, 0);
+
+    flv_mp4_field_32(b, FLV_MP4_TIMESCALE);
+    flv_mp4_field_32(b, 0);          /* duration, fragmented */
+
+    flv_mp4_field_32(b, 0x00010000); /* rate */
+    flv_mp4_field_16(b, 0x0100);     /* volume */
+    flv_mp4_field_16(b, 0);
+    flv_mp4_field_64(b, 0);
+
+    flv_mp4_write_matrix(b);
+
+    /* pre defined */
+    flv_mp4_field_64(b, 0);
+    flv_mp4_field_64(b, 0);
+    flv_mp4_field_64(b, 0);
+
+    flv_mp4_field_32(b, next_track);
+
+    flv_mp4_update_box_size(b, pos);
+}
+
+
+static void
+flv_mp4_write_tkhd(flv_mp4_buf_t *b, u_int32_t track, av_codec_ctx_t *codec)
+{
+    u_char                              *pos;
+
+    pos = flv_mp4_start_box(b, "tkhd");
+
+    /* enabled, in movie, in preview */
+    flv_mp4_field_32(b, 0x00000007);
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, 0);
+
+    flv_mp4_field_32(b, track);
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, 0);          /* duration */
+    flv_mp4_field_64(b, 0);
+
+    flv_mp4_field_16(b, 0);          /* layer */
+    flv_mp4_field_16(b, 0);          /* alternate group */
+    flv_mp4_field_16(b, track == FLV_MP4_AUDIO_TRACK ? 0x0100 : 0);
+    flv_mp4_field_16(b, 0);
+
+    flv_mp4_write_matrix(b);
+
+    if (track == FLV_MP4_VIDEO_TRACK) {
+        flv_mp4_field_32(b, codec->width << 16);
+        flv_mp4_field_32(b, codec->height << 16);
+    } else {
+        flv_mp4_field_32(b, 0);
+        flv_mp4_field_32(b, 0);
+    }
+
+    flv_mp4_update_box_size(b, pos);
+}
+
+
+static void
+flv_mp4_write_mdhd(flv_mp4_buf_t *b)
+{
+    u_char                              *pos;
+
+    pos = flv_mp4_start_box(b, "mdhd");
+
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, 0);
+
+    flv_mp4_field_32(b, FLV_MP4_TIMESCALE);
+    flv_mp4_field_32(b, 0);
+
+    flv_mp4_field_16(b, 0x55c4);     /* und */
+    flv_mp4_field_16(b, 0);
+
+    flv_mp4_update_box_size(b, pos);
+}
+
+
+static void
+flv_mp4_write_hdlr(flv_mp4_buf_t *b, u_int32_t track)
+{
+    u_char                              *pos;
+
+    pos = flv_mp4_start_box(b, "hdlr");
+
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, 0);
+
+    if (track == FLV_MP4_VIDEO_TRACK) {
+        flv_mp4_data(b, "vide", 4);
+    } else {
+        flv_mp4_data(b, "soun", 4);
+    }
+
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, 0);
+
+    if (track == FLV_MP4_VIDEO_TRACK) {
+        flv_mp4_data(b, "VideoHandler", sizeof("VideoHandler"));
+    } else {
+        flv_mp4_data(b, "SoundHandler", sizeof("SoundHandler"));
+    }
+
+    flv_mp4_update_box_size(b, pos);
+}
+
+
+static void
+flv_mp4_write_dinf(flv_mp4_buf_t *b)
+{
+    u_char                              *pos, *dref, *url;
+
+    pos = flv_mp4_start_box(b, "dinf");
+    dref = flv_mp4_start_box(b, "dref");
+
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, 1);
+
+    /* the data is in this file */
+    url = flv_mp4_start_box(b, "url ");
+    flv_mp4_field_32(b, 0x00000001);
+    flv_mp4_update_box_size(b, url);
+
+    flv_mp4_update_box_size(b, dref);
+    flv_mp4_update_box_size(b, pos);
+}
+
+
+static void
+flv_mp4_write_avc1(flv_mp4_buf_t *b, av_codec_ctx_t *codec)
+{
+    u_char                              *pos, *avcc;
+
+    pos = flv_mp4_start_box(b, "avc1");
+
+    /* reserved, data reference index */
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_16(b, 0);
+    flv_mp4_field_16(b, 1);
+
+    /* pre defined, reserved */
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_64(b, 0);
+    flv_mp4_field_32(b, 0);
+
+    flv_mp4_field_16(b, codec->width);
+    flv_mp4_field_16(b, codec->height);
+
+    flv_mp4_field_32(b, 0x00480000); /* 72 dpi */
+    flv_mp4_field_32(b, 0x00480000);
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_16(b, 1);          /* frame count */
+
+    /* compressor name */
+    flv_mp4_field_64(b, 0);
+    flv_mp4_field_64(b, 0);
+    flv_mp4_field_64(b, 0);
+    flv_mp4_field_64(b, 0);
+
+    flv_mp4_field_16(b, 0x0018);     /* depth */
+    flv_mp4_field_16(b, 0xffff);
+
+    /* AVCDecoderConfigurationRecord follows the 5 bytes of flv tag */
+    avcc = flv_mp4_start_box(b, "avcC");
+    flv_mp4_data(b, codec->avc_header + 5, codec->avc_header_size - 5);
+    flv_mp4_update_box_size(b, avcc);
+
+    flv_mp4_update_box_size(b, pos);
+}
+
+
+static void
+flv_mp4_write_esds(flv_mp4_buf_t *b, av_codec_ctx_t *codec)
+{
+    u_char                              *pos;
+    u_int32_t                           dsi_len, dcd_len;
+
+    /* AudioSpecificConfig follows the 2 bytes of flv tag */
+    dsi_len = codec->aac_header_size - 2;
+    dcd_len = 13 + 2 + dsi_len;
+
+    pos = flv_mp4_start_box(b, "esds");
+
+    flv_mp4_field_32(b, 0);
+
+    /* ES descriptor */
+    flv_mp4_field_8(b, 0x03);
+    flv_mp4_field_8(b, (u_int8_t) (3 + 2 + dcd_len + 3));
+    flv_mp4_field_16(b, FLV_MP4_AUDIO_TRACK);
+    flv_mp4_field_8(b, 0);
+
+    /* decoder config descriptor */
+    flv_mp4_field_8(b, 0x04);
+    flv_mp4_field_8(b, (u_int8_t) dcd_len);
+    flv_mp4_field_8(b, 0x40);        /* MPEG-4 audio */
+    flv_mp4_field_8(b, 0x15);        /* audio stream */
+    flv_mp4_field_24(b, 0);          /* buffer size */
+    flv_mp4_field_32(b, 0);          /* max bitrate */
+    flv_mp4_field_32(b, 0);          /* avg bitrate */
+
+    /* decoder specific info */
+    flv_mp4_field_8(b, 0x05);
+    flv_mp4_field_8(b, (u_int8_t) dsi_len);
+    flv_mp4_data(b, codec->aac_header + 2, dsi_len);
+
+    /* SL config descriptor */
+    flv_mp4_field_8(b, 0x06);
+    flv_mp4_field_8(b, 1);
+    flv_mp4_field_8(b, 0x02);
+
+    flv_mp4_update_box_size(b, pos);
+}
+
+
+static void
+flv_mp4_write_mp4a(flv_mp4_buf_t *b, av_codec_ctx_t *codec)
+{
+    u_char                              *pos;
+
+    pos = flv_mp4_start_box(b, "mp4a");
+
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_16(b, 0);
+    flv_mp4_field_16(b, 1);
+
+    flv_mp4_field_64(b, 0);
+
+    flv_mp4_field_16(b, codec->aac_chan_conf ? codec->aac_chan_conf : 2);
+    flv_mp4_field_16(b, 16);         /* sample size */
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, (codec->sample_rate & 0xffff) << 16);
+
+    flv_mp4_write_esds(b, codec);
+
+    flv_mp4_update_box_size(b, pos);
+}
+
+
+/* the sample tables are empty, the samples are in fragments */
+static void
+flv_mp4_write_stbl(flv_mp4_buf_t *b, u_int32_t track, av_codec_ctx_t *codec)
+{
+    u_char                              *pos, *box;
+
+    pos = flv_mp4_start_box(b, "stbl");
+
+    box = flv_mp4_start_box(b, "stsd");
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, 1);
+
+    if (track == FLV_MP4_VIDEO_TRACK) {
+        flv_mp4_write_avc1(b, codec);
+    } else {
+        flv_mp4_write_mp4a(b, codec);
+    }
+
+    flv_mp4_update_box_size(b, box);
+
+    box = flv_mp4_start_box(b, "stts");
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, 0);
+    flv_mp4_update_box_size(b, box);
+
+    box = flv_mp4_start_box(b, "stsc");
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, 0);
+    flv_mp4_update_box_size(b, box);
+
+    box = flv_mp4_start_box(b, "stsz");
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, 0);
+    flv_mp4_update_box_size(b, box);
+
+    box = flv_mp4_start_box(b, "stco");
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, 0);
+    flv_mp4_update_box_size(b, box);
+
+    flv_mp4_update_box_size(b, pos);
+}
+
+
+static void
+flv_mp4_write_trak(flv_mp4_buf_t *b, u_int32_t track, av_codec_ctx_t *codec)
+{
+    u_char                              *pos, *mdia, *minf, *box;
+
+    pos = flv_mp4_start_box(b, "trak");
+
+    flv_mp4_write_tkhd(b, track, codec);
+
+    mdia = flv_mp4_start_box(b, "mdia");
+
+    flv_mp4_write_mdhd(b);
+    flv_mp4_write_hdlr(b, track);
+
+    minf = flv_mp4_start_box(b, "minf");
+
+    if (track == FLV_MP4_VIDEO_TRACK) {
+        box = flv_mp4_start_box(b, "vmhd");
+        flv_mp4_field_32(b, 0x00000001);
+        flv_mp4_field_64(b, 0);
+    } else {
+        box = flv_mp4_start_box(b, "smhd");
+        flv_mp4_field_32(b, 0);
+        flv_mp4_field_32(b, 0);
+    }
+    flv_mp4_update_box_size(b, box);
+
+    flv_mp4_write_dinf(b);
+    flv_mp4_write_stbl(b, track, codec);
+
+    flv_mp4_update_box_size(b, minf);
+    flv_mp4_update_box_size(b, mdia);
+    flv_mp4_update_box_size(b, pos);
+}
+
+
+static void
+flv_mp4_write_trex(flv_mp4_buf_t *b, u_int32_t track)
+{
+    u_char                              *pos;
+
+    pos = flv_mp4_start_box(b, "trex");
+
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, track);
+    flv_mp4_field_32(b, 1);          /* sample description index */
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, 0);
+
+    flv_mp4_update_box_size(b, pos);
+}
+
+
+void
+flv_mp4_init(flv_mp4_t *mp4)
+{
+    memset(mp4, 0, sizeof(*mp4));
+
+    mp4->video.id = FLV_MP4_VIDEO_TRACK;
+    mp4->audio.id = FLV_MP4_AUDIO_TRACK;
+}
+
+
+int
+flv_mp4_open_file(flv_mpegts_file_t *file, char *path)
+{
+    if (file->out) {
+        file->fd = -1;
+
+    } else {
+        file->fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+
+        if (file->fd == -1) {
+            printf("hls: error creating fragment file\n");
+            return ERROR_NORMAL;
+        }
+    }
+
+    file->size = 0;
+    file->offset = 0;
+
+    return SUCCESS;
+}
+
+
+int
+flv_mp4_write_init(flv_mpegts_file_t *file, av_codec_ctx_t *codec)
+{
+    flv_mp4_buf_t                       buf, *b;
+    u_char                              *data, *pos, *mvex;
+    size_t                              size;
+    int                                 video, audio, rc;
+
+    video = (codec->avc_header && codec->avc_header_size > 5);
+    audio = (codec->aac_header && codec->aac_header_size > 2);
+
+    size = 4096 + codec->avc_header_size + codec->aac_header_size;
+
+    data = (u_char *) malloc(size);
+    if (data == NULL) {
+        return ERROR_NORMAL;
+    }
+
+    b = &buf;
+    b->start = b->last = data;
+    b->end = data + size;
+
+    flv_mp4_write_ftyp(b);
+
+    pos = flv_mp4_start_box(b, "moov");
+
+    flv_mp4_write_mvhd(b, FLV_MP4_AUDIO_TRACK + 1);
+
+    if (video) {
+        flv_mp4_write_trak(b, FLV_MP4_VIDEO_TRACK, codec);
+    }
+
+    if (audio) {
+        flv_mp4_write_trak(b, FLV_MP4_AUDIO_TRACK, codec);
+    }
+
+    mvex = flv_mp4_start_box(b, "mvex");
+
+    if (video) {
+        flv_mp4_write_trex(b, FLV_MP4_VIDEO_TRACK);
+    }
+
+    if (audio) {
+        flv_mp4_write_trex(b, FLV_MP4_AUDIO_TRACK);
+    }
+
+    flv_mp4_update_box_size(b, mvex);
+    flv_mp4_update_box_size(b, pos);
+
+    rc = flv_mpegts_write_file(file, b->start, b->last - b->start);
+
+    free(data);
+
+    return rc;
+}
+
+
+int
+flv_mp4_add_sample(flv_mp4_track_t *t, u_int64_t dts, u_int32_t cts,
+    int key, u_char *data, size_t size)
+{
+    flv_mp4_sample_t                    *s;
+    u_char                              *p;
+    size_t                              cap;
+    u_int32_t                           n;
+
+    if (t->nsamples == t->max_samples) {
+        n = t->max_samples ? t->max_samples * 2 : 256;
+
+        s = (flv_mp4_sample_t *) realloc(t->samples,
+                                          n * sizeof(flv_mp4_sample_t));
+        if (s == NULL) {
+            return ERROR_NORMAL;
+        }
+
+        t->samples = s;
+        t->max_samples = n;
+    }
+
+    if (t->len + size > t->cap) {
+        for (cap = t->cap ? t->cap : 64 * 1024; cap < t->len + size; cap *= 2) {
+        }
+
+        p = (u_char *) realloc(t->data, cap);
+        if (p == NULL) {
+            return ERROR_NORMAL;
+        }
+
+        t->data = p;
+        t->cap = cap;
+    }
+
+    memcpy(t->data + t->len, data, size);
+    t->len += size;
+
+    s = &t->samples[t->nsamples++];
+
+    s->size = (u_int32_t) size;
+    s->duration = 0;
+    s->flags = key ? FLV_MP4_SAMPLE_KEY : FLV_MP4_SAMPLE_NON_KEY;
+    s->cts = cts;
+    s->dts = dts;
+
+    return SUCCESS;
+}
+
+
+/*
+ * durations from the next sample. the last one keeps the cadence
+ * of the track, end_dts is used only when nothing is known yet.
+ */
+static void
+flv_mp4_update_durations(flv_mp4_track_t *t, u_int64_t end_dts)
+{
+    flv_mp4_sample_t                    *s;
+    u_int32_t                           i;
+
+    for (i = 0; i + 1 < t->nsamples; i++) {
+        s = &t->samples[i];
+        s->duration = (u_int32_t) (s[1].dts > s->dts ? s[1].dts - s->dts : 0);
+        t->last_duration = s->duration ? s->duration : t->last_duration;
+    }
+
+    s = &t->samples[t->nsamples - 1];
+
+    if (t->last_duration) {
+        s->duration = t->last_duration;
+
+    } else if (end_dts > s->dts) {
+        s->duration = (u_int32_t) (end_dts - s->dts);
+        t->last_duration = s->duration;
+    }
+}
+
+
+static void
+flv_mp4_write_traf(flv_mp4_buf_t *b, flv_mp4_track_t *t, u_int32_t data_offset)
+{
+    u_char                              *pos, *box;
+    flv_mp4_sample_t                    *s;
+    u_int32_t                           i;
+
+    pos = flv_mp4_start_box(b, "traf");
+
+    /* default base is moof */
+    box = flv_mp4_start_box(b, "tfhd");
+    flv_mp4_field_32(b, 0x00020000);
+    flv_mp4_field_32(b, t->id);
+    flv_mp4_update_box_size(b, box);
+
+    box = flv_mp4_start_box(b, "tfdt");
+    flv_mp4_field_32(b, 0x01000000);
+    flv_mp4_field_64(b, t->samples[0].dts);
+    flv_mp4_update_box_size(b, box);
+
+    /* data offset, sample duration, size, flags, composition offset */
+    box = flv_mp4_start_box(b, "trun");
+    flv_mp4_field_32(b, 0x00000f01);
+    flv_mp4_field_32(b, t->nsamples);
+    flv_mp4_field_32(b, data_offset);
+
+    for (i = 0; i < t->nsamples; i++) {
+        s = &t->samples[i];
+
+        flv_mp4_field_32(b, s->duration);
+        flv_mp4_field_32(b, s->size);
+        flv_mp4_field_32(b, s->flags);
+        flv_mp4_field_32(b, s->cts);
+    }
+
+    flv_mp4_update_box_size(b, box);
+    flv_mp4_update_box_size(b, pos);
+}
+
+
+static u_int32_t
+flv_mp4_traf_size(flv_mp4_track_t *t)
+{
+    if (t->nsamples == 0) {
+        return 0;
+    }
+
+    /* traf, tfhd, tfdt, trun and the sample entries */
+    return 8 + 16 + 20 + 20 + t->nsamples * 16;
+}
+
+
+int
+flv_mp4_write_fragment(flv_mpegts_file_t *file, flv_mp4_t *mp4,
+    u_int64_t end_dts)
+{
+    flv_mp4_buf_t                       buf, *b;
+    u_char                              *data, *pos;
+    u_int32_t                           moof_size;
+    int                                 rc;
+
+    if (mp4->video.nsamples == 0 && mp4->audio.nsamples == 0) {
+        return SUCCESS;
+    }
+
+    /* moof, mfhd and the trafs */
+    moof_size = 8 + 16 + flv_mp4_traf_size(&mp4->video)
+                + flv_mp4_traf_size(&mp4->audio);
+
+    data = (u_char *) malloc(moof_size + 8);
+    if (data == NULL) {
+        return ERROR_NORMAL;
+    }
+
+    b = &buf;
+    b->start = b->last = data;
+    b->end = data + moof_size + 8;
+
+    pos = flv_mp4_start_box(b, "moof");
+
+    flv_mp4_field_32(b, 16);
+    flv_mp4_data(b, "mfhd", 4);
+    flv_mp4_field_32(b, 0);
+    flv_mp4_field_32(b, ++mp4->seq);
+
+    /* mdat has the video samples, then the audio samples */
+    if (mp4->video.nsamples) {
+        flv_mp4_update_durations(&mp4->video, end_dts);
+        flv_mp4_write_traf(b, &mp4->video, moof_size + 8);
+    }
+
+    if (mp4->audio.nsamples) {
+        flv_mp4_update_durations(&mp4->audio, end_dts);
+        flv_mp4_write_traf(b, &mp4->audio, moof_size + 8 + mp4->video.len);
+    }
+
+    flv_mp4_update_box_size(b, pos);
+
+    flv_mp4_field_32(b, 8 + mp4->video.len + mp4->audio.len);
+    flv_mp4_data(b, "mdat", 4);
+
+    rc = flv_mpegts_write_file(file, b->start, b->last - b->start);
+
+    if (rc == SUCCESS && mp4->video.len) {
+        rc = flv_mpegts_write_file(file, mp4->video.data, mp4->video.len);
+    }
+
+    if (rc == SUCCESS && mp4->audio.len) {
+        rc = flv_mpegts_write_file(file, mp4->audio.data, mp4->audio.len);
+    }
+
+    free(data);
+
+    mp4->video.nsamples = mp4->audio.nsamples = 0;
+    mp4->video.len = mp4->audio.len = 0;
+
+    return rc;
+}
@@ -0,0 +1,74 @@
+
+/*
+ * fragmented mp4 (CMAF) output, an init segment with the codec
+ * configuration and moof+mdat fragments of the samples.
+ */
+
+
+#ifndef _FLV_MP4_H_INCLUDED_
+#define _FLV_MP4_H_INCLUDED_
+
+#include "flv_mpegts.h"
+
+
+#define FLV_MP4_TIMESCALE           90000
+
+#define FLV_MP4_VIDEO_TRACK         1
+#define FLV_MP4_AUDIO_TRACK         2
+
+
+typedef struct {
+    u_int32_t                           size;
+    u_int32_t                           duration;
+    u_int32_t                           flags;
+    u_int32_t                           cts;
+    u_int64_t                           dts;
+} flv_mp4_sample_t;
+
+
+typedef struct {
+    u_int32_t                           id;
+
+    flv_mp4_sample_t                    *samples;
+    u_int32_t                           nsamples;
+    u_int32_t                           max_samples;
+    u_int32_t                           last_duration;
+
+    /* sample payloads as they come in flv, the mdat of the track */
+    u_char                              *data;
+    size_t                              len;
+    size_t                              cap;
+} flv_mp4_track_t;
+
+
+typedef struct {
+    flv_mp4_track_t                     video;
+    flv_mp4_track_t                     audio;
+    u_int32_t                           seq;
+} flv_mp4_t;
+
+
+void flv_mp4_init(flv_mp4_t *mp4);
+int flv_mp4_open_file(flv_mpegts_file_t *file, char *path);
+
+/*
+ * ftyp and moov of the tracks having a codec header.
+ */
+int flv_mp4_write_init(flv_mpegts_file_t *file, av_codec_ctx_t *codec);
+
+/*
+ * the video sample is the AVCC payload of the flv tag, the audio
+ * sample the raw AAC frame. timestamps are in FLV_MP4_TIMESCALE.
+ */
+int flv_mp4_add_sample(flv_mp4_track_t *t, u_int64_t dts, u_int32_t cts,
+    int key, u_char *data, size_t size);
+
+/*
+ * write the buffered samples as a moof+mdat fragment, end_dts is the
+ * decode time following the last sample, 0 if not known.
+ */
+int flv_mp4_write_fragment(flv_mpegts_file_t *file, flv_mp4_t *mp4,
+    u_int64_t end_dts);
+
+
+#endif /* _FLV_MP4_H_INCLUDED_ */
@@ -79,19 +79,95 @@ static u_char flv_mpegts_header[] = {
 #define flv2hls_movemem(dst, src, n)   (((u_char *) memmove(dst, src, n)) + (n))
 
 static int
+flv_mpegts_write_out(flv_mpegts_file_t *file, u_char *in, size_t in_size)
+{
+    ssize_t   rc;
+
+    if (file->out) {
+        if (hls_buf_append(file->out, in, in_size) != SUCCESS) {
+            return ERROR_NORMAL;
+        }
+
+        rc = in_size;
+
+    } else {
+        rc = write(file->fd, in, in_size);
+        if (rc < 0) {
+            return ERROR_NORMAL;
+        }
+    }
+
+    file->offset += rc;
+
+    if (file->hash) {
+        file->crc = flv_crc32c(file->crc, in, rc);
+    }
+
+    if (file->mem && hls_buf_append(file->mem, in, in_size) != SUCCESS) {
+        return ERROR_NORMAL;
+    }
+
+    return SUCCESS;
+}
+
+
+/*
+ * with encryption the bytes are encrypted as they come, the ones
+ * short of a block wait in buf for the next write or the padding.
+ */
+int
 flv_mpegts_write_file(flv_mpegts_file_t *file, u_char *in,
     size_t in_size)
 {
-
-    ssize_t   rc;
+    u_char     buf[1024];
+    size_t     out_size, n;
 
     //printf("mpegts: write %uz bytes", in_size);
 
-    rc = write(file->fd, in, in_size);
-    if (rc < 0) {
-        return ERROR_NORMAL;
+    if (!file->encrypt) {
+        return flv_mpegts_write_out(file, in, in_size);
+    }
+
+    if (file->size + in_size < 16) {
+        memcpy(file->buf + file->size, in, in_size);
+        file->size += in_size;
+        return SUCCESS;
+    }
+
+    if (file->size) {
+        n = 16 - file->size;
+        memcpy(file->buf + file->size, in, n);
+
+        flv_aes_cbc_encrypt(&file->key, file->iv, file->buf, buf, 16);
+
+        if (flv_mpegts_write_out(file, buf, 16) != SUCCESS) {
+            return ERROR_NORMAL;
+        }
+
+        in += n;
+        in_size -= n;
+        file->size = 0;
     }
 
+    out_size = in_size & ~(size_t) 0x0f;
+
+    while (out_size) {
+        n = out_size < sizeof(buf) ? out_size : sizeof(buf);
+
+        flv_aes_cbc_encrypt(&file->key, file->iv, in, buf, n);
+
+        if (flv_mpegts_write_out(file, buf, n) != SUCCESS) {
+            return ERROR_NORMAL;
+        }
+
+        in += n;
+        in_size -= n;
+        out_size -= n;
+    }
+
+    memcpy(file->buf, in, in_size);
+    file->size = in_size;
+
     return SUCCESS;
 }
 
@@ -99,11 +175,131 @@ flv_mpegts_write_file(flv_mpegts_file_t *file, u_char *in,
 static int32_t
 flv_mpegts_write_header(flv_mpegts_file_t *file)
 {
+    if (file->header) {
+        return flv_mpegts_write_file(file, file->header,
+                                     FLV_MPEGTS_HEADER_SIZE);
+    }
+
     return flv_mpegts_write_file(file, flv_mpegts_header,
                                       sizeof(flv_mpegts_header));
 }
 
 
+/* CRC32 of PSI sections, MSB first with no final xor */
+static u_int32_t
+flv_mpegts_crc32(u_char *p, size_t n)
+{
+    u_int32_t  crc;
+    int        i;
+
+    crc = 0xffffffff;
+
+    while (n--) {
+        crc ^= (u_int32_t) *p++ << 24;
+
+        for (i = 0; i < 8; i++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+
+void
+flv_mpegts_make_header(u_char *header, unsigned streams, u_char *asc,
+    size_t asc_len)
+{
+    u_char     *p, *section;
+    u_int32_t  crc, pcr_pid;
+    unsigned   saes;
+
+    saes = (streams & FLV_MPEGTS_SAMPLE_AES);
+
+    memset(header, 0xff, FLV_MPEGTS_HEADER_SIZE);
+
+    /* PAT is the same for any streams */
+    memcpy(header, flv_mpegts_header, 188);
+
+    pcr_pid = (streams & FLV_MPEGTS_VIDEO) ? 0x100 : 0x101;
+
+    p = header + 188;
+
+    /* TS */
+    *p++ = 0x47;
+    *p++ = 0x50;
+    *p++ = 0x01;
+    *p++ = 0x10;
+    *p++ = 0x00;
+
+    /* PSI */
+    section = p;
+    *p++ = 0x02;
+    *p++ = 0xb0;
+    *p++ = 0x00;  /* section length */
+    *p++ = 0x00;
+    *p++ = 0x01;
+    *p++ = 0xc1;
+    *p++ = 0x00;
+    *p++ = 0x00;
+
+    /* PMT */
+    *p++ = (u_char) (0xe0 | (pcr_pid >> 8));
+    *p++ = (u_char) pcr_pid;
+    *p++ = 0xf0;
+    *p++ = 0x00;
+
+    if ((streams & FLV_MPEGTS_VIDEO) && !saes) {
+        /* h264 */
+        *p++ = 0x1b; *p++ = 0xe1; *p++ = 0x00; *p++ = 0xf0; *p++ = 0x00;
+    }
+
+    if ((streams & FLV_MPEGTS_VIDEO) && saes) {
+        /* SAMPLE-AES h264, private data indicator "zavc" */
+        *p++ = 0xdb; *p++ = 0xe1; *p++ = 0x00; *p++ = 0xf0; *p++ = 0x06;
+        *p++ = 0x0f; *p++ = 0x04;
+        *p++ = 'z'; *p++ = 'a'; *p++ = 'v'; *p++ = 'c';
+    }
+
+    if ((streams & FLV_MPEGTS_AUDIO) && !saes) {
+        /* aac */
+        *p++ = 0x0f; *p++ = 0xe1; *p++ = 0x01; *p++ = 0xf0; *p++ = 0x00;
+    }
+
+    /*
+     * SAMPLE-AES aac, private data indicator "aacd" and the audio
+     * setup information of "zaac" with the AudioSpecificConfig in
+     * a registration descriptor "apad".
+     */
+    if ((streams & FLV_MPEGTS_AUDIO) && saes) {
+        if (asc_len > 64) {
+            asc_len = 0;
+        }
+
+        *p++ = 0xcf; *p++ = 0xe1; *p++ = 0x01; *p++ = 0xf0;
+        *p++ = (u_char) (6 + 2 + 12 + asc_len);
+        *p++ = 0x0f; *p++ = 0x04;
+        *p++ = 'a'; *p++ = 'a'; *p++ = 'c'; *p++ = 'd';
+        *p++ = 0x05; *p++ = (u_char) (12 + asc_len);
+        *p++ = 'a'; *p++ = 'p'; *p++ = 'a'; *p++ = 'd';
+        *p++ = 'z'; *p++ = 'a'; *p++ = 'a'; *p++ = 'c';
+        *p++ = 0x00; *p++ = 0x00;   /* priming */
+        *p++ = 0x01;                /* version */
+        *p++ = (u_char) asc_len;
+        p = flv2hls_movemem(p, asc, asc_len);
+    }
+
+    section[2] = (u_char) (p - section - 3 + 4);
+
+    /* CRC */
+    crc = flv_mpegts_crc32(section, p - section);
+    *p++ = (u_char) (crc >> 24);
+    *p++ = (u_char) (crc >> 16);
+    *p++ = (u_char) (crc >> 8);
+    *p++ = (u_char) crc;
+}
+
+
 static u_char *
 flv_mpegts_write_pcr(u_char *p, u_int64_t pcr)
 {
@@ -227,7 +423,7 @@ flv_mpegts_write_frame(flv_mpegts_file_t *file,
                 /* has adaptation */
 
                 base = &packet[5] + packet[4];
-                p = (u_int8_t*)memmove((void*)(base + stuff_size), (void*)base, p - base);
+                p = flv2hls_movemem(base + stuff_size, base, p - base);
                 memset(base, 0xff, stuff_size);
                 packet[4] += (u_char) stuff_size;
 
@@ -236,8 +432,8 @@ flv_mpegts_write_frame(flv_mpegts_file_t *file,
                 /* no adaptation */
 
                 packet[3] |= 0x20;
-                p = (u_int8_t*)memmove((void*)(&packet[4] + stuff_size), (void*)&packet[4],
-                                p - &packet[4]);
+                p = flv2hls_movemem(&packet[4] + stuff_size, &packet[4],
+                                    p - &packet[4]);
 
                 packet[4] = (u_char) (stuff_size - 1);
                 if (stuff_size >= 2) {
@@ -260,37 +456,96 @@ flv_mpegts_write_frame(flv_mpegts_file_t *file,
 }
 
 
+/*
+ * AES-128 CBC of the next file, the iv is the 64 bit number in
+ * network order in the low half.
+ */
 int32_t
-flv_mpegts_open_file(flv_mpegts_file_t *file, char *path)
+flv_mpegts_init_encryption(flv_mpegts_file_t *file, u_char *key,
+    size_t key_len, u_int64_t iv)
 {
-    file->fd = open(path, O_WRONLY|O_CREAT|O_TRUNC);
+    u_int32_t  i;
 
-    if (file->fd == -1) {
-        printf("hls: error creating fragment file\n");
+    if (key_len != 16) {
         return ERROR_NORMAL;
     }
 
+    flv_aes_set_key(&file->key, key);
+
+    memset(file->iv, 0, 8);
+
+    for (i = 0; i < 8; i++) {
+        file->iv[15 - i] = (u_char) (iv >> (i * 8));
+    }
+
+    file->encrypt = 1;
+
+    return SUCCESS;
+}
+
+
+int32_t
+flv_mpegts_open_file(flv_mpegts_file_t *file, char *path)
+{
+    /* the sink gets the segment from out when it is complete */
+    if (file->out) {
+        file->fd = -1;
+
+    } else {
+        file->fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+
+        if (file->fd == -1) {
+            printf("hls: error creating fragment file\n");
+            return ERROR_NORMAL;
+        }
+    }
+
     file->size = 0;
+    file->offset = 0;
 
     if (flv_mpegts_write_header(file) != SUCCESS) {
         printf("hls: error writing fragment header\n");
-        close(file->fd);
+        if (file->fd != -1) {
+            close(file->fd);
+        }
         return ERROR_NORMAL;
     }
-    fchmod(file->fd, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH);
-    
+
     return SUCCESS;
 }
 
 
+/* next segment in the already open file, it starts with PAT/PMT */
+int
+flv_mpegts_start_file(flv_mpegts_file_t *file)
+{
+    return flv_mpegts_write_header(file);
+}
+
+
 int
 flv_mpegts_close_file(flv_mpegts_file_t *file)
 {
     u_int8_t   buf[16];
     ssize_t  rc;
 
+    /* PKCS#7 padding ends the last block */
+    if (file->encrypt) {
+        memset(file->buf + file->size, 16 - file->size, 16 - file->size);
+
+        flv_aes_cbc_encrypt(&file->key, file->iv, file->buf, buf, 16);
 
-    close(file->fd);
+        rc = flv_mpegts_write_out(file, buf, 16);
+        if (rc != SUCCESS) {
+            printf("hls: error writing fragment\n");
+        }
+
+        file->size = 0;
+    }
+
+    if (file->fd != -1) {
+        close(file->fd);
+    }
 
     return SUCCESS;
 }
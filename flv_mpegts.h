@@ -8,11 +8,32 @@
 #define _NGX_RTMP_MPEGTS_H_INCLUDED_
 
 #include "FlvDecoder.h"
+#include "flv_hls_store.h"
+#include "flv_aes.h"
+#include "flv_crc32c.h"
+
+
+/* PAT and PMT packets starting every file */
+#define FLV_MPEGTS_HEADER_SIZE      376
+
+#define FLV_MPEGTS_VIDEO            0x01
+#define FLV_MPEGTS_AUDIO            0x02
+#define FLV_MPEGTS_SAMPLE_AES       0x04
 
 
 typedef struct {
     int    fd;
-    unsigned    size:4;
+    unsigned    encrypt:1;
+    unsigned    size:4; /* bytes in buf waiting for a whole block */
+    u_char      buf[16];
+    u_char      iv[16];
+    flv_aes_key_t   key;
+    hls_buf_t   *mem;   /* copy of the written bytes, NULL to disable */
+    hls_buf_t   *out;   /* the bytes for a sink off the disk, fd is -1 */
+    off_t       offset; /* end of the written bytes in file */
+    unsigned    hash:1;
+    u_int32_t   crc;    /* CRC32C of the written bytes */
+    u_char      *header; /* PAT/PMT, NULL for h264 and aac */
 } flv_mpegts_file_t;
 
 
@@ -26,9 +47,22 @@ typedef struct {
 } flv_mpegts_frame_t;
 
 
+int flv_mpegts_init_encryption(flv_mpegts_file_t *file, u_char *key,
+    size_t key_len, u_int64_t iv);
 int flv_mpegts_open_file(flv_mpegts_file_t *file, char *path);
+int flv_mpegts_start_file(flv_mpegts_file_t *file);
 int flv_mpegts_close_file(flv_mpegts_file_t *file);
 int flv_mpegts_write_frame(flv_mpegts_file_t *file, flv_mpegts_frame_t *f, str_buf_t *b);
+int flv_mpegts_write_file(flv_mpegts_file_t *file, u_char *in, size_t in_size);
+
+/*
+ * PAT/PMT of FLV_MPEGTS_VIDEO and FLV_MPEGTS_AUDIO streams, the PCR
+ * is carried by video when there is video. with FLV_MPEGTS_SAMPLE_AES
+ * they are the encrypted stream types, asc is the AudioSpecificConfig
+ * the audio setup information carries.
+ */
+void flv_mpegts_make_header(u_char *header, unsigned streams, u_char *asc,
+    size_t asc_len);
 
 
 #endif /* _NGX_RTMP_MPEGTS_H_INCLUDED_ */
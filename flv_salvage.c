@@ -0,0 +1,175 @@
+/*
+ * a tag of flv is type, size, timestamp and a stream id that is
+ * always 0, then the data and the PreviousTagSize, 11 + size. random
+ * bytes have the type and three zeros at 8 once in a few hundred
+ * megabytes, the tags after a candidate tell the rest.
+ */
+
+
+#include "flv_salvage.h"
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#define FLV_SALVAGE_SSE2            1
+#endif
+
+
+#define FLV_SALVAGE_AUDIO           8
+#define FLV_SALVAGE_VIDEO           9
+#define FLV_SALVAGE_META            18
+
+
+#define flv_salvage_get32(p)                                                 \
+    (((u_int32_t) (p)[0] << 24) | ((u_int32_t) (p)[1] << 16)                 \
+     | ((u_int32_t) (p)[2] << 8) | (u_int32_t) (p)[3])
+
+#define flv_salvage_type(c)                                                  \
+    ((c) == FLV_SALVAGE_AUDIO || (c) == FLV_SALVAGE_VIDEO                    \
+     || (c) == FLV_SALVAGE_META)
+
+
+/* the size of the tag at p with its trailer, 0 when it looks wrong */
+static size_t
+flv_salvage_tag(const u_char *p, size_t len, u_int32_t min_ts,
+    unsigned flags)
+{
+    u_int32_t                           size;
+    u_int8_t                            c;
+
+    if (len < FLV_SALVAGE_TAG_MIN + 1 || !flv_salvage_type(p[0])
+        || p[8] || p[9] || p[10])
+    {
+        return 0;
+    }
+
+    size = flv_salvage_get24(p + 1);
+
+    if (size == 0 || size > FLV_SALVAGE_MAX_SIZE
+        || len < (size_t) size + FLV_SALVAGE_TAG_MIN
+        || flv_salvage_ts(p) < min_ts)
+    {
+        return 0;
+    }
+
+    if ((flags & FLV_SALVAGE_TRAILERS)
+        && flv_salvage_get32(p + 11 + size) != size + 11)
+    {
+        return 0;
+    }
+
+    c = p[11];
+
+    switch (p[0]) {
+
+    case FLV_SALVAGE_VIDEO:
+        /* frame type 1-5, the codec ids of flv and 12 for hevc */
+        if ((c >> 4) < 1 || (c >> 4) > 5
+            || (((c & 0x0f) < 1 || (c & 0x0f) > 7) && (c & 0x0f) != 12))
+        {
+            return 0;
+        }
+        break;
+
+    case FLV_SALVAGE_META:
+        /* the name, an amf0 string */
+        if (c != 0x02) {
+            return 0;
+        }
+        break;
+    }
+
+    return (size_t) size + FLV_SALVAGE_TAG_MIN;
+}
+
+
+static int
+flv_salvage_chain(const u_char *p, size_t len, u_int32_t min_ts,
+    unsigned flags)
+{
+    size_t                              n;
+    u_int32_t                           ts, i, chain;
+
+    chain = (flags & FLV_SALVAGE_TRAILERS) ? FLV_SALVAGE_CHAIN
+                                           : FLV_SALVAGE_CHAIN + 1;
+
+    for (i = 0; i < chain; i++) {
+        n = flv_salvage_tag(p, len, min_ts, flags);
+        if (n == 0) {
+            return 0;
+        }
+
+        if (n == len) {
+            return 1;
+        }
+
+        ts = flv_salvage_ts(p);
+        min_ts = ts > FLV_SALVAGE_TS_BACK ? ts - FLV_SALVAGE_TS_BACK : 0;
+
+        p += n;
+        len -= n;
+    }
+
+    return 1;
+}
+
+
+int64_t
+flv_salvage_scan(const u_char *p, size_t len, u_int32_t min_ts,
+    unsigned flags)
+{
+    size_t                              i;
+
+    i = 0;
+
+#ifdef FLV_SALVAGE_SSE2
+    {
+        __m128i                         a, v, s, z;
+        u_int32_t                       mask, k;
+
+        a = _mm_set1_epi8(FLV_SALVAGE_AUDIO);
+        v = _mm_set1_epi8(FLV_SALVAGE_VIDEO);
+        s = _mm_set1_epi8(FLV_SALVAGE_META);
+        z = _mm_setzero_si128();
+
+        /* a type where the three bytes at 8 are zero */
+        for ( /* void */ ; i + 26 <= len; i += 16) {
+            __m128i t, m;
+
+            t = _mm_loadu_si128((const __m128i *) (p + i));
+
+            m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(t, a),
+                                          _mm_cmpeq_epi8(t, v)),
+                             _mm_cmpeq_epi8(t, s));
+
+            t = _mm_or_si128(
+                    _mm_or_si128(
+                        _mm_loadu_si128((const __m128i *) (p + i + 8)),
+                        _mm_loadu_si128((const __m128i *) (p + i + 9))),
+                    _mm_loadu_si128((const __m128i *) (p + i + 10)));
+
+            m = _mm_and_si128(m, _mm_cmpeq_epi8(t, z));
+
+            mask = (u_int32_t) _mm_movemask_epi8(m);
+
+            while (mask) {
+                k = (u_int32_t) __builtin_ctz(mask);
+                mask &= mask - 1;
+
+                if (flv_salvage_chain(p + i + k, len - i - k, min_ts, flags)) {
+                    return (int64_t) (i + k);
+                }
+            }
+        }
+    }
+#endif
+
+    for ( /* void */ ; i + FLV_SALVAGE_TAG_MIN < len; i++) {
+        if (flv_salvage_type(p[i])
+            && flv_salvage_chain(p + i, len - i, min_ts, flags))
+        {
+            return (int64_t) i;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,50 @@
+/*
+ * resync on a damaged flv, the next tag that looks right after the
+ * bytes that do not. the candidates are found 16 bytes at a time by
+ * SSE2 and checked by the tags that follow them.
+ */
+
+
+#ifndef _FLV_SALVAGE_H_INCLUDED_
+#define _FLV_SALVAGE_H_INCLUDED_
+
+#include "common.h"
+
+
+/* the PreviousTagSize of the input were right so far, check them */
+#define FLV_SALVAGE_TRAILERS        0x01
+
+/* header and PreviousTagSize, the least a tag takes */
+#define FLV_SALVAGE_TAG_MIN         15
+
+/* msec a timestamp may go back, audio and video are interleaved */
+#define FLV_SALVAGE_TS_BACK         1000
+
+/* the largest tag taken, video keyframes of 4k stay far below */
+#define FLV_SALVAGE_MAX_SIZE        (8 * 1024 * 1024)
+
+/* the tags checked from a candidate, more when the sizes are unknown */
+#define FLV_SALVAGE_CHAIN           2
+
+/* the bytes after a candidate its check reads at most */
+#define FLV_SALVAGE_AHEAD                                                    \
+    ((FLV_SALVAGE_CHAIN + 1) * (FLV_SALVAGE_MAX_SIZE + FLV_SALVAGE_TAG_MIN))
+
+
+#define flv_salvage_get24(p)                                                 \
+    (((u_int32_t) (p)[0] << 16) | ((u_int32_t) (p)[1] << 8) | (p)[2])
+
+#define flv_salvage_ts(p)                                                    \
+    (flv_salvage_get24((p) + 4) | ((u_int32_t) (p)[7] << 24))
+
+
+/*
+ * the offset in p of the first tag not before min_ts that is whole,
+ * looks right and is followed by tags that do too, or by the end of
+ * p. -1 when there is none.
+ */
+int64_t flv_salvage_scan(const u_char *p, size_t len, u_int32_t min_ts,
+    unsigned flags);
+
+
+#endif /* _FLV_SALVAGE_H_INCLUDED_ */
@@ -1,879 +1,1093 @@
+/*
+ * spscounter, what is inside flv files before they are segmented: the
+ * codec headers and how often they change, the gops, the bitrate of
+ * each second, the drift of audio against video and the sizes of the
+ * tags. each file is mapped and its tags are walked in place, the
+ * files are shared by a few threads and reported as json or csv.
+ */
+
+
 #include <stdio.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include "FlvDecoder.h"
-#include "flv_mpegts.h"
+#include "flv_salvage.h"
 #include "common.h"
 
 
 #define NGX_RTMP_MSG_AUDIO              8
 #define NGX_RTMP_MSG_VIDEO              9
-#define NGX_RTMP_MSG_AMF3_META          15
-#define NGX_RTMP_MSG_AMF3_SHARED        16
-#define NGX_RTMP_MSG_AMF3_CMD           17
 #define NGX_RTMP_MSG_AMF_META           18
-#define NGX_RTMP_MSG_AMF_SHARED         19
 
-#define FLV_HLS_BUFSIZE            (1024*1024)
-#define FLV_HLS_DIR_ACCESS         0744
-int g_winfrages = 6;
-int g_fraglen = 3000;
-int g_max_fraglen = 5000;
+#define SPS_FORMAT_JSON                 0
+#define SPS_FORMAT_CSV                  1
 
-typedef struct {
-    u_int64_t                            id;
-    u_int64_t                            key_id;
-    double                              duration;
-    unsigned                            active:1;
-    unsigned                            discont:1; /* before */
-} hls_frag_t;
+#define SPS_MAX_THREADS                 64
 
-typedef struct {
-    unsigned                            opened:1;
+/* the keyframe intervals are counted by the msec they are up to */
+#define SPS_GOP_BUCKETS                 10
 
-    flv_mpegts_file_t                   file;
+static u_int32_t sps_gop_buckets[SPS_GOP_BUCKETS] = {
+    500, 1000, 2000, 3000, 4000, 5000, 6000, 8000, 10000, 0xffffffff
+};
 
-    std::string                         playlist;
-    std::string                         playlist_bak;
+static const char *sps_gop_names[SPS_GOP_BUCKETS] = {
+    "0.5", "1", "2", "3", "4", "5", "6", "8", "10", "inf"
+};
 
-    char                                stream[1024];
-    int                                   stream_len;
+int g_threads = 0;
+int g_format = SPS_FORMAT_JSON;
+int g_per_second = 0;
 
 
-    u_int64_t                            frag;
-    u_int64_t                            frag_ts;
-    u_int32_t                          nfrags;
-    hls_frag_t                          *frags; /* circular 2 * winfrags + 1 */
-    u_int32_t                          winfrags;
-    u_int32_t                          max_fraglen;
-    u_int32_t                          fraglen;
-
-    u_int32_t                          audio_cc;
-    u_int32_t                          video_cc;
-    u_int32_t                          key_frags;
+typedef struct {
+    u_int64_t                           n;
+    u_int64_t                           bytes;
+    u_int32_t                           min;
+    u_int32_t                           max;
+} sps_sizes_t;
 
-    u_int64_t                            aframe_base;
-    u_int64_t                            aframe_num;
 
-    str_buf_t                            *aframe;
-    u_int64_t                            aframe_pts;
-    int                                bStart;
-    
-    int                          max_audio_delay;
-    u_int32_t                       sync;
-} hls_ctx_t;
+typedef struct {
+    const char                          *path;
+    const char                          *error;    /* NULL when read */
+    int64_t                             size;
+    int64_t                             truncated; /* bytes at the end */
+    u_int32_t                           damaged;   /* ranges skipped */
+    int64_t                             damaged_bytes;
+    unsigned                            trailers:1;
+
+    /* timestamps, msec */
+    unsigned                            started:1;
+    u_int32_t                           first_ts;
+    u_int32_t                           last_ts;
+    u_int32_t                           prev_ts;
+    u_int64_t                           backward;
+    u_int32_t                           max_gap;
+
+    sps_sizes_t                         video_tags;
+    sps_sizes_t                         audio_tags;
+    u_int64_t                           meta_tags;
+
+    /* video, the last sequence header points into the map */
+    u_int32_t                           video_codec;
+    u_int32_t                           profile;
+    u_int32_t                           level;
+    u_int32_t                           width;
+    u_int32_t                           height;
+    u_int32_t                           ref_frames;
+    u_int32_t                           nal_bytes;
+    const u_char                        *avcc;
+    u_int32_t                           avcc_len;
+    u_int32_t                           avcc_headers;
+    u_int32_t                           avcc_changes;
+    u_int64_t                           inband_sps;
+    u_int64_t                           inband_pps;
+    u_int64_t                           frames;
+    u_int64_t                           keyframes;
+
+    /* gops, from a keyframe to the next */
+    unsigned                            key_seen:1;
+    u_int32_t                           key_ts;
+    u_int32_t                           gop_count; /* frames of this one */
+    u_int64_t                           gops;
+    u_int64_t                           gop_frames;
+    u_int32_t                           gop_frames_min;
+    u_int32_t                           gop_frames_max;
+    u_int64_t                           gop_msec;
+    u_int32_t                           gop_msec_min;
+    u_int32_t                           gop_msec_max;
+    u_int64_t                           gop_hist[SPS_GOP_BUCKETS];
+
+    /* audio */
+    u_int32_t                           audio_codec;
+    u_int32_t                           sample_rate;
+    u_int32_t                           channels;
+    const u_char                        *asc;
+    u_int32_t                           asc_len;
+    u_int32_t                           asc_headers;
+    u_int32_t                           asc_changes;
+    u_int64_t                           audio_frames;
+
+    /* audio minus video, msec */
+    unsigned                            audio_seen:1;
+    unsigned                            video_seen:1;
+    u_int32_t                           audio_ts;
+    u_int32_t                           video_ts;
+    int64_t                             drift_max;
+    int64_t                             drift_end;
+
+    /* bytes of each second, kept for the report only with -p */
+    u_int64_t                           *seconds;
+    u_int32_t                           nseconds;
+    u_int32_t                           max_seconds;
+    u_int32_t                           kbps_min;
+    u_int32_t                           kbps_avg;
+    u_int32_t                           kbps_max;
+} sps_stat_t;
 
 
+typedef struct {
+    sps_stat_t                          *stats;
+    u_int32_t                           n;
+    u_int32_t                           next;
+} sps_jobs_t;
 
-typedef struct Flv2hlsContext
-{
-    FlvFileReader flvreader;
-    FlvDecoder flvdec;
-    hls_ctx_t   hls_ctx;
-    av_codec_ctx_t  codec;
-}Flv2hlsContext_t;
-
-static hls_frag_t *
-hls_get_frag(hls_ctx_t  *ctx, int n)
-{
-    return &ctx->frags[(ctx->frag + n) % (ctx->winfrags * 2 + 1)];
-}
 
+#define sps_get24(p)                                                         \
+    (((u_int32_t) (p)[0] << 16) | ((u_int32_t) (p)[1] << 8) | (p)[2])
 
-Flv2hlsContext* flv_open_read(const char* file)
-{
-    Flv2hlsContext* flv = new Flv2hlsContext();
-    
-    if (flv->flvreader.open(file) != SUCCESS) {
-        flv_freep(flv);
-        return NULL;
-    }
-    
-    if (flv->flvdec.initialize(&flv->flvreader) != SUCCESS) {
-        flv_freep(flv);
-        return NULL;
-    }
-    
-    return flv;
-}
+#define sps_get32(p)                                                         \
+    (((u_int32_t) (p)[0] << 24) | ((u_int32_t) (p)[1] << 16)                 \
+     | ((u_int32_t) (p)[2] << 8) | (u_int32_t) (p)[3])
 
-void flv_close(Flv2hlsContext* flv)
-{
-    Flv2hlsContext* context = flv;
-    flv_freep(context);
-}
 
-int flv_read_header(Flv2hlsContext* flv, char (*header)[9], u_int32_t*pos)
+static void
+sps_sizes_add(sps_sizes_t *s, u_int32_t size)
 {
-    int ret = SUCCESS;
-    
-    Flv2hlsContext* context = (Flv2hlsContext*)flv;
-
-    if (!context->flvreader.is_open()) {
-        return ERROR_SYSTEM_IO_INVALID;
-    }
-    
-    if ((ret = context->flvdec.read_header(*header)) != SUCCESS) {
-        return ret;
+    if (s->n == 0 || size < s->min) {
+        s->min = size;
     }
-    
-    char ts[4]; // tag size
-    if ((ret = context->flvdec.read_previous_tag_size(ts)) != SUCCESS) {
-        return ret;
+
+    if (size > s->max) {
+        s->max = size;
     }
-    *pos = context->flvdec.getPosition();
-    return ret;
+
+    s->n++;
+    s->bytes += size;
 }
 
-int flv_read_tag_header(Flv2hlsContext* context, char* ptype, u_int32_t *pdata_size, u_int32_t* ptime)
+
+/* the sequence parameter set after the nal header byte */
+static void
+sps_parse_sps(sps_stat_t *st, const u_char *p, u_int32_t len)
 {
-    int ret = SUCCESS;
-    
+    u_int32_t               profile_idc, width, height, crop_left, crop_right,
+                            crop_top, crop_bottom, frame_mbs_only, n, cf_idc,
+                            num_ref_frames;
+    stream_bit_reader_t     br;
 
-    if (!context->flvreader.is_open()) {
-        return ERROR_SYSTEM_IO_INVALID;
-    }
-    
-    if ((ret = context->flvdec.read_tag_header(ptype, pdata_size, ptime)) != SUCCESS) {
-        return ret;
-    }
-    
-    return ret;
-}
+    stream_bit_init_reader(&br, (u_int8_t *) p, (u_int8_t *) p + len);
 
-int flv_read_tag_data(Flv2hlsContext* context, char**data, u_int32_t size, char type)
-{
-    int ret = SUCCESS;
-    
+    /* profile idc */
+    profile_idc = (u_int32_t) stream_bit_read(&br, 8);
 
-    if (!context->flvreader.is_open()) {
-        return ERROR_SYSTEM_IO_INVALID;
-    }
-    
-    if ((ret = context->flvdec.read_tag_data(data, size, type)) != SUCCESS) {
-        return ret;
-    }
-    
-    char ts[4]; // tag size
-    if ((ret = context->flvdec.read_previous_tag_size(ts)) != SUCCESS) {
-        return ret;
-    }
-    
-    return ret;
-}
+    /* flags */
+    stream_bit_read(&br, 8);
 
-int hls_init_playlist(hls_ctx_t*ctx, char*hls_path)
-{
-    int ret = SUCCESS;
-    ctx->playlist = std::string(hls_path) + ".m3u8";
-    ctx->playlist_bak = ctx->playlist + ".bak";
-    return ret;
-}
+    /* level idc */
+    st->level = (u_int32_t) stream_bit_read(&br, 8);
+    st->profile = profile_idc;
 
+    /* SPS id */
+    stream_bit_read_golomb(&br);
 
-int flv_hls_copy(void *dst, u_int8_t**src, int n)
-{
-    u_char  *last;
-    size_t   pn;
+    if (profile_idc == 100 || profile_idc == 110 ||
+        profile_idc == 122 || profile_idc == 244 || profile_idc == 44 ||
+        profile_idc == 83 || profile_idc == 86 || profile_idc == 118)
+    {
+        /* chroma format idc */
+        cf_idc = (u_int32_t) stream_bit_read_golomb(&br);
 
-    if (src == NULL || dst == NULL) {
-        return -1;
-    }
+        if (cf_idc == 3) {
 
-    memcpy(dst, *src, n);
-    *src += n;
-    return SUCCESS;
-}
+            /* separate color plane */
+            stream_bit_read(&br, 1);
+        }
 
+        /* bit depth luma - 8 */
+        stream_bit_read_golomb(&br);
 
-static int
-hls_append_aud(str_buf_t * out)
-{
-    static u_char   aud_nal[] = { 0x00, 0x00, 0x00, 0x01, 0x09, 0xf0 };
+        /* bit depth chroma - 8 */
+        stream_bit_read_golomb(&br);
 
-    if (out->last + sizeof(aud_nal) > out->end) {
-        return ERROR_NORMAL;
-    }
+        /* qpprime y zero transform bypass */
+        stream_bit_read(&br, 1);
 
-    memcpy(out->last, aud_nal, sizeof(aud_nal));
-    out->last += sizeof(aud_nal);
-    return SUCCESS;
-}
+        /* seq scaling matrix present */
+        if (stream_bit_read(&br, 1)) {
 
-static int
-hls_append_sps_pps(av_codec_ctx_t*codec_ctx, str_buf_t*out)
-{
-    u_int8_t                        *p;
-    u_int8_t                        *in;
-    hls_ctx_t             *ctx;
-    int8_t                          nnals;
-    u_int16_t                        len, rlen;
-    int                       n;
-    u_int8_t                        dummy[FLV_HLS_BUFSIZE];
-    in = codec_ctx->avc_header;
-
-    p = in;
-
-    /*
-     * Skip bytes:
-     * - flv fmt
-     * - H264 CONF/PICT (0x00)
-     * - 0
-     * - 0
-     * - 0
-     * - version
-     * - profile
-     * - compatibility
-     * - level
-     * - nal bytes
-     */
-    DEBUG("enter hls_append_sps_pps, buf size:%d\n", out->end-out->last);
-    if (flv_hls_copy(dummy, &p, 10) != SUCCESS) {
-        return SUCCESS;
-    }
-
-    /* number of SPS NALs */
-    if (flv_hls_copy(&nnals, &p, 1) != SUCCESS) {
-        return SUCCESS;
-    }
-
-    nnals &= 0x1f; /* 5lsb */
-
-    DEBUG("hls: SPS number: %u\n", nnals);
-
-    /* SPS */
-    for (n = 0; ; ++n) {
-        for (; nnals; --nnals) {
-
-            /* NAL length */
-            if (flv_hls_copy(&rlen, &p, 2) != SUCCESS) {
-                return SUCCESS;
+            for (n = 0; n < (cf_idc != 3 ? 8u : 12u); n++) {
+
+                /* seq scaling list present, the lists are not read */
+                stream_bit_read(&br, 1);
             }
+        }
+    }
 
-            flv_rmemcpy(&len, &rlen, 2);
+    /* log2 max frame num */
+    stream_bit_read_golomb(&br);
 
-            printf("hls: header NAL length: %u, buf size:%d\n", (size_t) len, out->end-out->last);
+    /* pic order cnt type */
+    switch (stream_bit_read_golomb(&br)) {
+    case 0:
 
-            /* AnnexB prefix */
-            if (out->end - out->last < 4) {
-                printf( "hls: too small buffer for header NAL size\n");
-                return ERROR_NORMAL;
-            }
+        /* max pic order cnt */
+        stream_bit_read_golomb(&br);
+        break;
 
-            *out->last++ = 0;
-            *out->last++ = 0;
-            *out->last++ = 0;
-            *out->last++ = 1;
+    case 1:
 
-            /* NAL body */
-            if (out->end - out->last < len) {
-                printf("hls: too small buffer for header NAL\n");
-                return ERROR_NORMAL;
-            }
-            
-            if (flv_hls_copy(out->last, &p, len) != SUCCESS) {
-                return SUCCESS;
-            }
-            out->last += len;
+        /* delta pic order alwys zero */
+        stream_bit_read(&br, 1);
 
-        }
+        /* offset for non-ref pic */
+        stream_bit_read_golomb(&br);
 
-        if (n == 1) {
-            break;
-        }
+        /* offset for top to bottom field */
+        stream_bit_read_golomb(&br);
 
-        /* number of PPS NALs */
-        if (flv_hls_copy(&nnals, &p, 1) != SUCCESS) {
-            return SUCCESS;
+        /* num ref frames in pic order */
+        num_ref_frames = (u_int32_t) stream_bit_read_golomb(&br);
+
+        for (n = 0; n < num_ref_frames && !stream_bit_read_err(&br); n++) {
+
+            /* offset for ref frame */
+            stream_bit_read_golomb(&br);
         }
-        DEBUG("PPS nnals:%d\n", nnals);
     }
 
-    return SUCCESS;
-}
+    /* num ref frames */
+    st->ref_frames = (u_int32_t) stream_bit_read_golomb(&br);
 
-static void
-hls_next_frag(hls_ctx_t *ctx)
-{
+    /* gaps in frame num allowed */
+    stream_bit_read(&br, 1);
 
-    if (ctx->nfrags == ctx->winfrags) {
-        ctx->frag++;
-    } else {
-        ctx->nfrags++;
+    /* pic width in mbs - 1 */
+    width = (u_int32_t) stream_bit_read_golomb(&br);
+
+    /* pic height in map units - 1 */
+    height = (u_int32_t) stream_bit_read_golomb(&br);
+
+    /* frame mbs only flag */
+    frame_mbs_only = (u_int32_t) stream_bit_read(&br, 1);
+
+    if (!frame_mbs_only) {
+
+        /* mbs adaprive frame field */
+        stream_bit_read(&br, 1);
     }
-}
 
-static int
-hls_rename_file(const char *src, const char *dst)
-{
-    /* rename file with overwrite */
+    /* direct 8x8 inference flag */
+    stream_bit_read(&br, 1);
+
+    /* frame cropping */
+    if (stream_bit_read(&br, 1)) {
+
+        crop_left = (u_int32_t) stream_bit_read_golomb(&br);
+        crop_right = (u_int32_t) stream_bit_read_golomb(&br);
+        crop_top = (u_int32_t) stream_bit_read_golomb(&br);
+        crop_bottom = (u_int32_t) stream_bit_read_golomb(&br);
+
+    } else {
+
+        crop_left = 0;
+        crop_right = 0;
+        crop_top = 0;
+        crop_bottom = 0;
+    }
 
+    if (stream_bit_read_err(&br)) {
+        return;
+    }
 
-    rename(src, dst);
-   return SUCCESS;
+    st->width = (width + 1) * 16 - (crop_left + crop_right) * 2;
+    st->height = (2 - frame_mbs_only) * (height + 1) * 16 -
+                 (crop_top + crop_bottom) * 2;
 }
 
 
-static int
-hls_write_playlist(hls_ctx_t *ctx)
+/* AVCDecoderConfigurationRecord, the first SPS is read */
+static void
+sps_parse_avcc(sps_stat_t *st, const u_char *p, u_int32_t len)
 {
-    static u_char                   buffer[1024];
-    int                                 fd;
-    u_char                         *p, *end;
-    ssize_t                         n;
+    u_int32_t                           n;
 
-    hls_frag_t            *f;
-    u_int32_t                      i, max_frag;
+    st->avcc_headers++;
 
+    if (st->avcc && (st->avcc_len != len || memcmp(st->avcc, p, len) != 0)) {
+        st->avcc_changes++;
+    }
 
-    fd = open(ctx->playlist_bak.c_str(), O_WRONLY|O_CREAT|O_TRUNC);
+    st->avcc = p;
+    st->avcc_len = len;
 
-    if (fd == -1) {
-        printf("hls: open file failed: '%s'\n",
-                      ctx->playlist_bak.c_str());
-        return ERROR_NORMAL;
+    if (len < 8) {
+        return;
     }
-    fchmod(fd, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH);
 
-    max_frag = ctx->fraglen / 1000;
+    st->nal_bytes = (p[4] & 0x03) + 1;
 
-    for (i = 0; i < ctx->nfrags; i++) {
-        f = hls_get_frag(ctx, i);
-        if (f->duration > max_frag) {
-            max_frag = (u_int32_t) (f->duration + .5);
-        }
+    if ((p[5] & 0x1f) == 0) {
+        return;
     }
 
-    p = buffer;
-    end = p + sizeof(buffer);
-
-    p += sprintf((char*)p, "#EXTM3U\n"
-                     "#EXT-X-VERSION:3\n"
-                     "#EXT-X-MEDIA-SEQUENCE:%u\n"
-                     "#EXT-X-TARGETDURATION:%u\n",
-                     ctx->frag, max_frag);
+    n = ((u_int32_t) p[6] << 8) | p[7];
 
-    printf("will write buf:%s, size:%d", buffer, p-buffer);
-    n = write(fd, buffer, p - buffer);
-    if (n <= 0) {
-        printf("hls:write failed: '%s'\n",
-                      ctx->playlist_bak.c_str());
-        close(fd);
-        return ERROR_NORMAL;
+    if (n < 2 || 8 + n > len || (p[8] & 0x1f) != 7) {
+        return;
     }
 
+    sps_parse_sps(st, p + 9, n - 1);
+}
 
-    for (i = 0; i < ctx->nfrags; i++) {
-        f = hls_get_frag(ctx, i);
 
-        p = buffer;
-        end = p + sizeof(buffer);
+/* the in-band parameter sets among the NAL units of a frame */
+static void
+sps_count_nals(sps_stat_t *st, const u_char *p, u_int32_t len)
+{
+    const u_char                        *last;
+    u_int32_t                           n, i;
+
+    last = p + len;
 
-        if (f->discont) {
-            p += sprintf((char*)p, "#EXT-X-DISCONTINUITY\n");
+    while ((u_int32_t) (last - p) > st->nal_bytes) {
+        for (n = 0, i = 0; i < st->nal_bytes; i++) {
+            n = (n << 8) | *p++;
         }
 
+        if (n == 0 || n > (u_int32_t) (last - p)) {
+            return;
+        }
+
+        switch (p[0] & 0x1f) {
+        case 7:
+            st->inband_sps++;
+            break;
+        case 8:
+            st->inband_pps++;
+            break;
+        }
+
+        p += n;
+    }
+}
+
 
-        p += sprintf((char*)p, "#EXTINF:%.3f,\n"
-                         "%u.ts\n",
-                         f->duration, f->id);
+static void
+sps_video(sps_stat_t *st, u_int32_t ts, const u_char *p, u_int32_t len)
+{
+    u_int32_t                           i, msec;
+    int                                 key;
 
+    st->video_codec = p[0] & 0x0f;
+    key = ((p[0] >> 4) == 1);
 
-        n = write(fd, buffer, p - buffer);
-        if (n <= 0) {
-            printf("hls: write failed '%V'",
-                          ctx->playlist_bak.c_str());
-            close(fd);
-            return ERROR_NORMAL;
+    /* AVC sequence header and end of sequence are no frames */
+    if (st->video_codec == 7 && len >= 5) {
+        if (p[1] == 0) {
+            sps_parse_avcc(st, p + 5, len - 5);
+            return;
         }
+
+        if (p[1] != 1) {
+            return;
+        }
+
+        sps_count_nals(st, p + 5, len - 5);
     }
 
-    close(fd);
+    st->frames++;
 
-    hls_rename_file(ctx->playlist_bak.c_str(), ctx->playlist.c_str());
+    if (key) {
+        st->keyframes++;
 
-    return SUCCESS;
+        if (st->key_seen) {
+            msec = ts - st->key_ts;
+
+            if (st->gops == 0 || st->gop_count < st->gop_frames_min) {
+                st->gop_frames_min = st->gop_count;
+            }
+
+            if (st->gops == 0 || msec < st->gop_msec_min) {
+                st->gop_msec_min = msec;
+            }
+
+            if (st->gop_count > st->gop_frames_max) {
+                st->gop_frames_max = st->gop_count;
+            }
+
+            if (msec > st->gop_msec_max) {
+                st->gop_msec_max = msec;
+            }
+
+            for (i = 0; msec > sps_gop_buckets[i]; i++) { /* void */ }
+            st->gop_hist[i]++;
+
+            st->gops++;
+            st->gop_frames += st->gop_count;
+            st->gop_msec += msec;
+        }
+
+        st->key_seen = 1;
+        st->key_ts = ts;
+        st->gop_count = 0;
+    }
+
+    st->gop_count++;
 }
 
 
-static int
-hls_close_fragment(hls_ctx_t *ctx, u_int32_t ts)
+static void
+sps_audio(sps_stat_t *st, const u_char *p, u_int32_t len)
 {
-    DEBUG("hls_close_fragment frag:%d, nfrags:%d\n", ctx->frag, ctx->nfrags);
-    if( ctx->frag != 0 || ctx->nfrags != 0 )
-    {
-        close(ctx->file.fd);
-        ctx->opened = 0;
-    }else{
-    /*
-        if( ctx->aframe )
+    static u_int32_t    rates[] = { 5512, 11025, 22050, 44100 };
+    static u_int32_t    aac_rates[] =
+        { 96000, 88200, 64000, 48000,
+          44100, 32000, 24000, 22050,
+          16000, 12000, 11025,  8000,
+           7350,     0,     0,     0 };
+
+    st->audio_codec = p[0] >> 4;
+
+    /* AAC sequence header, the AudioSpecificConfig */
+    if (st->audio_codec == 10 && len >= 2 && p[1] == 0) {
+        st->asc_headers++;
+
+        if (st->asc
+            && (st->asc_len != len - 2 || memcmp(st->asc, p + 2, len - 2) != 0))
         {
-            DEBUG("*********clean aframe***************\n");
-            memset(ctx->aframe->buf, 0, sizeof(MAX_FRAME_SIZE));
-            ctx->aframe->last = ctx->aframe->pos = ctx->aframe->start = ctx->aframe->buf;
-            ctx->aframe_pts = 0;
+            st->asc_changes++;
         }
-        */
-        ctx->bStart = 1;
+
+        st->asc = p + 2;
+        st->asc_len = len - 2;
+
+        if (len >= 4) {
+            st->sample_rate = aac_rates[((p[2] & 0x07) << 1) | (p[3] >> 7)];
+            st->channels = (p[3] >> 3) & 0x0f;
+        }
+
+        return;
     }
-    hls_next_frag(ctx);
 
-    if( ctx->frag != 0 || ctx->nfrags != 1)
-    {
-        hls_write_playlist(ctx);
+    if (st->audio_codec != 10) {
+        st->sample_rate = rates[(p[0] >> 2) & 0x03];
+        st->channels = (p[0] & 0x01) + 1;
     }
-    return SUCCESS;
+
+    st->audio_frames++;
 }
 
-static u_int64_t
-flv_hls_get_fragment_id(hls_ctx_t*ctx)
+
+static void
+sps_second(sps_stat_t *st, u_int32_t ts, u_int32_t bytes)
 {
-    return ctx->frag + ctx->nfrags;    
-}
+    u_int32_t                           i, n;
+    u_int64_t                           *s;
 
+    i = (ts - st->first_ts) / 1000;
 
+    /* damage that makes the time jump far is not counted */
+    if (ts < st->first_ts || i > 30 * 24 * 3600) {
+        return;
+    }
 
+    if (i >= st->max_seconds) {
+        n = st->max_seconds ? st->max_seconds : 1024;
+        while (n <= i) {
+            n *= 2;
+        }
 
+        s = (u_int64_t *) realloc(st->seconds, n * sizeof(u_int64_t));
+        if (s == NULL) {
+            return;
+        }
 
+        memset(s + st->max_seconds, 0,
+               (n - st->max_seconds) * sizeof(u_int64_t));
 
+        st->seconds = s;
+        st->max_seconds = n;
+    }
 
+    st->seconds[i] += bytes;
 
-static int
-hls_parse_aac_header(av_codec_ctx_t   *codec_ctx, u_int32_t *objtype,
-    u_int32_t *srindex, u_int32_t *chconf)
+    if (i >= st->nseconds) {
+        st->nseconds = i + 1;
+    }
+}
+
+
+static void
+sps_tag(sps_stat_t *st, const u_char *t)
 {
-    u_int8_t            *cl;
-    u_char             p[2];
-    u_char              b0, b1;
-    DEBUG("enter hls_parse_aac_header\n");
-    cl = codec_ctx->aac_header;
+    u_int32_t                           type, size, ts;
+    int64_t                             drift;
+    const u_char                        *p;
 
-    if (flv_hls_copy(p, &cl, 2) != SUCCESS) {
-        return ERROR_NORMAL;
-    }
+    type = t[0];
+    size = sps_get24(t + 1);
+    ts = sps_get24(t + 4) | ((u_int32_t) t[7] << 24);
+    p = t + 11;
 
-    if (flv_hls_copy(&b0, &cl, 1) != SUCCESS) {
-        return ERROR_NORMAL;
-    }
+    if (!st->started) {
+        st->started = 1;
+        st->first_ts = ts;
+        st->last_ts = ts;
 
-    if (flv_hls_copy(&b1, &cl, 1) != SUCCESS) {
-        return ERROR_NORMAL;
+    } else if (ts < st->prev_ts) {
+        st->backward++;
+
+    } else if (ts - st->prev_ts > st->max_gap) {
+        st->max_gap = ts - st->prev_ts;
     }
 
-    *objtype = b0 >> 3;
-    if (*objtype == 0 || *objtype == 0x1f) {
-        ERROR( "error: hls_parse_aac_header unsupported adts object type:%u\n", *objtype);
-        return ERROR_NORMAL;
+    st->prev_ts = ts;
+
+    if (ts > st->last_ts) {
+        st->last_ts = ts;
     }
 
-    if (*objtype > 4) {
+    sps_second(st, ts, size + 15);
 
-        /*
-         * Mark all extended profiles as LC
-         * to make Android as happy as possible.
-         */
+    switch (type) {
 
-        *objtype = 2;
-    }
+    case NGX_RTMP_MSG_VIDEO:
+        sps_sizes_add(&st->video_tags, size);
+        sps_video(st, ts, p, size);
+        st->video_seen = 1;
+        st->video_ts = ts;
+        break;
 
-    *srindex = ((b0 << 1) & 0x0f) | ((b1 & 0x80) >> 7);
-    if (*srindex == 0x0f) {
-        ERROR( "error: hls_parse_aac_header unsupported adts sample rate:%u\n", *srindex);
-        return ERROR_NORMAL;
+    case NGX_RTMP_MSG_AUDIO:
+        sps_sizes_add(&st->audio_tags, size);
+        sps_audio(st, p, size);
+        st->audio_seen = 1;
+        st->audio_ts = ts;
+        break;
+
+    default:
+        st->meta_tags++;
+        return;
     }
 
-    *chconf = (b1 >> 3) & 0x0f;
+    if (st->audio_seen && st->video_seen) {
+        drift = (int64_t) st->audio_ts - (int64_t) st->video_ts;
 
-    DEBUG( "hls: aac object_type:%u, sample_rate_index:%u, "
-                   "channel_config:%u\n", *objtype, *srindex, *chconf);
+        if ((drift < 0 ? -drift : drift)
+            > (st->drift_max < 0 ? -st->drift_max : st->drift_max))
+        {
+            st->drift_max = drift;
+        }
 
-    return SUCCESS;
+        st->drift_end = drift;
+    }
 }
 
 
+/* the whole seconds, the last one is cut by the end */
 static void
-av_codec_parse_aac_header(Flv2hlsContext*context, u_int8_t*data, int data_len)
+sps_bitrate(sps_stat_t *st)
 {
-    u_int32_t               idx;
-    av_codec_ctx_t          *ctx = &context->codec;
-    stream_bit_reader_t     br;
-    static u_int32_t    aac_sample_rates[] =
-        { 96000, 88200, 64000, 48000,
-          44100, 32000, 24000, 22050,
-          16000, 12000, 11025,  8000,
-           7350,     0,     0,     0 };
+    u_int32_t                           i, n;
+    u_int64_t                           kbps, sum;
 
-    stream_bit_init_reader(&br, data, data+data_len);
+    n = st->nseconds > 1 ? st->nseconds - 1 : st->nseconds;
+    sum = 0;
 
-    stream_bit_read(&br, 16);
+    for (i = 0; i < n; i++) {
+        kbps = st->seconds[i] * 8 / 1000;
+
+        if (i == 0 || kbps < st->kbps_min) {
+            st->kbps_min = (u_int32_t) kbps;
+        }
 
-    ctx->aac_profile = (u_int32_t) stream_bit_read(&br, 5);
-    if (ctx->aac_profile == 31) {
-        ctx->aac_profile = (u_int32_t) stream_bit_read(&br, 6) + 32;
+        if (kbps > st->kbps_max) {
+            st->kbps_max = (u_int32_t) kbps;
+        }
+
+        sum += kbps;
     }
 
-    idx = (u_int32_t) stream_bit_read(&br, 4);
-    if (idx == 15) {
-        ctx->sample_rate = (u_int32_t) stream_bit_read(&br, 24);
-    } else {
-        ctx->sample_rate = aac_sample_rates[idx];
+    st->kbps_avg = n ? (u_int32_t) (sum / n) : 0;
+
+    if (!g_per_second) {
+        free(st->seconds);
+        st->seconds = NULL;
+        st->max_seconds = 0;
     }
+}
 
-    ctx->aac_chan_conf = (u_int32_t) stream_bit_read(&br, 4);
 
-    if (ctx->aac_profile == 5 || ctx->aac_profile == 29) {
-        
-        if (ctx->aac_profile == 29) {
-            ctx->aac_ps = 1;
-        }
+/*
+ * walk the tags in the map. a tag that is no tag is skipped to the
+ * next one as flv2hls does, what is left at the end is truncated.
+ */
+static void
+sps_walk(sps_stat_t *st, const u_char *p, int64_t size)
+{
+    int64_t                             off, found;
+    const u_char                        *t;
+    u_int32_t                           n, min_ts;
+    int                                 checked, ok;
+
+    if (size < 13 || p[0] != 'F' || p[1] != 'L' || p[2] != 'V') {
+        st->error = "no flv header";
+        return;
+    }
 
-        ctx->aac_sbr = 1;
+    off = (int64_t) sps_get32(p + 5) + 4;
+    checked = 0;
 
-        idx = (u_int32_t) stream_bit_read(&br, 4);
-        if (idx == 15) {
-            ctx->sample_rate = (u_int32_t) stream_bit_read(&br, 24);
-        } else {
-            ctx->sample_rate = aac_sample_rates[idx];
+    while (off + 11 <= size) {
+        t = p + off;
+        n = sps_get24(t + 1);
+
+        ok = (t[0] == NGX_RTMP_MSG_AUDIO || t[0] == NGX_RTMP_MSG_VIDEO
+              || t[0] == NGX_RTMP_MSG_AMF_META)
+             && !t[8] && !t[9] && !t[10] && n > 0
+             && off + 15 + n <= size;
+
+        if (ok && !checked) {
+            checked = 1;
+            st->trailers = (sps_get32(t + 11 + n) == n + 11);
+
+        } else if (ok && st->trailers) {
+            ok = (sps_get32(t + 11 + n) == n + 11);
+        }
+
+        if (ok) {
+            sps_tag(st, t);
+            off += 15 + n;
+            continue;
         }
 
-        ctx->aac_profile = (u_int32_t) stream_bit_read(&br, 5);
-        if (ctx->aac_profile == 31) {
-            ctx->aac_profile = (u_int32_t) stream_bit_read(&br, 6) + 32;
+        min_ts = st->prev_ts > FLV_SALVAGE_TS_BACK
+                 ? st->prev_ts - FLV_SALVAGE_TS_BACK : 0;
+
+        found = flv_salvage_scan(t + 1, (size_t) (size - off - 1), min_ts,
+                                 st->trailers ? FLV_SALVAGE_TRAILERS : 0);
+        if (found < 0) {
+            break;
         }
+
+        st->damaged++;
+        st->damaged_bytes += found + 1;
+        off += found + 1;
     }
 
-    /* MPEG-4 Audio Specific Config
-
-       5 bits: object type
-       if (object type == 31)
-         6 bits + 32: object type
-       4 bits: frequency index
-       if (frequency index == 15)
-         24 bits: frequency
-       4 bits: channel configuration
-
-       if (object_type == 5)
-           4 bits: frequency index
-           if (frequency index == 15)
-             24 bits: frequency
-           5 bits: object type
-           if (object type == 31)
-             6 bits + 32: object type
-             
-       var bits: AOT Specific Config
-     */
-
-    DEBUG("codec: aac header profile=%u, "
-           "sample_rate=%u, chan_conf=%u\n",
-           ctx->aac_profile, ctx->sample_rate, ctx->aac_chan_conf);
+    st->truncated = size - off;
 }
 
 
 static void
-av_codec_parse_avc_header(Flv2hlsContext*context, u_int8_t*data, int data_len)
+sps_analyze(sps_stat_t *st)
 {
-    u_int32_t               profile_idc, width, height, crop_left, crop_right,
-                            crop_top, crop_bottom, frame_mbs_only, n, cf_idc,
-                            num_ref_frames;
-    av_codec_ctx_t   *ctx = &context->codec;
-    stream_bit_reader_t   br;
-    u_int8_t                *p = data;
-    u_int8_t                tm = 0;
-    stream_bit_init_reader(&br, data, data+data_len);
+    struct stat                         sb;
+    u_char                              *p;
+    int                                 fd;
 
-    stream_bit_read(&br, 48);
+    fd = open(st->path, O_RDONLY);
+    if (fd == -1) {
+        st->error = strerror(errno);
+        return;
+    }
 
-    ctx->avc_profile = (u_int32_t) stream_bit_read_8(&br);
-    ctx->avc_compat = (u_int32_t) stream_bit_read_8(&br);
-    ctx->avc_level = (u_int32_t) stream_bit_read_8(&br);
+    if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode)) {
+        st->error = "not a regular file";
+        close(fd);
+        return;
+    }
 
-    /* nal bytes */
-    ctx->avc_nal_bytes = (u_int32_t) ((stream_bit_read_8(&br) & 0x03) + 1);
+    st->size = sb.st_size;
 
-    /* nnals */
-    if ((stream_bit_read_8(&br) & 0x1f) == 0) {
+    if (st->size == 0) {
+        st->error = "empty";
+        close(fd);
         return;
     }
 
-    /* nal size */
-    stream_bit_read(&br, 16);
+    p = (u_char *) mmap(NULL, (size_t) st->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
 
-    /* nal type */
-    if ( (tm = stream_bit_read_8(&br)) != 0x67 && tm != 0x68) {
+    if (p == MAP_FAILED) {
+        st->error = strerror(errno);
         return;
     }
-    if(tm == 0x67){
-      DEBUG("we have sps\n");
-    }else if(tm == 0x68)
-    {
-      DEBUG("we have pps\n");
-      return;
-    }
-    /* SPS */
 
-    /* profile idc */
-    profile_idc = (u_int32_t) stream_bit_read(&br, 8);
+    madvise(p, (size_t) st->size, MADV_SEQUENTIAL);
 
-    /* flags */
-    stream_bit_read(&br, 8);
+    sps_walk(st, p, st->size);
 
-    /* level idc */
-    stream_bit_read(&br, 8);
+    /* the headers pointed into the map */
+    munmap(p, (size_t) st->size);
+    st->avcc = NULL;
+    st->asc = NULL;
 
-    /* SPS id */
-    stream_bit_read_golomb(&br);
+    sps_bitrate(st);
+}
 
-    if (profile_idc == 100 || profile_idc == 110 ||
-        profile_idc == 122 || profile_idc == 244 || profile_idc == 44 ||
-        profile_idc == 83 || profile_idc == 86 || profile_idc == 118)
-    {
-        /* chroma format idc */
-        cf_idc = (u_int32_t) stream_bit_read_golomb(&br);
-        
-        if (cf_idc == 3) {
 
-            /* separate color plane */
-            stream_bit_read(&br, 1);
+static void *
+sps_worker(void *data)
+{
+    sps_jobs_t                          *jobs;
+    u_int32_t                           i;
+
+    jobs = (sps_jobs_t *) data;
+
+    for ( ;; ) {
+        i = __sync_fetch_and_add(&jobs->next, 1);
+        if (i >= jobs->n) {
+            return NULL;
         }
 
-        /* bit depth luma - 8 */
-        stream_bit_read_golomb(&br);
+        sps_analyze(&jobs->stats[i]);
+    }
+}
 
-        /* bit depth chroma - 8 */
-        stream_bit_read_golomb(&br);
 
-        /* qpprime y zero transform bypass */
-        stream_bit_read(&br, 1);
+static void
+sps_print_string(FILE *out, const char *s, int json)
+{
+    fputc('"', out);
 
-        /* seq scaling matrix present */
-        if (stream_bit_read(&br, 1)) {
+    for ( /* void */ ; *s; s++) {
+        if (*s == '"') {
+            fputs(json ? "\\\"" : "\"\"", out);
 
-            for (n = 0; n < (cf_idc != 3 ? 8u : 12u); n++) {
+        } else if (json && *s == '\\') {
+            fputs("\\\\", out);
 
-                /* seq scaling list present */
-                if (stream_bit_read(&br, 1)) {
+        } else if (json && (u_char) *s < 0x20) {
+            fprintf(out, "\\u%04x", (u_char) *s);
 
-                    /* TODO: scaling_list()
-                    if (n < 6) {
-                    } else {
-                    }
-                    */
-                }
-            }
+        } else {
+            fputc(*s, out);
         }
     }
 
-    /* log2 max frame num */
-    stream_bit_read_golomb(&br);
+    fputc('"', out);
+}
 
-    /* pic order cnt type */
-    switch (stream_bit_read_golomb(&br)) {
-    case 0:
 
-        /* max pic order cnt */
-        stream_bit_read_golomb(&br);
-        break;
-
-    case 1:
+static u_int32_t
+sps_avg(u_int64_t sum, u_int64_t n)
+{
+    return n ? (u_int32_t) (sum / n) : 0;
+}
 
-        /* delta pic order alwys zero */
-        stream_bit_read(&br, 1);
 
-        /* offset for non-ref pic */
-        stream_bit_read_golomb(&br);
+static void
+sps_print_json(FILE *out, sps_stat_t *st)
+{
+    u_int32_t                           i;
 
-        /* offset for top to bottom field */
-        stream_bit_read_golomb(&br);
+    fprintf(out, "{\"file\":");
+    sps_print_string(out, st->path, 1);
 
-        /* num ref frames in pic order */
-        num_ref_frames = (u_int32_t) stream_bit_read_golomb(&br);
+    if (st->error) {
+        fprintf(out, ",\"error\":");
+        sps_print_string(out, st->error, 1);
+        fprintf(out, "}");
+        return;
+    }
 
-        for (n = 0; n < num_ref_frames; n++) {
+    fprintf(out,
+            ",\"size\":%lld,\"duration_ms\":%u"
+            ",\"damaged\":{\"ranges\":%u,\"bytes\":%lld}"
+            ",\"truncated_bytes\":%lld,\"trailers\":%s"
+            ",\"tags\":{\"video\":%llu,\"audio\":%llu,\"meta\":%llu}"
+            ",\"tag_size\":{\"video\":{\"min\":%u,\"avg\":%u,\"max\":%u}"
+            ",\"audio\":{\"min\":%u,\"avg\":%u,\"max\":%u}}",
+            (long long) st->size, st->last_ts - st->first_ts,
+            st->damaged, (long long) st->damaged_bytes,
+            (long long) st->truncated, st->trailers ? "true" : "false",
+            (unsigned long long) st->video_tags.n,
+            (unsigned long long) st->audio_tags.n,
+            (unsigned long long) st->meta_tags,
+            st->video_tags.min,
+            sps_avg(st->video_tags.bytes, st->video_tags.n),
+            st->video_tags.max, st->audio_tags.min,
+            sps_avg(st->audio_tags.bytes, st->audio_tags.n),
+            st->audio_tags.max);
+
+    fprintf(out,
+            ",\"video\":{\"codec\":%u,\"profile\":%u,\"level\":%u"
+            ",\"width\":%u,\"height\":%u,\"ref_frames\":%u"
+            ",\"frames\":%llu,\"keyframes\":%llu"
+            ",\"sequence_headers\":%u,\"sequence_header_changes\":%u"
+            ",\"inband_sps\":%llu,\"inband_pps\":%llu}",
+            st->video_codec, st->profile, st->level, st->width, st->height,
+            st->ref_frames, (unsigned long long) st->frames,
+            (unsigned long long) st->keyframes, st->avcc_headers,
+            st->avcc_changes, (unsigned long long) st->inband_sps,
+            (unsigned long long) st->inband_pps);
+
+    fprintf(out,
+            ",\"gop\":{\"count\":%llu"
+            ",\"frames\":{\"min\":%u,\"avg\":%u,\"max\":%u}"
+            ",\"ms\":{\"min\":%u,\"avg\":%u,\"max\":%u},\"histogram\":{",
+            (unsigned long long) st->gops, st->gop_frames_min,
+            sps_avg(st->gop_frames, st->gops), st->gop_frames_max,
+            st->gop_msec_min, sps_avg(st->gop_msec, st->gops),
+            st->gop_msec_max);
+
+    for (i = 0; i < SPS_GOP_BUCKETS; i++) {
+        fprintf(out, "%s\"%s\":%llu", i ? "," : "", sps_gop_names[i],
+                (unsigned long long) st->gop_hist[i]);
+    }
 
-            /* offset for ref frame */
-            stream_bit_read_golomb(&br);
+    fprintf(out,
+            "}},\"audio\":{\"codec\":%u,\"sample_rate\":%u,\"channels\":%u"
+            ",\"frames\":%llu,\"sequence_headers\":%u"
+            ",\"sequence_header_changes\":%u}"
+            ",\"drift_ms\":{\"max\":%lld,\"end\":%lld}"
+            ",\"timestamps\":{\"backward\":%llu,\"max_gap_ms\":%u}"
+            ",\"bitrate_kbps\":{\"min\":%u,\"avg\":%u,\"max\":%u",
+            st->audio_codec, st->sample_rate, st->channels,
+            (unsigned long long) st->audio_frames, st->asc_headers,
+            st->asc_changes, (long long) st->drift_max,
+            (long long) st->drift_end, (unsigned long long) st->backward,
+            st->max_gap, st->kbps_min, st->kbps_avg, st->kbps_max);
+
+    if (st->seconds) {
+        fprintf(out, ",\"per_second\":[");
+
+        for (i = 0; i < st->nseconds; i++) {
+            fprintf(out, "%s%llu", i ? "," : "",
+                    (unsigned long long) (st->seconds[i] * 8 / 1000));
         }
+
+        fprintf(out, "]");
     }
 
-    /* num ref frames */
-    ctx->avc_ref_frames = (u_int32_t) stream_bit_read_golomb(&br);
+    fprintf(out, "}}");
+}
 
-    /* gaps in frame num allowed */
-    stream_bit_read(&br, 1);
 
-    /* pic width in mbs - 1 */
-    width = (u_int32_t) stream_bit_read_golomb(&br);
+static void
+sps_print_csv_header(FILE *out)
+{
+    u_int32_t                           i;
+
+    fprintf(out,
+            "file,error,size,duration_ms,damaged_ranges,damaged_bytes,"
+            "truncated_bytes,video_tags,audio_tags,meta_tags,"
+            "video_size_min,video_size_avg,video_size_max,"
+            "audio_size_min,audio_size_avg,audio_size_max,"
+            "video_codec,profile,level,width,height,ref_frames,frames,"
+            "keyframes,avc_headers,avc_header_changes,inband_sps,inband_pps,"
+            "gops,gop_frames_min,gop_frames_avg,gop_frames_max,"
+            "gop_ms_min,gop_ms_avg,gop_ms_max");
+
+    for (i = 0; i < SPS_GOP_BUCKETS; i++) {
+        fprintf(out, ",gop_le_%s", sps_gop_names[i]);
+    }
 
-    /* pic height in map units - 1 */
-    height = (u_int32_t) stream_bit_read_golomb(&br);
+    fprintf(out,
+            ",audio_codec,sample_rate,channels,audio_frames,asc_headers,"
+            "asc_changes,drift_max_ms,drift_end_ms,ts_backward,max_gap_ms,"
+            "kbps_min,kbps_avg,kbps_max\n");
+}
 
-    /* frame mbs only flag */
-    frame_mbs_only = (u_int32_t) stream_bit_read(&br, 1);
 
-    if (!frame_mbs_only) {
+static void
+sps_print_csv(FILE *out, sps_stat_t *st)
+{
+    u_int32_t                           i;
 
-        /* mbs adaprive frame field */
-        stream_bit_read(&br, 1);
+    sps_print_string(out, st->path, 0);
+    fputc(',', out);
+
+    if (st->error) {
+        sps_print_string(out, st->error, 0);
+        fputc('\n', out);
+        return;
     }
 
-    /* direct 8x8 inference flag */
-    stream_bit_read(&br, 1);
+    fprintf(out,
+            ",%lld,%u,%u,%lld,%lld,%llu,%llu,%llu,%u,%u,%u,%u,%u,%u",
+            (long long) st->size, st->last_ts - st->first_ts, st->damaged,
+            (long long) st->damaged_bytes, (long long) st->truncated,
+            (unsigned long long) st->video_tags.n,
+            (unsigned long long) st->audio_tags.n,
+            (unsigned long long) st->meta_tags, st->video_tags.min,
+            sps_avg(st->video_tags.bytes, st->video_tags.n),
+            st->video_tags.max, st->audio_tags.min,
+            sps_avg(st->audio_tags.bytes, st->audio_tags.n),
+            st->audio_tags.max);
+
+    fprintf(out,
+            ",%u,%u,%u,%u,%u,%u,%llu,%llu,%u,%u,%llu,%llu",
+            st->video_codec, st->profile, st->level, st->width, st->height,
+            st->ref_frames, (unsigned long long) st->frames,
+            (unsigned long long) st->keyframes, st->avcc_headers,
+            st->avcc_changes, (unsigned long long) st->inband_sps,
+            (unsigned long long) st->inband_pps);
+
+    fprintf(out, ",%llu,%u,%u,%u,%u,%u,%u",
+            (unsigned long long) st->gops, st->gop_frames_min,
+            sps_avg(st->gop_frames, st->gops), st->gop_frames_max,
+            st->gop_msec_min, sps_avg(st->gop_msec, st->gops),
+            st->gop_msec_max);
+
+    for (i = 0; i < SPS_GOP_BUCKETS; i++) {
+        fprintf(out, ",%llu", (unsigned long long) st->gop_hist[i]);
+    }
 
-    /* frame cropping */
-    if (stream_bit_read(&br, 1)) {
+    fprintf(out, ",%u,%u,%u,%llu,%u,%u,%lld,%lld,%llu,%u,%u,%u,%u\n",
+            st->audio_codec, st->sample_rate, st->channels,
+            (unsigned long long) st->audio_frames, st->asc_headers,
+            st->asc_changes, (long long) st->drift_max,
+            (long long) st->drift_end, (unsigned long long) st->backward,
+            st->max_gap, st->kbps_min, st->kbps_avg, st->kbps_max);
+}
 
-        crop_left = (u_int32_t) stream_bit_read_golomb(&br);
-        crop_right = (u_int32_t) stream_bit_read_golomb(&br);
-        crop_top = (u_int32_t) stream_bit_read_golomb(&br);
-        crop_bottom = (u_int32_t) stream_bit_read_golomb(&br);
 
-    } else {
+/* paths one by line, "-" for stdin */
+static int
+sps_read_list(const char *name, std::vector<std::string> &paths)
+{
+    FILE                                *f;
+    char                                line[4096];
+    size_t                              n;
 
-        crop_left = 0;
-        crop_right = 0;
-        crop_top = 0;
-        crop_bottom = 0;
+    f = strcmp(name, "-") == 0 ? stdin : fopen(name, "r");
+    if (f == NULL) {
+        ERROR("error: open list %s failed, %s\n", name, strerror(errno));
+        return ERROR_NORMAL;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        n = strcspn(line, "\r\n");
+        line[n] = 0;
+
+        if (n) {
+            paths.push_back(line);
+        }
+    }
+
+    if (f != stdin) {
+        fclose(f);
     }
 
-    ctx->width = (width + 1) * 16 - (crop_left + crop_right) * 2;
-    ctx->height = (2 - frame_mbs_only) * (height + 1) * 16 -
-                  (crop_top + crop_bottom) * 2;
-    printf("profile:%d,compat:%d,level:%d,profile_idc:%d,num_ref:%d, width:%d,height:%d\n", ctx->avc_profile,ctx->avc_compat,ctx->avc_level,profile_idc,num_ref_frames,  ctx->width,ctx->height);
+    return SUCCESS;
 }
 
-Flv2hlsContext* init_context(char*flv_meta_path)
+
+static void
+usage(const char *name)
 {
-    Flv2hlsContext* context = new Flv2hlsContext();
-    hls_ctx_t   *ctx;
-    char hls_path[1024] = {0};
-    snprintf(hls_path, 1024,  "hls_%s", flv_meta_path);
-    if (context->flvreader.open(flv_meta_path) != SUCCESS) {
-        flv_freep(context);
-        return NULL;
-    }
-    
-    if (context->flvdec.initialize(&context->flvreader) != SUCCESS) {
-        flv_freep(context);
-        return NULL;
-    }
-
-    if (hls_init_playlist(&context->hls_ctx, hls_path) != SUCCESS) {
-        ERROR("error: hls_init_playlist failed.\n");
-        return NULL;
-    }
-
-    ctx = &context->hls_ctx;
-    ctx->winfrags = g_winfrages;
-    ctx->nfrags = 0;
-    ctx->frag = 0;
-    ctx->fraglen = g_fraglen;
-    ctx->max_fraglen = g_max_fraglen;
-    ctx->bStart = 0;
-    
-    if (ctx->frags == NULL) {
-        ctx->frags = (hls_frag_t*) new hls_frag_t [ctx->winfrags*2+1];   
-        memset(ctx->frags, 0, sizeof(hls_frag_t)*(ctx->winfrags*2+1));
-    }
-    return context;    
+    ERROR("usage: %s [-j threads] [-o json|csv] [-p] [-l list] "
+          "[-s file.flv] [file.flv ...]\n", name);
 }
 
+
 int main(int argc, char*argv[])
 {
-    char header[9];
-    u_int32_t g_pos4firstpkt = 0;
-    int ret = SUCCESS;
-    u_int32_t vstartime = 0;
-    char *source = "test";
-    int c;
-
-    while ((c = getopt(argc, argv, "w:f:m:s:")) != -1) {
+    std::vector<std::string>            paths;
+    sps_jobs_t                          jobs;
+    sps_stat_t                          *stats;
+    pthread_t                           tids[SPS_MAX_THREADS];
+    u_int32_t                           i, n;
+    int                                 c, failed;
+
+    while ((c = getopt(argc, argv, "j:o:pl:s:")) != -1) {
         switch (c) {
-            case 'c':
-                g_winfrages = atoi(optarg);
-                printf("g_winfrages:%d\n", g_winfrages);
+            case 'j':
+                g_threads = atoi(optarg);
+                break;
+            case 'o':
+                if (strcmp(optarg, "csv") == 0) {
+                    g_format = SPS_FORMAT_CSV;
+                } else if (strcmp(optarg, "json") == 0) {
+                    g_format = SPS_FORMAT_JSON;
+                } else {
+                    usage(argv[0]);
+                    return ERROR_NORMAL;
+                }
                 break;
-            case 'f':
-                g_fraglen = atoi(optarg);
-                printf("g_fraglen:%d\n", g_fraglen);
+            case 'p':
+                g_per_second = 1;
                 break;
-            case 'm':
-                g_max_fraglen = atoi(optarg);
-                printf("g_max_fraglen:%d\n", g_max_fraglen);
+            case 'l':
+                if (sps_read_list(optarg, paths) != SUCCESS) {
+                    return ERROR_NORMAL;
+                }
                 break;
             case 's':
-                source = optarg;
+                paths.push_back(optarg);
                 break;
             default:
-                exit(0);
+                usage(argv[0]);
+                return ERROR_NORMAL;
         }
     }
 
-    time_t startid = time(NULL);
+    for (i = optind; i < (u_int32_t) argc; i++) {
+        paths.push_back(argv[i]);
+    }
 
-    Flv2hlsContext* g_con = init_context(source);  
-    if( !g_con )
-    {
-        ERROR("error: fail to open test.flv\n");
-        return 0;
-    }
-
-    if (flv_read_header(g_con, &header, &g_pos4firstpkt) != SUCCESS) {
-        ERROR("error: read flv header failed.\n");
-        return 0;
-    }
-
-    DEBUG("startid:%d\n", startid);
-    startid = startid - 10;
-    while(true){
-        char type;
-        u_int32_t timestamp=0;
-        u_int32_t size = 0;
-        
-        
-        if ((ret = flv_read_tag_header(g_con, &type, &size, &timestamp)) != SUCCESS) {        
-            ERROR("error: flv_read_tag_header failed \n"); 
-            return 0;
-            char tmpname[35] = {0};
-            sprintf(tmpname, "test-%d.flv", startid);
-            std::string clippath = tmpname;
-            g_con->flvreader.close();
-            if (g_con->flvreader.open(clippath) != SUCCESS) {
-               DEBUG("open clip:%s failed, try 1s later\n", clippath.c_str());
-               sleep(1);
-               continue;
-            }
+    if (paths.empty()) {
+        usage(argv[0]);
+        return ERROR_NORMAL;
+    }
 
-            if (g_con->flvdec.initialize(&g_con->flvreader) != SUCCESS) {
-                ERROR("init new clip failed\n");
-                return 0;
-            }
-            DEBUG("using new clip:%s\n", clippath.c_str());
-            startid++;
-            if ((ret = flv_read_tag_header(g_con, &type, &size, &timestamp)) != SUCCESS) {        
-                ERROR("real error: flv_read_tag_header failed \n"); 
-                return 0;
-            }
-        }
-        if( vstartime == 0 )
-        {
-            vstartime = timestamp;
-        }
-        char* data = new char[size];
-        DEBUG("flv frametype:%d, timestamp:%u\n", type, timestamp);
-        if ((ret = flv_read_tag_data(g_con, &data, size, type)) != SUCCESS) {
-            ERROR("error: flv_read_tag_data failed\n");
-            delete data;
-            return 0;
+    stats = new sps_stat_t[paths.size()]();
+
+    for (i = 0; i < paths.size(); i++) {
+        stats[i].path = paths[i].c_str();
+    }
+
+    jobs.stats = stats;
+    jobs.n = (u_int32_t) paths.size();
+    jobs.next = 0;
+
+    /* the disks are the limit, not the cpus */
+    n = g_threads > 0 ? (u_int32_t) g_threads
+                      : (u_int32_t) sysconf(_SC_NPROCESSORS_ONLN);
+    n = n < 1 ? 1 : n > SPS_MAX_THREADS ? SPS_MAX_THREADS : n;
+    n = n > jobs.n ? jobs.n : n;
+
+    for (i = 0; i < n; i++) {
+        if (pthread_create(&tids[i], NULL, sps_worker, &jobs) != 0) {
+            ERROR("error: start thread failed\n");
+            break;
         }
-        if( type == NGX_RTMP_MSG_VIDEO )
-        {
-            av_codec_parse_avc_header(g_con, (u_int8_t*)data, size);
+    }
+
+    /* the files left are done here when no thread started */
+    if (i == 0) {
+        sps_worker(&jobs);
+    }
+
+    n = i;
+    for (i = 0; i < n; i++) {
+        pthread_join(tids[i], NULL);
+    }
+
+    failed = 0;
+
+    if (g_format == SPS_FORMAT_CSV) {
+        sps_print_csv_header(stdout);
+    } else {
+        printf("[\n");
+    }
+
+    for (i = 0; i < jobs.n; i++) {
+        if (stats[i].error) {
+            ERROR("error: %s, %s\n", stats[i].path, stats[i].error);
+            failed = 1;
         }
-        else if( type == NGX_RTMP_MSG_AUDIO )
-        {
-            av_codec_parse_aac_header(g_con, (u_int8_t*)data, size);
+
+        if (g_format == SPS_FORMAT_CSV) {
+            sps_print_csv(stdout, &stats[i]);
+
+        } else {
+            sps_print_json(stdout, &stats[i]);
+            printf("%s\n", i + 1 < jobs.n ? "," : "");
         }
+
+        free(stats[i].seconds);
+    }
+
+    if (g_format == SPS_FORMAT_JSON) {
+        printf("]\n");
     }
-    
-    flv_close(g_con);
-    ERROR(" job finished\n"); 
-    return 0;
+
+    delete [] stats;
+
+    return failed ? ERROR_NORMAL : SUCCESS;
 }